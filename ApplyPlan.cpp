@@ -0,0 +1,231 @@
+#include "ApplyPlan.h"
+#include <QList>
+
+namespace {
+
+QString quotePowerShell(const QString &value)
+{
+    QString escaped = value;
+    escaped.replace("'", "''");
+    return "'" + escaped + "'";
+}
+
+} // namespace
+
+ApplyPlan ApplyPlan::compile(const QString &adapterName, const IpConfig &config)
+{
+    return compile(adapterName, ConfigDelta::full(config));
+}
+
+ApplyPlan ApplyPlan::compile(const QString &adapterName, const ConfigDelta &delta)
+{
+    ApplyPlan plan;
+    plan.m_adapterName = adapterName;
+    const QString nameArg = QString("name=%1").arg(adapterName);
+    const IpConfig &config = delta.target();
+    const AdapterState &live = delta.live();
+    // Empty unless restoring a snapshot
+    const AdapterState &snapshot = delta.snapshot();
+
+    if (config.isDhcp) {
+        if (delta.has(ConfigDelta::Dhcp)) {
+            plan.addStep(QString("切换到DHCP"),
+                         QStringList() << "interface" << "ipv4" << "set" << "address"
+                                       << nameArg << "source=dhcp");
+        }
+    } else if (delta.has(ConfigDelta::Address)) {
+        // Address, mask and gateway in one call so the adapter is only
+        // reconfigured once
+        QStringList addressArgs = QStringList() << "interface" << "ipv4" << "set" << "address"
+                                                << nameArg << "source=static"
+                                                << QString("address=%1").arg(config.ipAddress)
+                                                << QString("mask=%1").arg(config.subnetMask);
+        if (!config.gateway.isEmpty()) {
+            addressArgs << QString("gateway=%1").arg(config.gateway) << "gwmetric=1";
+        }
+        plan.addStep(QString("设置IP地址 %1/%2").arg(config.ipAddress, config.subnetMask), addressArgs);
+
+        for (const InterfaceAddress &address : snapshot.addresses.mid(1)) {
+            const QString mask = ConfigDelta::maskFromPrefix(address.prefixLength);
+            plan.addStep(QString("添加IP地址 %1/%2").arg(address.address, mask),
+                         QStringList() << "interface" << "ipv4" << "add" << "address"
+                                       << nameArg
+                                       << QString("address=%1").arg(address.address)
+                                       << QString("mask=%1").arg(mask));
+        }
+    } else if (delta.has(ConfigDelta::Gateway)) {
+        // Only the default route; the address stays up
+        const QString interfaceArg = QString("interface=%1").arg(adapterName);
+        for (const QString &gateway : live.gateways) {
+            plan.addStep(QString("删除默认网关 %1").arg(gateway),
+                         QStringList() << "interface" << "ipv4" << "delete" << "route"
+                                       << "prefix=0.0.0.0/0" << interfaceArg
+                                       << QString("nexthop=%1").arg(gateway));
+        }
+        if (!config.gateway.isEmpty()) {
+            plan.addStep(QString("设置默认网关 %1").arg(config.gateway),
+                         QStringList() << "interface" << "ipv4" << "add" << "route"
+                                       << "prefix=0.0.0.0/0" << interfaceArg
+                                       << QString("nexthop=%1").arg(config.gateway)
+                                       << "metric=1");
+        }
+    }
+
+    if (delta.has(ConfigDelta::DnsDhcp)) {
+        plan.addStep(QString("DNS切换到DHCP"),
+                     QStringList() << "interface" << "ipv4" << "set" << "dnsservers"
+                                   << nameArg << "source=dhcp");
+    }
+
+    if (delta.has(ConfigDelta::PrimaryDns) && config.dns1.isEmpty()) {
+        // Restoring a snapshot that had no DNS servers
+        plan.addStep(QString("清除DNS"),
+                     QStringList() << "interface" << "ipv4" << "set" << "dnsservers"
+                                   << nameArg << "source=static" << "address=none"
+                                   << "validate=no");
+    } else if (delta.has(ConfigDelta::PrimaryDns)) {
+        plan.addStep(QString("设置首选DNS %1").arg(config.dns1),
+                     QStringList() << "interface" << "ipv4" << "set" << "dnsservers"
+                                   << nameArg << "source=static"
+                                   << QString("address=%1").arg(config.dns1)
+                                   << "register=primary" << "validate=no");
+    } else if (delta.has(ConfigDelta::SecondaryDns)) {
+        // Keep the first server, replace the rest
+        for (const QString &server : live.dnsServers.mid(1)) {
+            plan.addStep(QString("删除DNS %1").arg(server),
+                         QStringList() << "interface" << "ipv4" << "delete" << "dnsservers"
+                                       << nameArg
+                                       << QString("address=%1").arg(server)
+                                       << "validate=no");
+        }
+    }
+
+    // set dnsservers drops the secondary, so it goes back in either way
+    if ((delta.has(ConfigDelta::PrimaryDns) || delta.has(ConfigDelta::SecondaryDns)) &&
+        !config.dns2.isEmpty()) {
+        plan.addStep(QString("添加备用DNS %1").arg(config.dns2),
+                     QStringList() << "interface" << "ipv4" << "add" << "dnsservers"
+                                   << nameArg
+                                   << QString("address=%1").arg(config.dns2)
+                                   << "index=2" << "validate=no");
+    }
+    if (delta.has(ConfigDelta::PrimaryDns)) {
+        const QStringList servers = snapshot.dnsServers.mid(2);
+        for (int i = 0; i < servers.size(); ++i) {
+            plan.addStep(QString("添加DNS %1").arg(servers[i]),
+                         QStringList() << "interface" << "ipv4" << "add" << "dnsservers"
+                                       << nameArg
+                                       << QString("address=%1").arg(servers[i])
+                                       << QString("index=%1").arg(i + 3) << "validate=no");
+        }
+    }
+
+    return plan;
+}
+
+bool ApplyPlan::isEmpty() const
+{
+    return m_steps.isEmpty();
+}
+
+const QVector<ApplyStep> &ApplyPlan::steps() const
+{
+    return m_steps;
+}
+
+QString ApplyPlan::adapterName() const
+{
+    return m_adapterName;
+}
+
+QString ApplyPlan::toShellScript() const
+{
+    // netsh writes in the OEM code page; switch the console encoding while
+    // it runs so its messages are decoded correctly, then restore UTF-8
+    // for the host's own framing
+    QString script;
+    script += "$oem = [System.Text.Encoding]::GetEncoding([System.Globalization.CultureInfo]::CurrentCulture.TextInfo.OEMCodePage)\n";
+    script += "$utf8 = [Console]::OutputEncoding\n";
+    script += "$steps = @()\n";
+
+    for (const ApplyStep &step : m_steps) {
+        QStringList quoted;
+        for (const QString &argument : step.arguments) {
+            quoted << quotePowerShell(argument);
+        }
+        script += QString("$steps += ,@(%1)\n").arg(quoted.join(", "));
+    }
+
+    script += "try {\n"
+              "    for ($i = 0; $i -lt $steps.Count; $i++) {\n"
+              "        [Console]::OutputEncoding = $oem\n"
+              "        $out = & netsh @($steps[$i]) 2>&1 | Out-String\n"
+              "        $code = $LASTEXITCODE\n"
+              "        [Console]::OutputEncoding = $utf8\n"
+              "        [Console]::Out.WriteLine(\"@@PROGRESS $RequestId $i $code\")\n"
+              "        [Console]::Out.Flush()\n"
+              "        \"@@STEP $i $code\"\n"
+              "        $out.TrimEnd()\n"
+              "        if ($code -ne 0) { break }\n"
+              "    }\n"
+              "} finally {\n"
+              "    [Console]::OutputEncoding = $utf8\n"
+              "}\n";
+
+    return script;
+}
+
+QString ApplyPlan::describe() const
+{
+    QStringList lines;
+    for (int i = 0; i < m_steps.size(); ++i) {
+        lines << QString("%1. %2").arg(i + 1).arg(m_steps[i].description);
+    }
+    return lines.join('\n');
+}
+
+QVector<ApplyStepResult> ApplyPlan::parseResults(const QByteArray &output) const
+{
+    QVector<ApplyStepResult> results(m_steps.size());
+    int current = -1;
+
+    const QList<QByteArray> lines = output.split('\n');
+    for (QByteArray line : lines) {
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+
+        if (line.startsWith("@@STEP ")) {
+            const QList<QByteArray> parts = line.mid(7).split(' ');
+            bool ok = false;
+            const int index = parts.value(0).toInt(&ok);
+            if (ok && index >= 0 && index < results.size()) {
+                current = index;
+                results[current].executed = true;
+                results[current].exitCode = parts.value(1).toInt();
+                continue;
+            }
+        }
+
+        if (current >= 0) {
+            if (!results[current].output.isEmpty()) {
+                results[current].output += '\n';
+            }
+            results[current].output += QString::fromUtf8(line);
+        }
+    }
+
+    for (ApplyStepResult &result : results) {
+        result.output = result.output.trimmed();
+    }
+
+    return results;
+}
+
+void ApplyPlan::addStep(const QString &description, const QStringList &arguments)
+{
+    ApplyStep step;
+    step.description = description;
+    step.arguments = arguments;
+    m_steps.append(step);
+}
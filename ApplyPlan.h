@@ -0,0 +1,48 @@
+#ifndef APPLYPLAN_H
+#define APPLYPLAN_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "IpConfigManager.h"
+#include "ConfigDelta.h"
+
+struct ApplyStep {
+    QString description;
+    QStringList arguments;  // netsh arguments, one entry per argv element
+};
+
+struct ApplyStepResult {
+    bool executed = false;
+    int exitCode = -1;
+    QString output;
+};
+
+// Ordered batch of netsh steps compiled from an IpConfig, or from just the
+// parts of it that differ from the adapter's state. The whole plan is
+// sent to the shell host as one request; steps run in order and the batch
+// stops at the first failing step, so later steps never see a half-applied
+// adapter.
+class ApplyPlan
+{
+public:
+    static ApplyPlan compile(const QString &adapterName, const IpConfig &config);
+    static ApplyPlan compile(const QString &adapterName, const ConfigDelta &delta);
+
+    bool isEmpty() const;
+    const QVector<ApplyStep> &steps() const;
+    QString adapterName() const;
+
+    QString toShellScript() const;
+    QString describe() const;
+    QVector<ApplyStepResult> parseResults(const QByteArray &output) const;
+
+private:
+    void addStep(const QString &description, const QStringList &arguments);
+
+    QString m_adapterName;
+    QVector<ApplyStep> m_steps;
+};
+
+#endif // APPLYPLAN_H
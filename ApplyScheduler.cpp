@@ -0,0 +1,228 @@
+#include "ApplyScheduler.h"
+#include "NetworkWorker.h"
+#include <QMetaObject>
+#include <QThread>
+#include <QDebug>
+
+ApplyScheduler::ApplyScheduler(QObject *parent)
+    : QObject(parent)
+    , m_maxWorkers(qBound(1, QThread::idealThreadCount(), 4))
+    , m_completed(0)
+    , m_superseded(0)
+    , m_lastLatencyMs(0)
+    , m_totalLatencyMs(0)
+    , m_maxLatencyMs(0)
+{
+    bool ok = false;
+    const int configured = qEnvironmentVariableIntValue("IPTOOL_APPLY_WORKERS", &ok);
+    if (ok && configured > 0) {
+        m_maxWorkers = configured;
+    }
+}
+
+ApplyScheduler::~ApplyScheduler()
+{
+    for (const Worker &worker : m_workers) {
+        worker.worker->cancelAll();
+        worker.thread->quit();
+    }
+    for (const Worker &worker : m_workers) {
+        worker.thread->wait();
+    }
+}
+
+void ApplyScheduler::submit(quint64 operationId, const QString &adapterName, const IpConfig &config,
+                            bool captureRevert)
+{
+    Request request;
+    request.operationId = operationId;
+    request.adapterName = adapterName;
+    request.config = config;
+    request.captureRevert = captureRevert;
+    request.submitted.start();
+    enqueue(request);
+}
+
+void ApplyScheduler::submitDelta(quint64 operationId, const QString &adapterName, const ConfigDelta &delta)
+{
+    Request request;
+    request.operationId = operationId;
+    request.adapterName = adapterName;
+    request.delta = delta;
+    request.precomputed = true;
+    request.submitted.start();
+    enqueue(request);
+}
+
+void ApplyScheduler::enqueue(const Request &request)
+{
+    const quint64 operationId = request.operationId;
+    const QString adapterName = request.adapterName;
+
+    auto it = m_waiting.find(adapterName);
+    if (it != m_waiting.end()) {
+        // Latest wins; the adapter keeps its place in line
+        const quint64 replaced = it->operationId;
+        *it = request;
+        ++m_superseded;
+        emit operationSuperseded(replaced, operationId);
+    } else {
+        m_waiting.insert(adapterName, request);
+        m_waitingOrder.append(adapterName);
+    }
+
+    dispatch();
+    emit statsChanged();
+}
+
+bool ApplyScheduler::cancel(quint64 operationId)
+{
+    for (const Worker &worker : m_workers) {
+        if (worker.request.operationId == operationId) {
+            // Still reports through operationFinished
+            worker.worker->cancel(operationId);
+            return true;
+        }
+    }
+
+    for (auto it = m_waiting.begin(); it != m_waiting.end(); ++it) {
+        if (it->operationId == operationId) {
+            m_waitingOrder.removeOne(it.key());
+            m_waiting.erase(it);
+            emit operationFinished(operationId, false, QString("操作已取消。"));
+            emit statsChanged();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ApplyScheduler::cancelAll()
+{
+    const QList<Request> waiting = m_waiting.values();
+    m_waiting.clear();
+    m_waitingOrder.clear();
+
+    for (const Worker &worker : m_workers) {
+        if (worker.request.operationId != 0) {
+            worker.worker->cancel(worker.request.operationId);
+        }
+    }
+
+    for (const Request &request : waiting) {
+        emit operationFinished(request.operationId, false, QString("操作已取消。"));
+    }
+    emit statsChanged();
+}
+
+int ApplyScheduler::queueDepth() const
+{
+    return m_waiting.size();
+}
+
+int ApplyScheduler::workerCount() const
+{
+    return m_maxWorkers;
+}
+
+ApplySchedulerStats ApplyScheduler::stats() const
+{
+    ApplySchedulerStats stats;
+    stats.queueDepth = m_waiting.size();
+    stats.running = m_busyAdapters.size();
+    stats.completed = m_completed;
+    stats.superseded = m_superseded;
+    stats.lastLatencyMs = m_lastLatencyMs;
+    stats.averageLatencyMs = m_completed > 0 ? m_totalLatencyMs / m_completed : 0;
+    stats.maxLatencyMs = m_maxLatencyMs;
+    return stats;
+}
+
+void ApplyScheduler::dispatch()
+{
+    for (int i = 0; i < m_waitingOrder.size();) {
+        const QString adapterName = m_waitingOrder[i];
+
+        // One operation per adapter at a time
+        if (m_busyAdapters.contains(adapterName)) {
+            ++i;
+            continue;
+        }
+
+        const int index = idleWorker();
+        if (index < 0) {
+            return;
+        }
+
+        m_waitingOrder.removeAt(i);
+        Worker &slot = m_workers[index];
+        slot.request = m_waiting.take(adapterName);
+        m_busyAdapters.insert(adapterName, index);
+
+        NetworkWorker *worker = slot.worker;
+        const Request request = slot.request;
+        QMetaObject::invokeMethod(worker, [worker, request]() {
+            if (request.precomputed) {
+                worker->applyDelta(request.operationId, request.adapterName, request.delta);
+            } else {
+                worker->applyConfig(request.operationId, request.adapterName, request.config,
+                                    request.captureRevert);
+            }
+        }, Qt::QueuedConnection);
+    }
+}
+
+int ApplyScheduler::idleWorker()
+{
+    for (int i = 0; i < m_workers.size(); ++i) {
+        if (m_workers[i].request.operationId == 0) {
+            return i;
+        }
+    }
+
+    if (m_workers.size() >= m_maxWorkers) {
+        return -1;
+    }
+
+    // Each worker creates its own backend on first use, so a slow netsh
+    // call on one adapter does not hold up the others
+    Worker slot;
+    slot.thread = new QThread(this);
+    slot.worker = new NetworkWorker;
+    slot.worker->moveToThread(slot.thread);
+    connect(slot.thread, &QThread::finished, slot.worker, &QObject::deleteLater);
+    connect(slot.worker, &NetworkWorker::operationProgress, this, &ApplyScheduler::operationProgress);
+    connect(slot.worker, &NetworkWorker::operationFinished, this, &ApplyScheduler::onWorkerFinished);
+    connect(slot.worker, &NetworkWorker::revertPrepared, this, &ApplyScheduler::revertPrepared);
+
+    slot.thread->setObjectName(QString("ApplyWorker%1").arg(m_workers.size()));
+    slot.thread->start();
+
+    m_workers.append(slot);
+    return m_workers.size() - 1;
+}
+
+void ApplyScheduler::onWorkerFinished(quint64 operationId, bool success, const QString &message)
+{
+    for (Worker &slot : m_workers) {
+        if (slot.request.operationId != operationId) {
+            continue;
+        }
+
+        const double latencyMs = slot.request.submitted.nsecsElapsed() / 1e6;
+        m_busyAdapters.remove(slot.request.adapterName);
+        slot.request = Request();
+
+        ++m_completed;
+        m_lastLatencyMs = latencyMs;
+        m_totalLatencyMs += latencyMs;
+        m_maxLatencyMs = qMax(m_maxLatencyMs, latencyMs);
+        break;
+    }
+
+    emit operationFinished(operationId, success, message);
+
+    dispatch();
+    emit statsChanged();
+}
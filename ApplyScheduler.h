@@ -0,0 +1,100 @@
+#ifndef APPLYSCHEDULER_H
+#define APPLYSCHEDULER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include "IpConfigManager.h"
+#include "ConfigDelta.h"
+
+class QThread;
+class NetworkWorker;
+
+struct ApplySchedulerStats {
+    int queueDepth = 0;         // Waiting for their adapter or a worker
+    int running = 0;
+    quint64 completed = 0;
+    quint64 superseded = 0;
+    double lastLatencyMs = 0;   // Submission to completion
+    double averageLatencyMs = 0;
+    double maxLatencyMs = 0;
+};
+
+// Runs applyConfig operations for NetworkAdapterManager. Work for one
+// adapter is strictly serialized; different adapters run in parallel, each
+// on a pool worker with its own backend instance.
+//
+// Each adapter has at most one waiting request. Submitting another one
+// while it waits replaces it (latest wins) and reports the old one through
+// operationSuperseded() instead of operationFinished(); an operation that
+// has already started always runs to completion.
+class ApplyScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ApplyScheduler(QObject *parent = nullptr);
+    ~ApplyScheduler();
+
+    void submit(quint64 operationId, const QString &adapterName, const IpConfig &config,
+                bool captureRevert = false);
+    // A delta worked out earlier, run without re-reading the adapter
+    void submitDelta(quint64 operationId, const QString &adapterName, const ConfigDelta &delta);
+
+    // Returns false if the operation is not (or no longer) known here
+    bool cancel(quint64 operationId);
+    void cancelAll();
+
+    int queueDepth() const;
+    int workerCount() const;
+    ApplySchedulerStats stats() const;
+
+signals:
+    void operationProgress(quint64 operationId, int step, int totalSteps, const QString &description);
+    void operationFinished(quint64 operationId, bool success, const QString &message);
+    void operationSuperseded(quint64 operationId, quint64 replacedBy);
+    void revertPrepared(quint64 operationId, const ConfigDelta &revert);
+    void statsChanged();
+
+private slots:
+    void onWorkerFinished(quint64 operationId, bool success, const QString &message);
+
+private:
+    struct Request {
+        quint64 operationId = 0;
+        QString adapterName;
+        IpConfig config;
+        ConfigDelta delta;
+        bool precomputed = false;   // Run delta instead of config
+        bool captureRevert = false;
+        QElapsedTimer submitted;
+    };
+
+    struct Worker {
+        QThread *thread = nullptr;
+        NetworkWorker *worker = nullptr;
+        Request request;        // operationId 0 while idle
+    };
+
+    void enqueue(const Request &request);
+    void dispatch();
+    int idleWorker();
+
+    QVector<Worker> m_workers;  // Grows on demand up to m_maxWorkers
+    int m_maxWorkers;
+
+    QHash<QString, Request> m_waiting;  // By adapter name
+    QList<QString> m_waitingOrder;      // Adapters in submission order
+    QHash<QString, int> m_busyAdapters; // Adapter -> worker index
+
+    quint64 m_completed;
+    quint64 m_superseded;
+    double m_lastLatencyMs;
+    double m_totalLatencyMs;
+    double m_maxLatencyMs;
+};
+
+#endif // APPLYSCHEDULER_H
@@ -0,0 +1,248 @@
+#include "BinaryConfigStore.h"
+#include <QFile>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const char kMagic[4] = { 'I', 'P', 'C', 'B' };
+const quint16 kVersion = 1;
+const int kHeaderSize = 24;
+const int kRecordSize = 40;
+
+enum RecordField {
+    FieldName,
+    FieldIp,
+    FieldMask,
+    FieldGateway,
+    FieldDns1,
+    FieldDns2,
+    FieldGuid,
+    FieldFlags
+};
+
+enum RecordFlag {
+    FlagDhcp = 0x01
+};
+
+quint32 readU32(const uchar *p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+// Field offsets inside a record, after the 8-byte id
+const uchar *field(const uchar *record, RecordField which)
+{
+    return record + 8 + 4 * int(which);
+}
+
+void appendU16(QByteArray &out, quint16 value)
+{
+    uchar bytes[2];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), 2);
+}
+
+void appendU32(QByteArray &out, quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), 4);
+}
+
+void appendU64(QByteArray &out, quint64 value)
+{
+    uchar bytes[8];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), 8);
+}
+
+} // namespace
+
+BinaryConfigStore::BinaryConfigStore()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_count(0)
+    , m_records(nullptr)
+    , m_strings(nullptr)
+    , m_stringsSize(0)
+{
+}
+
+BinaryConfigStore::~BinaryConfigStore()
+{
+    close();
+}
+
+bool BinaryConfigStore::open(const QString &path, QString *error)
+{
+    close();
+
+    auto fail = [this, error](const QString &message) {
+        if (error) {
+            *error = message;
+        }
+        close();
+        return false;
+    };
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(file.errorString());
+    }
+    m_buffer = file.readAll();
+    if (file.error() != QFileDevice::NoError) {
+        return fail(file.errorString());
+    }
+    file.close();
+
+    m_size = m_buffer.size();
+    if (m_size < kHeaderSize) {
+        return fail(QString("file too short"));
+    }
+    m_data = reinterpret_cast<const uchar *>(m_buffer.constData());
+
+    if (std::memcmp(m_data, kMagic, sizeof(kMagic)) != 0) {
+        return fail(QString("not a binary profile store"));
+    }
+    if (qFromLittleEndian<quint16>(m_data + 4) != kVersion ||
+        qFromLittleEndian<quint16>(m_data + 6) != kRecordSize) {
+        return fail(QString("unsupported version"));
+    }
+
+    m_count = readU32(m_data + 8);
+    const quint32 stringsOffset = readU32(m_data + 12);
+    m_stringsSize = readU32(m_data + 16);
+
+    // Everything a lookup touches must lie inside the file
+    const quint64 recordsEnd = quint64(kHeaderSize) + quint64(m_count) * kRecordSize;
+    if (recordsEnd > quint64(m_size) || stringsOffset < recordsEnd ||
+        quint64(stringsOffset) + m_stringsSize > quint64(m_size)) {
+        return fail(QString("truncated or damaged"));
+    }
+
+    m_records = m_data + kHeaderSize;
+    m_strings = m_data + stringsOffset;
+    return true;
+}
+
+void BinaryConfigStore::close()
+{
+    m_buffer = QByteArray();
+    m_data = nullptr;
+    m_size = 0;
+    m_count = 0;
+    m_records = nullptr;
+    m_strings = nullptr;
+    m_stringsSize = 0;
+    m_guids.clear();
+}
+
+quint64 BinaryConfigStore::id(int index) const
+{
+    return qFromLittleEndian<quint64>(record(index));
+}
+
+QString BinaryConfigStore::adapterGuid(int index) const
+{
+    const quint32 offset = readU32(field(record(index), FieldGuid));
+    auto it = m_guids.constFind(offset);
+    if (it == m_guids.constEnd()) {
+        it = m_guids.insert(offset, string(offset));
+    }
+    return *it;
+}
+
+IpConfig BinaryConfigStore::decode(int index) const
+{
+    const uchar *data = record(index);
+
+    IpConfig config;
+    config.id = qFromLittleEndian<quint64>(data);
+    config.name = string(readU32(field(data, FieldName)));
+    config.ipAddress = string(readU32(field(data, FieldIp)));
+    config.subnetMask = string(readU32(field(data, FieldMask)));
+    config.gateway = string(readU32(field(data, FieldGateway)));
+    config.dns1 = string(readU32(field(data, FieldDns1)));
+    config.dns2 = string(readU32(field(data, FieldDns2)));
+    config.adapterGuid = adapterGuid(index);
+    config.isDhcp = readU32(field(data, FieldFlags)) & FlagDhcp;
+    return config;
+}
+
+QByteArray BinaryConfigStore::encode(const QVector<IpConfig> &configs)
+{
+    QByteArray strings;
+    QHash<QString, quint32> offsets;
+    appendU16(strings, 0);
+    offsets.insert(QString(), 0);
+
+    auto intern = [&strings, &offsets](const QString &value) -> quint32 {
+        const auto it = offsets.constFind(value);
+        if (it != offsets.constEnd()) {
+            return *it;
+        }
+        // Longer strings are cut; no profile field comes close
+        QByteArray utf8 = value.toUtf8().left(0xFFFF);
+        const quint32 offset = quint32(strings.size());
+        appendU16(strings, quint16(utf8.size()));
+        strings.append(utf8);
+        offsets.insert(value, offset);
+        return offset;
+    };
+
+    QByteArray records;
+    records.reserve(configs.size() * kRecordSize);
+    for (const IpConfig &config : configs) {
+        appendU64(records, config.id);
+        appendU32(records, intern(config.name));
+        appendU32(records, intern(config.ipAddress));
+        appendU32(records, intern(config.subnetMask));
+        appendU32(records, intern(config.gateway));
+        appendU32(records, intern(config.dns1));
+        appendU32(records, intern(config.dns2));
+        appendU32(records, intern(config.adapterGuid));
+        appendU32(records, config.isDhcp ? FlagDhcp : 0);
+    }
+
+    QByteArray out;
+    out.reserve(kHeaderSize + records.size() + strings.size());
+    out.append(kMagic, sizeof(kMagic));
+    appendU16(out, kVersion);
+    appendU16(out, kRecordSize);
+    appendU32(out, quint32(configs.size()));
+    appendU32(out, quint32(kHeaderSize + records.size()));
+    appendU32(out, quint32(strings.size()));
+    appendU32(out, 0);
+    out.append(records);
+    out.append(strings);
+    return out;
+}
+
+bool BinaryConfigStore::hasMagic(const QString &path)
+{
+    QFile file(path);
+    char magic[sizeof(kMagic)];
+    return file.open(QIODevice::ReadOnly) &&
+           file.read(magic, sizeof(magic)) == qint64(sizeof(magic)) &&
+           std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+const uchar *BinaryConfigStore::record(int index) const
+{
+    Q_ASSERT(index >= 0 && quint32(index) < m_count);
+    return m_records + qsizetype(index) * kRecordSize;
+}
+
+QString BinaryConfigStore::string(quint32 offset) const
+{
+    // A bad offset reads as empty rather than outside the file
+    if (quint64(offset) + 2 > m_stringsSize) {
+        return QString();
+    }
+    const quint16 length = qFromLittleEndian<quint16>(m_strings + offset);
+    if (quint64(offset) + 2 + length > m_stringsSize) {
+        return QString();
+    }
+    return QString::fromUtf8(reinterpret_cast<const char *>(m_strings + offset + 2), length);
+}
@@ -0,0 +1,61 @@
+#ifndef BINARYCONFIGSTORE_H
+#define BINARYCONFIGSTORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include "IpConfigManager.h"
+
+// Read-only view of a binary profile checkpoint (ip_configs.bin). The file
+// is read in one go and closed, and nothing is decoded up front: a
+// profile's strings are only built when decode() asks for it, so opening
+// 100k profiles costs one read and a header check. The file is not kept
+// open or mapped, because Windows refuses to replace a mapped file, and
+// another instance must be able to write a new checkpoint.
+//
+// Layout, little-endian:
+//
+//     "IPCB"  u16 version  u16 record size  u32 count
+//     u32 string table offset  u32 string table size  u32 reserved
+//     count records:   u64 id, u32 name, ip, mask, gateway, dns1, dns2,
+//                      adapterGuid, u32 flags (bit 0: DHCP)
+//     string table:    u16 length + UTF-8 bytes per string
+//
+// Strings are referenced by offset into the table and stored once, so the
+// masks, DNS servers and adapter GUIDs shared by many profiles cost a few
+// bytes per profile. Offset 0 is the empty string.
+class BinaryConfigStore
+{
+public:
+    BinaryConfigStore();
+    ~BinaryConfigStore();
+
+    bool open(const QString &path, QString *error = nullptr);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    int count() const { return int(m_count); }
+    quint64 id(int index) const;
+    // Shared between profiles of the same adapter
+    QString adapterGuid(int index) const;
+    IpConfig decode(int index) const;
+
+    static QByteArray encode(const QVector<IpConfig> &configs);
+    static bool hasMagic(const QString &path);
+
+private:
+    const uchar *record(int index) const;
+    QString string(quint32 offset) const;
+
+    QByteArray m_buffer;    // The whole file
+    const uchar *m_data;
+    qint64 m_size;
+    quint32 m_count;
+    const uchar *m_records;
+    const uchar *m_strings;
+    quint32 m_stringsSize;
+    mutable QHash<quint32, QString> m_guids;
+};
+
+#endif // BINARYCONFIGSTORE_H
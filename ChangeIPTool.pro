@@ -13,12 +13,59 @@ SOURCES += \
     main.cpp \
     MainWindow.cpp \
     IpConfigManager.cpp \
-    NetworkAdapterManager.cpp
+    NetworkAdapterManager.cpp \
+    ShellHost.cpp \
+    ApplyPlan.cpp \
+    ApplyScheduler.cpp \
+    BinaryConfigStore.cpp \
+    CommandDeadlines.cpp \
+    CommandMetrics.cpp \
+    CommandTrace.cpp \
+    ConfigDelta.cpp \
+    ConfigIndex.cpp \
+    ConfigTable.cpp \
+    ConfigTransfer.cpp \
+    ConfigWriter.cpp \
+    CsvReader.cpp \
+    NetworkWorker.cpp \
+    NetworkBackend.cpp \
+    NetshBackend.cpp \
+    FakeBackend.cpp \
+    HelperProtocol.cpp \
+    HelperServer.cpp \
+    HelperBackend.cpp
 
 HEADERS += \
     MainWindow.h \
     IpConfigManager.h \
-    NetworkAdapterManager.h
+    IpConfig.h \
+    NetworkAdapterManager.h \
+    ShellHost.h \
+    ApplyPlan.h \
+    ApplyScheduler.h \
+    BinaryConfigStore.h \
+    CommandDeadlines.h \
+    CommandMetrics.h \
+    CommandTrace.h \
+    ConfigDelta.h \
+    ConfigIndex.h \
+    ConfigTable.h \
+    ConfigTransfer.h \
+    ConfigWriter.h \
+    CsvReader.h \
+    NetworkWorker.h \
+    NetworkBackend.h \
+    NetshBackend.h \
+    FakeBackend.h \
+    HelperProtocol.h \
+    HelperServer.h \
+    HelperBackend.h
+
+# Native rtnetlink backend
+linux {
+    SOURCES += NetlinkBackend.cpp
+    HEADERS += NetlinkBackend.h
+}
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
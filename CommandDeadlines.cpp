@@ -0,0 +1,195 @@
+#include "CommandDeadlines.h"
+#include <QJsonArray>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <algorithm>
+
+namespace {
+
+const int kWindowSize = 256;        // Most recent completions per kind
+const int kMinSamples = 10;         // Before this, the call site's timeout applies
+const double kDefaultFactor = 3.0;
+const int kBackoffBaseMs = 200;
+const int kBackoffMaxMs = 5000;
+
+struct KnownPolicy {
+    const char *kind;
+    int floorMs;
+    int ceilingMs;
+    int retries;
+};
+
+// Applies are not retried: a timed-out apply may have run in part, and
+// the user has to see that rather than have it silently run again
+const KnownPolicy kPolicies[] = {
+    { "netsh.enumerateAdapters", 2000, 60000, 1 },
+    { "netsh.readState", 1000, 30000, 1 },
+    { "netsh.readAllStates", 2000, 60000, 1 },
+    { "netsh.apply", 10000, 120000, 0 },
+    { "process.netSession", 500, 15000, 1 },
+};
+
+} // namespace
+
+CommandDeadlines::CommandDeadlines()
+    : m_factor(kDefaultFactor)
+{
+    bool ok = false;
+    const double factor = qEnvironmentVariable("IPTOOL_DEADLINE_FACTOR").toDouble(&ok);
+    if (ok && factor >= 1.0) {
+        m_factor = factor;
+    }
+}
+
+CommandDeadlines *CommandDeadlines::instance()
+{
+    static CommandDeadlines deadlines;
+    return &deadlines;
+}
+
+int CommandDeadlines::timeoutMs(const QString &kind, int initialMs, int attempt)
+{
+    QMutexLocker locker(&m_mutex);
+    m_windows[kind].initialMs = initialMs;
+    return timeoutLocked(kind, initialMs, attempt);
+}
+
+int CommandDeadlines::maxRetries(const QString &kind) const
+{
+    return policy(kind, 0).retries;
+}
+
+int CommandDeadlines::retryDelayMs(int attempt) const
+{
+    const int cap = qMin(kBackoffMaxMs, kBackoffBaseMs << qBound(0, attempt, 8));
+    return int(QRandomGenerator::global()->bounded(cap + 1));
+}
+
+void CommandDeadlines::recordLatency(const QString &kind, qint64 micros)
+{
+    QMutexLocker locker(&m_mutex);
+    addSampleLocked(kind, micros);
+}
+
+void CommandDeadlines::recordTimeout(const QString &kind, int timeoutMs, int attempt, bool retrying)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        Window &window = m_windows[kind];
+        ++window.timeouts;
+        if (retrying) {
+            ++window.retries;
+        }
+        // The command took at least this long
+        addSampleLocked(kind, qint64(timeoutMs) * 1000);
+    }
+
+    emit deadlineExceeded(kind, timeoutMs, attempt, retrying);
+}
+
+QVector<CommandDeadline> CommandDeadlines::snapshot() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QVector<CommandDeadline> result;
+    result.reserve(m_windows.size());
+    for (auto it = m_windows.constBegin(); it != m_windows.constEnd(); ++it) {
+        CommandDeadline entry;
+        entry.kind = it.key();
+        entry.timeoutMs = timeoutLocked(it.key(), it->initialMs, 0);
+        entry.p99Us = p99Locked(it.key());
+        entry.samples = it->samples.size();
+        entry.timeouts = it->timeouts;
+        entry.retries = it->retries;
+        result.append(entry);
+    }
+
+    std::sort(result.begin(), result.end(), [](const CommandDeadline &a, const CommandDeadline &b) {
+        return a.kind < b.kind;
+    });
+    return result;
+}
+
+QJsonObject CommandDeadlines::toJson() const
+{
+    QJsonObject kinds;
+    for (const CommandDeadline &entry : snapshot()) {
+        QJsonObject obj;
+        obj["timeoutMs"] = entry.timeoutMs;
+        obj["p99Us"] = double(entry.p99Us);
+        obj["samples"] = entry.samples;
+        obj["timeouts"] = double(entry.timeouts);
+        obj["retries"] = double(entry.retries);
+        kinds[entry.kind] = obj;
+    }
+
+    QJsonObject root;
+    root["factor"] = m_factor;
+    root["kinds"] = kinds;
+    return root;
+}
+
+void CommandDeadlines::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_windows.clear();
+}
+
+CommandDeadlines::Policy CommandDeadlines::policy(const QString &kind, int initialMs)
+{
+    for (const KnownPolicy &known : kPolicies) {
+        if (kind == QLatin1String(known.kind)) {
+            Policy policy;
+            policy.floorMs = known.floorMs;
+            policy.ceilingMs = known.ceilingMs;
+            policy.retries = known.retries;
+            return policy;
+        }
+    }
+
+    // Anything else may get faster than its call site expects, never slower
+    Policy policy;
+    policy.floorMs = qMax(1, initialMs / 4);
+    policy.ceilingMs = qMax(1, initialMs);
+    return policy;
+}
+
+int CommandDeadlines::timeoutLocked(const QString &kind, int initialMs, int attempt) const
+{
+    const Policy limits = policy(kind, initialMs);
+
+    qint64 deadlineMs = initialMs;
+    const qint64 p99Us = p99Locked(kind);
+    if (p99Us > 0) {
+        deadlineMs = qint64(p99Us * m_factor / 1000.0);
+    }
+    deadlineMs = qBound<qint64>(limits.floorMs, deadlineMs, limits.ceilingMs);
+
+    // Each retry doubles the wait, still within the ceiling
+    deadlineMs <<= qBound(0, attempt, 8);
+    return int(qMin<qint64>(deadlineMs, limits.ceilingMs));
+}
+
+qint64 CommandDeadlines::p99Locked(const QString &kind) const
+{
+    const auto it = m_windows.constFind(kind);
+    if (it == m_windows.constEnd() || it->samples.size() < kMinSamples) {
+        return 0;
+    }
+
+    QVector<qint64> samples = it->samples;
+    const int index = qMin(int(samples.size()) - 1, int(samples.size() * 0.99));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+void CommandDeadlines::addSampleLocked(const QString &kind, qint64 micros)
+{
+    Window &window = m_windows[kind];
+    if (window.samples.size() < kWindowSize) {
+        window.samples.append(micros);
+    } else {
+        window.samples[window.next] = micros;
+        window.next = (window.next + 1) % kWindowSize;
+    }
+}
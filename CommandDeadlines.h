@@ -0,0 +1,83 @@
+#ifndef COMMANDDEADLINES_H
+#define COMMANDDEADLINES_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+struct CommandDeadline {
+    QString kind;
+    int timeoutMs = 0;      // Next first attempt
+    qint64 p99Us = 0;       // Over the window; 0 until enough samples
+    int samples = 0;
+    quint64 timeouts = 0;
+    quint64 retries = 0;
+};
+
+// Timeouts derived from observed latency instead of fixed values. For each
+// command kind the last completions are kept in a rolling window and the
+// deadline is p99 × factor, clamped to the kind's floor and ceiling, so a
+// hung command fails fast on a normal machine while a slow but healthy one
+// gets the time it needs. Until a kind has enough samples, the caller's
+// own timeout is used (still clamped).
+//
+// A timed-out attempt counts as a sample of its deadline, which pushes the
+// next one up. Read-only kinds are retried after a timeout, with a longer
+// deadline and a jittered backoff; applies never are.
+//
+// IPTOOL_DEADLINE_FACTOR changes the multiplier (default 3). Safe to call
+// from any thread; deadlineExceeded() is emitted on the caller's thread.
+class CommandDeadlines : public QObject
+{
+    Q_OBJECT
+
+public:
+    static CommandDeadlines *instance();
+
+    // Deadline for the given attempt (0 for the first) of a command whose
+    // call site would otherwise wait initialMs
+    int timeoutMs(const QString &kind, int initialMs, int attempt = 0);
+    int maxRetries(const QString &kind) const;
+    // Full jitter over an exponential backoff
+    int retryDelayMs(int attempt) const;
+
+    void recordLatency(const QString &kind, qint64 micros);
+    void recordTimeout(const QString &kind, int timeoutMs, int attempt, bool retrying);
+
+    QVector<CommandDeadline> snapshot() const;  // Sorted by kind
+    QJsonObject toJson() const;
+    void reset();
+
+signals:
+    void deadlineExceeded(const QString &kind, int timeoutMs, int attempt, bool retrying);
+
+private:
+    struct Policy {
+        int floorMs = 0;
+        int ceilingMs = 0;
+        int retries = 0;
+    };
+
+    struct Window {
+        QVector<qint64> samples;    // Ring buffer, microseconds
+        int next = 0;
+        int initialMs = 0;          // As given by the call site
+        quint64 timeouts = 0;
+        quint64 retries = 0;
+    };
+
+    CommandDeadlines();
+    static Policy policy(const QString &kind, int initialMs);
+    int timeoutLocked(const QString &kind, int initialMs, int attempt) const;
+    qint64 p99Locked(const QString &kind) const;
+    void addSampleLocked(const QString &kind, qint64 micros);
+
+    double m_factor;
+    mutable QMutex m_mutex;
+    QHash<QString, Window> m_windows;
+};
+
+#endif // COMMANDDEADLINES_H
@@ -0,0 +1,216 @@
+#include "CommandMetrics.h"
+#include <QDateTime>
+#include <QJsonArray>
+#include <QMutexLocker>
+#include <QtAlgorithms>
+#include <algorithm>
+
+namespace {
+
+const int kSubBucketBits = 4;
+const int kSubBuckets = 1 << kSubBucketBits;
+const int kMaxExponent = 40;  // 2^41 us is about 25 days
+const int kBucketCount = (kMaxExponent - kSubBucketBits + 1) * kSubBuckets + kSubBuckets;
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram()
+    : m_buckets(kBucketCount, 0)
+    , m_count(0)
+    , m_sum(0)
+    , m_min(0)
+    , m_max(0)
+{
+}
+
+void LatencyHistogram::record(qint64 micros)
+{
+    micros = qMax<qint64>(micros, 0);
+
+    ++m_buckets[bucketIndex(micros)];
+    m_min = m_count ? qMin(m_min, micros) : micros;
+    m_max = qMax(m_max, micros);
+    m_sum += micros;
+    ++m_count;
+}
+
+void LatencyHistogram::reset()
+{
+    m_buckets.fill(0);
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+}
+
+qint64 LatencyHistogram::percentile(double percent) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+
+    const quint64 rank = qMax<quint64>(1, quint64(qBound(0.0, percent, 100.0) / 100.0 * m_count + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < m_buckets.size(); ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            // Never report more than was actually recorded
+            return qMin(bucketUpperBound(i), m_max);
+        }
+    }
+    return m_max;
+}
+
+QJsonObject LatencyHistogram::toJson() const
+{
+    QJsonObject json;
+    json["count"] = double(m_count);
+    json["minUs"] = double(min());
+    json["maxUs"] = double(m_max);
+    json["meanUs"] = mean();
+    json["p50Us"] = double(percentile(50));
+    json["p90Us"] = double(percentile(90));
+    json["p99Us"] = double(percentile(99));
+    json["p999Us"] = double(percentile(99.9));
+
+    // Only the non-empty buckets, as [upper bound, count] pairs
+    QJsonArray buckets;
+    for (int i = 0; i < m_buckets.size(); ++i) {
+        if (m_buckets[i] != 0) {
+            buckets.append(QJsonArray() << double(bucketUpperBound(i)) << double(m_buckets[i]));
+        }
+    }
+    json["buckets"] = buckets;
+    return json;
+}
+
+int LatencyHistogram::bucketIndex(qint64 micros)
+{
+    if (micros < kSubBuckets) {
+        return int(micros);
+    }
+
+    const int exponent = 63 - int(qCountLeadingZeroBits(quint64(micros)));
+    if (exponent > kMaxExponent) {
+        return kBucketCount - 1;
+    }
+    const int sub = int((micros >> (exponent - kSubBucketBits)) & (kSubBuckets - 1));
+    return (exponent - kSubBucketBits + 1) * kSubBuckets + sub;
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < kSubBuckets) {
+        return index;
+    }
+
+    const int exponent = index / kSubBuckets + kSubBucketBits - 1;
+    const int sub = index % kSubBuckets;
+    const int shift = exponent - kSubBucketBits;
+    return (qint64(kSubBuckets + sub) << shift) + (qint64(1) << shift) - 1;
+}
+
+CommandMetrics::CommandMetrics()
+{
+    m_since.start();
+}
+
+CommandMetrics *CommandMetrics::instance()
+{
+    static CommandMetrics metrics;
+    return &metrics;
+}
+
+void CommandMetrics::record(const QString &kind, const QElapsedTimer &timer, Outcome outcome,
+                            qint64 outputBytes)
+{
+    const qint64 micros = timer.isValid() ? timer.nsecsElapsed() / 1000 : 0;
+
+    QMutexLocker locker(&m_mutex);
+    CommandKindStats &stats = statsFor(kind);
+    ++stats.count;
+    switch (outcome) {
+    case Succeeded:
+        break;
+    case Failed:
+        ++stats.failed;
+        break;
+    case TimedOut:
+        ++stats.timedOut;
+        break;
+    case Cancelled:
+        ++stats.cancelled;
+        break;
+    }
+    stats.outputBytes += quint64(qMax<qint64>(outputBytes, 0));
+    stats.latency.record(micros);
+}
+
+void CommandMetrics::recordSpawn(const QString &kind)
+{
+    QMutexLocker locker(&m_mutex);
+    ++statsFor(kind).spawns;
+}
+
+QVector<CommandKindStats> CommandMetrics::snapshot() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVector<CommandKindStats> stats;
+    stats.reserve(m_stats.size());
+    for (const CommandKindStats &entry : m_stats) {
+        stats.append(entry);
+    }
+    locker.unlock();
+
+    std::sort(stats.begin(), stats.end(), [](const CommandKindStats &a, const CommandKindStats &b) {
+        return a.kind < b.kind;
+    });
+    return stats;
+}
+
+QJsonObject CommandMetrics::toJson() const
+{
+    qint64 uptimeMs;
+    {
+        QMutexLocker locker(&m_mutex);
+        uptimeMs = m_since.elapsed();
+    }
+
+    QJsonObject kinds;
+    for (const CommandKindStats &stats : snapshot()) {
+        QJsonObject entry;
+        entry["count"] = double(stats.count);
+        entry["failed"] = double(stats.failed);
+        entry["timedOut"] = double(stats.timedOut);
+        entry["cancelled"] = double(stats.cancelled);
+        entry["spawns"] = double(stats.spawns);
+        entry["outputBytes"] = double(stats.outputBytes);
+        entry["latency"] = stats.latency.toJson();
+        kinds[stats.kind] = entry;
+    }
+
+    QJsonObject json;
+    json["version"] = 1;
+    json["capturedAt"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    json["uptimeMs"] = double(uptimeMs);
+    json["kinds"] = kinds;
+    return json;
+}
+
+void CommandMetrics::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_stats.clear();
+    m_since.restart();
+}
+
+CommandKindStats &CommandMetrics::statsFor(const QString &kind)
+{
+    auto it = m_stats.find(kind);
+    if (it == m_stats.end()) {
+        CommandKindStats stats;
+        stats.kind = kind;
+        it = m_stats.insert(kind, stats);
+    }
+    return *it;
+}
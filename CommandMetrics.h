@@ -0,0 +1,94 @@
+#ifndef COMMANDMETRICS_H
+#define COMMANDMETRICS_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+// Latency histogram with HDR-style log-linear buckets: 16 sub-buckets per
+// power of two, so every recorded value is kept to within ~6% from 1 us
+// up to days, in a fixed ~5 KB.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 micros);
+    void reset();
+
+    quint64 count() const { return m_count; }
+    qint64 min() const { return m_count ? m_min : 0; }
+    qint64 max() const { return m_max; }
+    double mean() const { return m_count ? double(m_sum) / m_count : 0.0; }
+    // Upper bound of the bucket holding the given percentile (0-100)
+    qint64 percentile(double percent) const;
+
+    QJsonObject toJson() const;
+
+private:
+    static int bucketIndex(qint64 micros);
+    static qint64 bucketUpperBound(int index);
+
+    QVector<quint64> m_buckets;
+    quint64 m_count;
+    qint64 m_sum;
+    qint64 m_min;
+    qint64 m_max;
+};
+
+struct CommandKindStats {
+    QString kind;
+    quint64 count = 0;
+    quint64 failed = 0;
+    quint64 timedOut = 0;
+    quint64 cancelled = 0;
+    quint64 spawns = 0;         // Processes started for this kind
+    quint64 outputBytes = 0;    // Output received and decoded
+    LatencyHistogram latency;
+};
+
+// Process-wide counters for everything that runs a command or talks to
+// the OS: shell host requests, worker operations, helper calls and the
+// processes started for them. Each kind is a short dotted name such as
+// "netsh.readState" or "worker.apply". Safe to call from any thread.
+//
+//     QElapsedTimer timer;
+//     timer.start();
+//     ShellResult result = ...;
+//     CommandMetrics::instance()->record("netsh.apply", timer, outcome, bytes);
+//
+// MainWindow shows the numbers in its Diagnostics dialog, which can also
+// export them as JSON to compare releases.
+class CommandMetrics
+{
+public:
+    enum Outcome {
+        Succeeded,
+        Failed,
+        TimedOut,
+        Cancelled
+    };
+
+    static CommandMetrics *instance();
+
+    void record(const QString &kind, const QElapsedTimer &timer, Outcome outcome,
+                qint64 outputBytes = 0);
+    void recordSpawn(const QString &kind);
+
+    QVector<CommandKindStats> snapshot() const;  // Sorted by kind
+    QJsonObject toJson() const;
+    void reset();
+
+private:
+    CommandMetrics();
+    CommandKindStats &statsFor(const QString &kind);
+
+    mutable QMutex m_mutex;
+    QHash<QString, CommandKindStats> m_stats;
+    QElapsedTimer m_since;
+};
+
+#endif // COMMANDMETRICS_H
@@ -0,0 +1,269 @@
+#include "CommandTrace.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+#include <QDebug>
+#include <cstring>
+
+namespace {
+
+const char kMagic[4] = { 'I', 'P', 'T', 'R' };
+const quint16 kVersion = 1;
+const int kCompressThreshold = 256;  // Bytes; smaller outputs are stored as is
+
+enum EntryFlag {
+    FlagOk = 0x01,
+    FlagTimedOut = 0x02,
+    FlagCancelled = 0x04,
+    FlagCompressed = 0x08
+};
+
+QString entryKey(const QString &kind, const QString &script)
+{
+    return kind + QLatin1Char('\n') + script;
+}
+
+} // namespace
+
+CommandTrace::CommandTrace()
+    : m_recording(false)
+    , m_replaying(false)
+    , m_replayTiming(qEnvironmentVariableIntValue("IPTOOL_REPLAY_TIMING") != 0)
+{
+    const QString replayPath = qEnvironmentVariable("IPTOOL_REPLAY");
+    const QString recordPath = qEnvironmentVariable("IPTOOL_RECORD");
+
+    if (!replayPath.isEmpty()) {
+        m_replaying = loadReplay(replayPath);
+    } else if (!recordPath.isEmpty()) {
+        m_recording = openRecording(recordPath);
+    }
+}
+
+CommandTrace *CommandTrace::instance()
+{
+    static CommandTrace trace;
+    return &trace;
+}
+
+void CommandTrace::record(const Entry &entry)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_recording) {
+        return;
+    }
+    if (!write(&m_file, entry)) {
+        qWarning() << "Failed to write command trace:" << m_file.errorString();
+        m_recording = false;
+        return;
+    }
+    // A crash should not lose what was already captured
+    m_file.flush();
+}
+
+ShellResult CommandTrace::replay(const QString &kind, const QString &script, int timeoutMs,
+                                 const ShellHost::ProgressCallback &onProgress,
+                                 const std::atomic_bool &cancelRequested)
+{
+    Entry entry;
+    {
+        QMutexLocker locker(&m_mutex);
+        const Entry *found = takeEntry(kind, script);
+        if (!found) {
+            qWarning() << "No recorded answer for" << kind << "request";
+            return ShellResult();
+        }
+        entry = *found;
+    }
+
+    if (!m_replayTiming) {
+        if (onProgress) {
+            for (const Progress &progress : entry.progress) {
+                onProgress(progress.payload);
+            }
+        }
+        return entry.result;
+    }
+
+    // Original timing: progress lines at their offsets, the reply after the
+    // recorded wall time
+    QElapsedTimer timer;
+    timer.start();
+    int next = 0;
+
+    for (;;) {
+        const qint64 nowUs = timer.nsecsElapsed() / 1000;
+        while (next < entry.progress.size() && entry.progress[next].offsetUs <= nowUs) {
+            if (onProgress) {
+                onProgress(entry.progress[next].payload);
+            }
+            ++next;
+        }
+
+        if (cancelRequested) {
+            ShellResult result;
+            result.cancelled = true;
+            return result;
+        }
+        if (nowUs >= qint64(timeoutMs) * 1000) {
+            ShellResult result;
+            result.timedOut = true;
+            return result;
+        }
+        if (nowUs >= entry.elapsedUs) {
+            break;
+        }
+
+        // Short sleeps so cancel() is noticed promptly
+        QThread::usleep(quint64(qMin<qint64>(entry.elapsedUs - nowUs, 10000)));
+    }
+
+    return entry.result;
+}
+
+bool CommandTrace::write(QIODevice *device, const Entry &entry)
+{
+    QDataStream stream(device);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    QByteArray output = entry.result.output;
+    quint8 flags = (entry.result.ok ? FlagOk : 0) |
+                   (entry.result.timedOut ? FlagTimedOut : 0) |
+                   (entry.result.cancelled ? FlagCancelled : 0);
+    if (output.size() >= kCompressThreshold) {
+        output = qCompress(output);
+        flags |= FlagCompressed;
+    }
+
+    stream << entry.kind << entry.script << qint32(entry.result.exitCode) << flags
+           << qint64(entry.elapsedUs) << quint32(entry.progress.size());
+    for (const Progress &progress : entry.progress) {
+        stream << qint64(progress.offsetUs) << progress.payload;
+    }
+    stream << output;
+
+    return stream.status() == QDataStream::Ok;
+}
+
+bool CommandTrace::read(QIODevice *device, Entry *entry)
+{
+    QDataStream stream(device);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    qint32 exitCode = -1;
+    quint8 flags = 0;
+    qint64 elapsedUs = 0;
+    quint32 progressCount = 0;
+    stream >> entry->kind >> entry->script >> exitCode >> flags >> elapsedUs >> progressCount;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    entry->progress.clear();
+    for (quint32 i = 0; i < progressCount && stream.status() == QDataStream::Ok; ++i) {
+        Progress progress;
+        qint64 offsetUs = 0;
+        stream >> offsetUs >> progress.payload;
+        progress.offsetUs = offsetUs;
+        entry->progress.append(progress);
+    }
+
+    QByteArray output;
+    stream >> output;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    entry->result = ShellResult();
+    entry->result.ok = flags & FlagOk;
+    entry->result.timedOut = flags & FlagTimedOut;
+    entry->result.cancelled = flags & FlagCancelled;
+    entry->result.exitCode = exitCode;
+    entry->result.output = (flags & FlagCompressed) ? qUncompress(output) : output;
+    entry->elapsedUs = elapsedUs;
+    return true;
+}
+
+bool CommandTrace::openRecording(const QString &path)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot record command trace to" << path << m_file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&m_file);
+    stream.writeRawData(kMagic, sizeof(kMagic));
+    stream << kVersion;
+    m_file.flush();
+
+    qDebug() << "Recording shell commands to" << path;
+    return true;
+}
+
+bool CommandTrace::loadReplay(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open command trace" << path << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    char magic[sizeof(kMagic)];
+    quint16 version = 0;
+    if (stream.readRawData(magic, sizeof(magic)) != int(sizeof(magic)) ||
+        std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        qWarning() << path << "is not a command trace";
+        return false;
+    }
+    stream >> version;
+    if (version != kVersion) {
+        qWarning() << "Unsupported command trace version" << version;
+        return false;
+    }
+
+    int count = 0;
+    Entry entry;
+    while (!file.atEnd()) {
+        if (!read(&file, &entry)) {
+            qWarning() << "Command trace" << path << "is truncated after" << count << "entries";
+            break;
+        }
+        m_entries[entryKey(entry.kind, entry.script)].append(entry);
+        if (!m_firstOfKind.contains(entry.kind)) {
+            m_firstOfKind.insert(entry.kind, entry);
+        }
+        ++count;
+    }
+
+    qDebug() << "Replaying" << count << "shell commands from" << path;
+    return true;
+}
+
+const CommandTrace::Entry *CommandTrace::takeEntry(const QString &kind, const QString &script)
+{
+    const QString key = entryKey(kind, script);
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end() && !it->isEmpty()) {
+        m_lastEntries.insert(key, it->takeFirst());
+        // Also the fallback for other scripts of the same kind, such as an
+        // apply of a profile that was never recorded
+        m_lastEntries.insert(kind, m_lastEntries.value(key));
+    }
+
+    auto last = m_lastEntries.constFind(key);
+    if (last == m_lastEntries.constEnd()) {
+        last = m_lastEntries.constFind(kind);
+    }
+    if (last == m_lastEntries.constEnd()) {
+        // Nothing of this kind used yet; take the first recorded one
+        last = m_firstOfKind.constFind(kind);
+        if (last == m_firstOfKind.constEnd()) {
+            return nullptr;
+        }
+    }
+    return &*last;
+}
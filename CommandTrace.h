@@ -0,0 +1,81 @@
+#ifndef COMMANDTRACE_H
+#define COMMANDTRACE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include "ShellHost.h"
+
+// Records shell host requests to a trace file and plays them back, so a
+// session captured on a Windows admin box can be re-run anywhere.
+//
+//     IPTOOL_RECORD=trace.bin ChangeIPTool          (on Windows)
+//     IPTOOL_REPLAY=trace.bin ./ChangeIPTool       (anywhere)
+//
+// While replaying, ShellHost starts no process; every request is answered
+// from the trace, matched by kind and script, in recorded order. Once the
+// recorded answers for a request are used up the last one is repeated, so
+// pollers keep seeing a steady system. Replies come back immediately unless
+// IPTOOL_REPLAY_TIMING=1, which reproduces the recorded wall time and
+// progress timing (still honouring cancel and the request timeout).
+//
+// The file is a binary stream: "IPTR", a version, then one entry per
+// request with its kind, script, exit code, flags, wall time, progress
+// lines with their offsets and the output, compressed when large. The
+// host merges stderr into stdout, so the output holds both.
+class CommandTrace
+{
+public:
+    struct Progress {
+        qint64 offsetUs = 0;
+        QByteArray payload;
+    };
+
+    struct Entry {
+        QString kind;
+        QString script;
+        ShellResult result;
+        qint64 elapsedUs = 0;
+        QVector<Progress> progress;
+    };
+
+    static CommandTrace *instance();
+
+    bool isRecording() const { return m_recording; }
+    bool isReplaying() const { return m_replaying; }
+
+    // Thread-safe; appends and flushes one entry
+    void record(const Entry &entry);
+
+    // Thread-safe; answers a request from the trace
+    ShellResult replay(const QString &kind, const QString &script, int timeoutMs,
+                       const ShellHost::ProgressCallback &onProgress,
+                       const std::atomic_bool &cancelRequested);
+
+    static bool write(QIODevice *device, const Entry &entry);
+    static bool read(QIODevice *device, Entry *entry);
+
+private:
+    CommandTrace();
+    bool openRecording(const QString &path);
+    bool loadReplay(const QString &path);
+    const Entry *takeEntry(const QString &kind, const QString &script);
+
+    bool m_recording;
+    bool m_replaying;
+    bool m_replayTiming;
+
+    QMutex m_mutex;
+    QFile m_file;                               // Recording
+    QHash<QString, QList<Entry>> m_entries;     // Replay: kind + script -> answers in order
+    QHash<QString, Entry> m_lastEntries;        // Replay: repeated once used up
+    QHash<QString, Entry> m_firstOfKind;        // Replay: fallback for unknown scripts
+};
+
+#endif // COMMANDTRACE_H
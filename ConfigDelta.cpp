@@ -0,0 +1,298 @@
+#include "ConfigDelta.h"
+#include <QHostAddress>
+
+namespace {
+
+bool sameAddress(const QString &a, const QString &b)
+{
+    const QHostAddress first(a.trimmed());
+    const QHostAddress second(b.trimmed());
+    return !first.isNull() && first == second;
+}
+
+bool sameInterfaceAddresses(const QVector<InterfaceAddress> &a, const QVector<InterfaceAddress> &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (int i = 0; i < a.size(); ++i) {
+        if (!sameAddress(a[i].address, b[i].address) || a[i].prefixLength != b[i].prefixLength) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameAddresses(const QStringList &a, const QStringList &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (int i = 0; i < a.size(); ++i) {
+        if (!sameAddress(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QString listOrNone(const QStringList &values)
+{
+    return values.isEmpty() ? QString("无") : values.join(", ");
+}
+
+QStringList nonEmpty(const QStringList &values)
+{
+    QStringList result;
+    for (const QString &value : values) {
+        if (!value.trimmed().isEmpty()) {
+            result << value.trimmed();
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+ConfigDelta::ConfigDelta()
+    : m_changes(0)
+{
+}
+
+ConfigDelta ConfigDelta::compute(const AdapterState &live, const IpConfig &target, bool withDns)
+{
+    ConfigDelta delta;
+    delta.m_live = live;
+    delta.m_target = target;
+
+    if (target.isDhcp) {
+        if (!live.isDhcp) {
+            delta.m_changes |= Dhcp;
+        }
+        if (withDns && !live.dnsFromDhcp) {
+            delta.m_changes |= DnsDhcp;
+        }
+        return delta;
+    }
+
+    // set address replaces every address on the adapter, so anything but
+    // exactly the target address counts as a change
+    const int prefixLength = prefixFromMask(target.subnetMask);
+    if (live.isDhcp || live.addresses.size() != 1 ||
+        !sameAddress(live.addresses.first().address, target.ipAddress) ||
+        live.addresses.first().prefixLength != prefixLength) {
+        delta.m_changes |= Address;
+    }
+
+    if (!sameAddresses(live.gateways, nonEmpty(QStringList() << target.gateway))) {
+        delta.m_changes |= Gateway;
+    }
+
+    // A profile without DNS servers leaves DNS alone
+    if (!withDns) {
+        return delta;
+    }
+    if (!target.dns1.trimmed().isEmpty()) {
+        if (live.dnsFromDhcp || !sameAddress(live.dnsServers.value(0), target.dns1)) {
+            delta.m_changes |= PrimaryDns;
+        } else if (!sameAddresses(live.dnsServers.mid(1), nonEmpty(QStringList() << target.dns2))) {
+            delta.m_changes |= SecondaryDns;
+        }
+    } else if (!target.dns2.trimmed().isEmpty()) {
+        if (live.dnsFromDhcp || !sameAddress(live.dnsServers.value(1), target.dns2)) {
+            delta.m_changes |= SecondaryDns;
+        }
+    }
+
+    return delta;
+}
+
+ConfigDelta ConfigDelta::full(const IpConfig &target)
+{
+    ConfigDelta delta;
+    delta.m_target = target;
+
+    if (target.isDhcp) {
+        delta.m_changes = Dhcp | DnsDhcp;
+        return delta;
+    }
+
+    delta.m_changes = Address | Gateway;
+    if (!target.dns1.trimmed().isEmpty()) {
+        delta.m_changes |= PrimaryDns;
+    }
+    if (!target.dns2.trimmed().isEmpty()) {
+        delta.m_changes |= SecondaryDns;
+    }
+    return delta;
+}
+
+ConfigDelta ConfigDelta::restore(const AdapterState &live, const AdapterState &snapshot, bool withDns)
+{
+    ConfigDelta delta;
+    delta.m_live = live;
+    delta.m_target = configFromState(snapshot);
+    delta.m_snapshot = snapshot;
+
+    if (snapshot.isDhcp) {
+        if (!live.isDhcp) {
+            delta.m_changes |= Dhcp;
+        }
+    } else {
+        if (live.isDhcp || !sameInterfaceAddresses(live.addresses, snapshot.addresses)) {
+            delta.m_changes |= Address;
+        }
+        if (!sameAddresses(live.gateways, snapshot.gateways)) {
+            delta.m_changes |= Gateway;
+        }
+    }
+
+    if (!withDns) {
+        return delta;
+    }
+    if (snapshot.dnsFromDhcp) {
+        if (!live.dnsFromDhcp) {
+            delta.m_changes |= DnsDhcp;
+        }
+    } else if (live.dnsFromDhcp || !sameAddresses(live.dnsServers, snapshot.dnsServers)) {
+        // Also when the snapshot had no servers at all
+        delta.m_changes |= PrimaryDns;
+    }
+    return delta;
+}
+
+IpConfig ConfigDelta::configFromState(const AdapterState &state)
+{
+    IpConfig config;
+    config.isDhcp = state.isDhcp;
+    config.adapterGuid = state.guid;
+    if (!state.addresses.isEmpty()) {
+        config.ipAddress = state.addresses.first().address;
+        config.subnetMask = maskFromPrefix(state.addresses.first().prefixLength);
+    }
+    config.gateway = state.gateways.value(0);
+    if (!state.dnsFromDhcp) {
+        config.dns1 = state.dnsServers.value(0);
+        config.dns2 = state.dnsServers.value(1);
+    }
+    return config;
+}
+
+AdapterState ConfigDelta::expectedState() const
+{
+    AdapterState state = m_live;
+
+    if (has(Dhcp)) {
+        state.isDhcp = true;
+        state.addresses.clear();
+        state.gateways.clear();
+    }
+    if (has(DnsDhcp)) {
+        state.dnsFromDhcp = true;
+        state.dnsServers.clear();
+    }
+
+    if (has(Address)) {
+        InterfaceAddress address;
+        address.address = m_target.ipAddress.trimmed();
+        address.prefixLength = prefixFromMask(m_target.subnetMask);
+        state.isDhcp = false;
+        state.addresses = QVector<InterfaceAddress>() << address << m_snapshot.addresses.mid(1);
+    }
+    if (has(Gateway)) {
+        state.gateways = nonEmpty(QStringList() << m_target.gateway);
+    }
+    if (has(PrimaryDns) && !m_snapshot.name.isEmpty()) {
+        state.dnsFromDhcp = false;
+        state.dnsServers = m_snapshot.dnsServers;
+    } else if (has(PrimaryDns)) {
+        state.dnsFromDhcp = false;
+        state.dnsServers = nonEmpty(QStringList() << m_target.dns1 << m_target.dns2);
+    } else if (has(SecondaryDns)) {
+        const QString primary = m_target.dns1.trimmed().isEmpty() ? m_live.dnsServers.value(0)
+                                                                  : m_target.dns1;
+        state.dnsFromDhcp = false;
+        state.dnsServers = nonEmpty(QStringList() << primary << m_target.dns2);
+    }
+
+    return state;
+}
+
+ConfigDelta ConfigDelta::inverse() const
+{
+    if (isEmpty()) {
+        return ConfigDelta();
+    }
+    // Parts this delta leaves alone are the same in both states, so only
+    // what it changes is put back
+    return restore(expectedState(), m_live);
+}
+
+QStringList ConfigDelta::describe() const
+{
+    QStringList lines;
+
+    if (has(Dhcp)) {
+        lines << QString("IP地址：改为自动获取 (DHCP)");
+    }
+    if (has(DnsDhcp)) {
+        lines << QString("DNS服务器：%1 → 自动获取 (DHCP)").arg(listOrNone(m_live.dnsServers));
+    }
+
+    if (has(Address)) {
+        QStringList current;
+        for (const InterfaceAddress &address : m_live.addresses) {
+            current << QString("%1/%2").arg(address.address).arg(address.prefixLength);
+        }
+        if (m_live.isDhcp) {
+            current << QString("DHCP");
+        }
+        QStringList target = QStringList() << QString("%1/%2").arg(m_target.ipAddress)
+                                                   .arg(prefixFromMask(m_target.subnetMask));
+        for (const InterfaceAddress &address : m_snapshot.addresses.mid(1)) {
+            target << QString("%1/%2").arg(address.address).arg(address.prefixLength);
+        }
+        lines << QString("IP地址：%1 → %2").arg(listOrNone(current), target.join(", "));
+    }
+    if (has(Gateway)) {
+        lines << QString("默认网关：%1 → %2")
+                     .arg(listOrNone(m_live.gateways), listOrNone(nonEmpty(QStringList() << m_target.gateway)));
+    }
+    if (has(PrimaryDns) || has(SecondaryDns)) {
+        QStringList servers = nonEmpty(QStringList() << m_target.dns1 << m_target.dns2);
+        if (!m_snapshot.name.isEmpty()) {
+            servers = m_snapshot.dnsServers;
+        } else if (m_target.dns1.trimmed().isEmpty()) {
+            // Only the secondary is set; the first server stays
+            servers = nonEmpty(QStringList() << m_live.dnsServers.value(0) << m_target.dns2);
+        }
+        lines << QString("DNS服务器：%1 → %2")
+                     .arg(listOrNone(m_live.dnsServers), listOrNone(servers));
+    }
+
+    return lines;
+}
+
+int ConfigDelta::prefixFromMask(const QString &mask)
+{
+    const QHostAddress address(mask.trimmed());
+    if (address.protocol() != QAbstractSocket::IPv4Protocol) {
+        return -1;
+    }
+
+    const quint32 bits = address.toIPv4Address();
+    int prefixLength = 0;
+    while (prefixLength < 32 && (bits & (0x80000000u >> prefixLength))) {
+        ++prefixLength;
+    }
+    // Anything after the first zero must be zero too
+    const quint32 expected = prefixLength == 0 ? 0 : ~quint32(0) << (32 - prefixLength);
+    return bits == expected ? prefixLength : -1;
+}
+
+QString ConfigDelta::maskFromPrefix(int prefixLength)
+{
+    const quint32 mask = prefixLength <= 0 ? 0 : ~quint32(0) << (32 - qMin(prefixLength, 32));
+    return QString("%1.%2.%3.%4").arg(mask >> 24).arg((mask >> 16) & 0xFF)
+                                 .arg((mask >> 8) & 0xFF).arg(mask & 0xFF);
+}
@@ -0,0 +1,75 @@
+#ifndef CONFIGDELTA_H
+#define CONFIGDELTA_H
+
+#include <QString>
+#include <QStringList>
+#include "IpConfigManager.h"
+#include "NetworkBackend.h"
+
+// What applying an IpConfig would actually change on an adapter, worked out
+// from its live AdapterState. Backends only run the parts that are flagged,
+// so a profile that only differs in DNS never touches the address, and an
+// empty delta means there is nothing to do at all.
+class ConfigDelta
+{
+public:
+    enum Change {
+        Address = 0x01,       // Static address and mask
+        Gateway = 0x02,
+        PrimaryDns = 0x04,    // Rewrites the whole DNS server list
+        SecondaryDns = 0x08,  // Only the servers after the first
+        Dhcp = 0x10,
+        DnsDhcp = 0x20
+    };
+
+    ConfigDelta();
+
+    // Without withDns, DNS servers are neither compared nor changed
+    static ConfigDelta compute(const AdapterState &live, const IpConfig &target,
+                               bool withDns = true);
+    // Everything the target sets, regardless of the current state
+    static ConfigDelta full(const IpConfig &target);
+    // Puts an adapter back into an earlier snapshot: every address and DNS
+    // server, DHCP-assigned DNS, and static DNS on a DHCP address, none of
+    // which an IpConfig can express. target() holds the first address and
+    // two DNS servers; backends take the rest from snapshot().
+    static ConfigDelta restore(const AdapterState &live, const AdapterState &snapshot,
+                               bool withDns = true);
+
+    // The profile that reproduces a state. IpConfig holds one address and
+    // two DNS servers, so anything beyond that is not carried over.
+    static IpConfig configFromState(const AdapterState &state);
+
+    bool isEmpty() const { return m_changes == 0; }
+    bool has(Change change) const { return m_changes & change; }
+    int changes() const { return m_changes; }
+
+    const AdapterState &live() const { return m_live; }
+    const IpConfig &target() const { return m_target; }
+    // Only set by restore()
+    const AdapterState &snapshot() const { return m_snapshot; }
+
+    // The adapter as it will look once this delta has been applied. DHCP
+    // leases are unknown in advance and left empty.
+    AdapterState expectedState() const;
+    // Undoes this delta: restore() from expectedState() back to live()
+    ConfigDelta inverse() const;
+
+    // One line per change, "old → new"
+    QStringList describe() const;
+
+    // 255.255.255.0 -> 24; -1 if not a contiguous IPv4 mask
+    static int prefixFromMask(const QString &mask);
+    // 24 -> 255.255.255.0
+    static QString maskFromPrefix(int prefixLength);
+
+private:
+    AdapterState m_live;
+    IpConfig m_target;
+    AdapterState m_snapshot;
+    int m_changes;
+};
+
+Q_DECLARE_METATYPE(ConfigDelta)
+
+#endif // CONFIGDELTA_H
@@ -0,0 +1,244 @@
+#include "ConfigIndex.h"
+#include "ConfigDelta.h"
+#include "ConfigTable.h"
+#include <algorithm>
+
+void ConfigIndex::clear()
+{
+    m_entries.clear();
+    m_names.clear();
+    m_addresses.clear();
+    m_subnets.clear();
+    std::fill(std::begin(m_prefixCounts), std::end(m_prefixCounts), 0);
+    m_conflictCounts.clear();
+    m_conflictChanges.clear();
+    m_built = false;
+}
+
+void ConfigIndex::add(const IpConfig &config)
+{
+    const Entry entry = entryFor(config);
+    // Searched before it is indexed, so it does not find itself
+    const QVector<ConfigConflict> found = conflicts(entry, config.id);
+
+    m_names.insert(entry.nameKey, config.id);
+    if (entry.addressValid) {
+        m_addresses.insert(entry.address, config.id);
+        if (entry.prefixLength >= 0) {
+            m_subnets.insert(subnetKey(entry.address, entry.prefixLength), config.id);
+            ++m_prefixCounts[entry.prefixLength];
+        }
+    }
+    m_entries.insert(config.id, entry);
+
+    countConflicts(found, 1);
+    if (!found.isEmpty()) {
+        m_conflictCounts[config.id] += int(found.size());
+        m_conflictChanges.insert(config.id);
+    }
+}
+
+void ConfigIndex::remove(quint64 id)
+{
+    const auto it = m_entries.constFind(id);
+    if (it == m_entries.constEnd()) {
+        return;
+    }
+
+    const Entry entry = *it;
+    m_entries.erase(it);
+    m_names.remove(entry.nameKey, id);
+    if (entry.addressValid) {
+        m_addresses.remove(entry.address, id);
+        if (entry.prefixLength >= 0) {
+            m_subnets.remove(subnetKey(entry.address, entry.prefixLength), id);
+            --m_prefixCounts[entry.prefixLength];
+        }
+    }
+
+    // Conflicting is symmetric, so this finds exactly the profiles that
+    // counted a conflict with it
+    countConflicts(conflicts(entry, id), -1);
+    if (m_conflictCounts.remove(id)) {
+        m_conflictChanges.insert(id);
+    }
+}
+
+QSet<quint64> ConfigIndex::takeConflictChanges()
+{
+    QSet<quint64> changes;
+    changes.swap(m_conflictChanges);
+    return changes;
+}
+
+QVector<ConfigConflict> ConfigIndex::conflicts(const IpConfig &config) const
+{
+    return conflicts(entryFor(config), config.id);
+}
+
+QVector<quint64> ConfigIndex::findByNamePrefix(const QString &prefix) const
+{
+    const QString key = prefix.toCaseFolded();
+
+    QVector<quint64> ids;
+    for (auto it = m_names.lowerBound(key); it != m_names.constEnd() && it.key().startsWith(key); ++it) {
+        ids.append(it.value());
+    }
+    return ids;
+}
+
+QVector<quint64> ConfigIndex::findInSubnet(quint32 network, int prefixLength) const
+{
+    const quint32 mask = maskFor(prefixLength);
+    const quint32 first = network & mask;
+    const quint32 last = first | ~mask;
+
+    QVector<quint64> ids;
+    for (auto it = m_addresses.lowerBound(first); it != m_addresses.constEnd() && it.key() <= last; ++it) {
+        ids.append(it.value());
+    }
+    return ids;
+}
+
+QVector<quint64> ConfigIndex::findContaining(quint32 address) const
+{
+    QVector<quint64> ids;
+    for (int prefixLength = 32; prefixLength >= 0; --prefixLength) {
+        if (m_prefixCounts[prefixLength] == 0) {
+            continue;
+        }
+
+        const qsizetype start = ids.size();
+        const quint64 key = subnetKey(address, prefixLength);
+        for (auto it = m_subnets.constFind(key); it != m_subnets.constEnd() && it.key() == key; ++it) {
+            ids.append(it.value());
+        }
+        std::sort(ids.begin() + start, ids.end());
+    }
+    return ids;
+}
+
+bool ConfigIndex::parseSubnet(const QString &text, quint32 *network, int *prefixLength)
+{
+    const qsizetype slash = text.indexOf(QLatin1Char('/'));
+    if (slash < 0 || !ConfigTable::parseAddress(text.left(slash).trimmed(), network)) {
+        return false;
+    }
+
+    const QString suffix = text.mid(slash + 1).trimmed();
+    bool ok = false;
+    int length = suffix.toInt(&ok);
+    if (!ok) {
+        length = ConfigDelta::prefixFromMask(suffix);
+    } else if (suffix.startsWith(QLatin1Char('+')) || suffix.startsWith(QLatin1Char('-'))) {
+        return false;
+    }
+    if (length < 0 || length > 32) {
+        return false;
+    }
+
+    *prefixLength = length;
+    return true;
+}
+
+ConfigIndex::Entry ConfigIndex::entryFor(const IpConfig &config)
+{
+    Entry entry;
+    entry.nameKey = config.name.toCaseFolded();
+    entry.adapterGuid = config.adapterGuid;
+    if (config.isDhcp || !ConfigTable::parseAddress(config.ipAddress, &entry.address)) {
+        return entry;
+    }
+    entry.addressValid = true;
+
+    const int prefixLength = ConfigDelta::prefixFromMask(config.subnetMask);
+    if (prefixLength >= 0) {
+        entry.prefixLength = qint8(prefixLength);
+
+        quint32 gateway = 0;
+        if (ConfigTable::parseAddress(config.gateway, &gateway) &&
+            ((gateway ^ entry.address) & maskFor(prefixLength)) != 0) {
+            entry.gatewayOutside = true;
+        }
+    }
+    return entry;
+}
+
+QVector<ConfigConflict> ConfigIndex::conflicts(const Entry &entry, quint64 id) const
+{
+    QVector<ConfigConflict> found;
+    if (entry.gatewayOutside) {
+        found.append({ ConfigConflict::GatewayOutsideSubnet, 0 });
+    }
+    if (!entry.addressValid) {
+        return found;
+    }
+
+    for (auto it = m_addresses.constFind(entry.address);
+         it != m_addresses.constEnd() && it.key() == entry.address; ++it) {
+        if (it.value() != id) {
+            found.append({ ConfigConflict::DuplicateAddress, it.value() });
+        }
+    }
+
+    const int prefixLength = entry.prefixLength;
+    if (prefixLength < 0) {
+        return found;
+    }
+
+    const auto overlap = [this, &entry, &found, id](quint64 other) {
+        if (other == id) {
+            return;
+        }
+        const auto it = m_entries.constFind(other);
+        if (it != m_entries.constEnd() && it->adapterGuid == entry.adapterGuid) {
+            found.append({ ConfigConflict::SubnetOverlap, other });
+        }
+    };
+
+    // Larger subnets containing this one
+    for (int shorter = 0; shorter < prefixLength; ++shorter) {
+        if (m_prefixCounts[shorter] == 0) {
+            continue;
+        }
+        const quint64 key = subnetKey(entry.address, shorter);
+        for (auto it = m_subnets.constFind(key); it != m_subnets.constEnd() && it.key() == key; ++it) {
+            overlap(it.value());
+        }
+    }
+
+    // Smaller ones inside it: the same network with a longer prefix, then
+    // every later network up to the end of the range
+    const quint32 last = entry.address | ~maskFor(prefixLength);
+    const quint64 to = subnetKey(last, 32);
+    for (auto it = m_subnets.lowerBound(subnetKey(entry.address, prefixLength) + 1);
+         it != m_subnets.constEnd() && it.key() <= to; ++it) {
+        overlap(it.value());
+    }
+    return found;
+}
+
+void ConfigIndex::countConflicts(const QVector<ConfigConflict> &conflicts, int delta)
+{
+    for (const ConfigConflict &conflict : conflicts) {
+        if (conflict.otherId == 0) {
+            continue;
+        }
+        int &count = m_conflictCounts[conflict.otherId];
+        count += delta;
+        if (count <= 0) {
+            m_conflictCounts.remove(conflict.otherId);
+        }
+        m_conflictChanges.insert(conflict.otherId);
+    }
+}
+
+quint32 ConfigIndex::maskFor(int prefixLength)
+{
+    return prefixLength == 0 ? 0 : ~quint32(0) << (32 - prefixLength);
+}
+
+quint64 ConfigIndex::subnetKey(quint32 address, int prefixLength)
+{
+    return (quint64(address & maskFor(prefixLength)) << 8) | quint64(prefixLength);
+}
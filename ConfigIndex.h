@@ -0,0 +1,97 @@
+#ifndef CONFIGINDEX_H
+#define CONFIGINDEX_H
+
+#include <QHash>
+#include <QMultiMap>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include "IpConfig.h"
+
+// Something wrong with a profile, alone or together with another one
+struct ConfigConflict {
+    enum Kind {
+        DuplicateAddress,       // Another profile has the same static IP, on any adapter
+        SubnetOverlap,          // Another profile on the same adapter has a different,
+                                // overlapping subnet (the same subnet is fine)
+        GatewayOutsideSubnet    // The profile's own gateway; otherId is 0
+    };
+
+    Kind kind = DuplicateAddress;
+    quint64 otherId = 0;
+};
+
+// Search indexes over IpConfigManager's profiles, kept up to date by
+// add()/remove() as profiles change:
+//
+// - names, case-folded and ordered, for prefix search;
+// - IPv4 addresses, ordered, for "which profiles are inside 10.20.0.0/16";
+// - subnets (address and mask), ordered by network and then prefix
+//   length. CIDR ranges nest or are disjoint, so the subnets containing a
+//   range are one lookup per shorter prefix length in use, and those
+//   inside it are one contiguous run of this order. That answers "which
+//   profile's subnet contains 10.20.3.4" as well as overlap checks.
+//
+// The same structures find each profile's conflicts (see ConfigConflict)
+// when it is added, so the number of conflicts per profile is kept up to
+// date in O(log n) per change, plus the conflicts found, without
+// rescanning.
+//
+// DHCP profiles and addresses that are not plain IPv4 are found by name
+// only and never conflict.
+class ConfigIndex
+{
+public:
+    bool isBuilt() const { return m_built; }
+    void setBuilt() { m_built = true; }
+    // Empty and not built
+    void clear();
+
+    void add(const IpConfig &config);
+    void remove(quint64 id);
+
+    // By name, then id
+    QVector<quint64> findByNamePrefix(const QString &prefix) const;
+    // By address, then id
+    QVector<quint64> findInSubnet(quint32 network, int prefixLength) const;
+    // Most specific subnet first
+    QVector<quint64> findContaining(quint32 address) const;
+
+    // Conflicts config would have with the indexed profiles other than
+    // itself (by id); it need not be indexed
+    QVector<ConfigConflict> conflicts(const IpConfig &config) const;
+    bool hasConflicts(quint64 id) const { return m_conflictCounts.contains(id); }
+    // Profiles whose conflicts changed since the last call, because they or
+    // others changed
+    QSet<quint64> takeConflictChanges();
+
+    // "10.20.0.0/16" or "10.20.0.0/255.255.0.0"
+    static bool parseSubnet(const QString &text, quint32 *network, int *prefixLength);
+
+private:
+    struct Entry {
+        QString nameKey;
+        QString adapterGuid;
+        quint32 address = 0;
+        bool addressValid = false;
+        qint8 prefixLength = -1;    // -1 if the mask is not usable
+        bool gatewayOutside = false;
+    };
+
+    static Entry entryFor(const IpConfig &config);
+    QVector<ConfigConflict> conflicts(const Entry &entry, quint64 id) const;
+    void countConflicts(const QVector<ConfigConflict> &conflicts, int delta);
+    static quint32 maskFor(int prefixLength);
+    static quint64 subnetKey(quint32 address, int prefixLength);
+
+    QHash<quint64, Entry> m_entries;            // Id -> what it is indexed under
+    QMultiMap<QString, quint64> m_names;        // Case-folded name -> id
+    QMultiMap<quint32, quint64> m_addresses;
+    QMultiMap<quint64, quint64> m_subnets;      // subnetKey() -> id
+    int m_prefixCounts[33] = {};                // Subnets per prefix length
+    QHash<quint64, int> m_conflictCounts;       // Only ids with conflicts
+    QSet<quint64> m_conflictChanges;
+    bool m_built = false;
+};
+
+#endif // CONFIGINDEX_H
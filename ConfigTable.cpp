@@ -0,0 +1,166 @@
+#include "ConfigTable.h"
+
+void ConfigTable::clear()
+{
+    m_rows.clear();
+    m_adapterGuids.clear();
+    m_adapterIds.clear();
+    m_verbatim.clear();
+}
+
+IpConfig ConfigTable::at(int index) const
+{
+    const Row &row = m_rows[index];
+
+    QString fields[AddressFieldCount];
+    if (row.flags & VerbatimFlag) {
+        const QStringList text = m_verbatim.value(row.id);
+        for (int i = 0; i < AddressFieldCount && i < text.size(); ++i) {
+            fields[i] = text[i];
+        }
+    } else {
+        for (int i = 0; i < AddressFieldCount; ++i) {
+            if (row.present & (1 << i)) {
+                fields[i] = formatAddress(row.addresses[i]);
+            }
+        }
+    }
+
+    IpConfig config;
+    config.id = row.id;
+    config.name = row.name;
+    config.ipAddress = fields[IpField];
+    config.subnetMask = fields[MaskField];
+    config.gateway = fields[GatewayField];
+    config.dns1 = fields[Dns1Field];
+    config.dns2 = fields[Dns2Field];
+    config.isDhcp = row.flags & DhcpFlag;
+    config.adapterGuid = m_adapterGuids[row.adapter];
+    return config;
+}
+
+void ConfigTable::append(const IpConfig &config)
+{
+    m_rows.append(pack(config));
+}
+
+void ConfigTable::set(int index, const IpConfig &config)
+{
+    if (m_rows[index].flags & VerbatimFlag) {
+        m_verbatim.remove(m_rows[index].id);
+    }
+    m_rows[index] = pack(config);
+}
+
+void ConfigTable::removeAt(int index)
+{
+    if (m_rows[index].flags & VerbatimFlag) {
+        m_verbatim.remove(m_rows[index].id);
+    }
+
+    const int last = size() - 1;
+    if (index != last) {
+        m_rows[index] = std::move(m_rows[last]);
+    }
+    m_rows.removeLast();
+}
+
+QVector<IpConfig> ConfigTable::toConfigs() const
+{
+    QVector<IpConfig> configs;
+    configs.reserve(m_rows.size());
+    for (int i = 0; i < size(); ++i) {
+        configs.append(at(i));
+    }
+    return configs;
+}
+
+bool ConfigTable::parseAddress(const QString &text, quint32 *address)
+{
+    // Only the form formatAddress() gives back: four decimal octets without
+    // leading zeros
+    const int length = int(text.size());
+    quint32 value = 0;
+    int pos = 0;
+    for (int part = 0; part < 4; ++part) {
+        if (part > 0) {
+            if (pos >= length || text.at(pos) != QLatin1Char('.')) {
+                return false;
+            }
+            ++pos;
+        }
+
+        const int start = pos;
+        quint32 octet = 0;
+        while (pos < length && pos - start < 3) {
+            const char16_t c = text.at(pos).unicode();
+            if (c < u'0' || c > u'9') {
+                break;
+            }
+            octet = octet * 10 + (c - u'0');
+            ++pos;
+        }
+        if (pos == start || octet > 255 || (text.at(start) == QLatin1Char('0') && pos - start > 1)) {
+            return false;
+        }
+        value = (value << 8) | octet;
+    }
+
+    if (pos != length) {
+        return false;
+    }
+    *address = value;
+    return true;
+}
+
+QString ConfigTable::formatAddress(quint32 address)
+{
+    return QString::number(address >> 24) + QLatin1Char('.') +
+           QString::number((address >> 16) & 0xFF) + QLatin1Char('.') +
+           QString::number((address >> 8) & 0xFF) + QLatin1Char('.') +
+           QString::number(address & 0xFF);
+}
+
+ConfigTable::Row ConfigTable::pack(const IpConfig &config)
+{
+    Row row;
+    row.id = config.id;
+    row.name = config.name;
+    row.adapter = internAdapter(config.adapterGuid);
+    if (config.isDhcp) {
+        row.flags |= DhcpFlag;
+    }
+
+    const QString *fields[AddressFieldCount] = {
+        &config.ipAddress, &config.subnetMask, &config.gateway, &config.dns1, &config.dns2
+    };
+    for (int i = 0; i < AddressFieldCount; ++i) {
+        if (fields[i]->isEmpty()) {
+            continue;
+        }
+        if (!parseAddress(*fields[i], &row.addresses[i])) {
+            row.flags |= VerbatimFlag;
+            break;
+        }
+        row.present |= 1 << i;
+    }
+
+    if (row.flags & VerbatimFlag) {
+        m_verbatim.insert(row.id, QStringList{ config.ipAddress, config.subnetMask, config.gateway,
+                                               config.dns1, config.dns2 });
+    }
+    return row;
+}
+
+quint32 ConfigTable::internAdapter(const QString &guid)
+{
+    const auto it = m_adapterIds.constFind(guid);
+    if (it != m_adapterIds.constEnd()) {
+        return *it;
+    }
+
+    const quint32 index = quint32(m_adapterGuids.size());
+    m_adapterGuids.append(guid);
+    m_adapterIds.insert(guid, index);
+    return index;
+}
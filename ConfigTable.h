@@ -0,0 +1,77 @@
+#ifndef CONFIGTABLE_H
+#define CONFIGTABLE_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "IpConfig.h"
+
+// IpConfigManager's profiles in packed form. IpConfig is seven strings; a
+// row here keeps the five address fields as IPv4 numbers and the adapter
+// as an index into a table of GUIDs shared by all rows, so only the name
+// is a string of its own. IpConfig values are built by at() and taken
+// apart by append()/set(), at the edges where the UI and the files need
+// text.
+//
+// Text that does not round-trip through a number (anything but plain
+// dotted quads, e.g. an IPv6 DNS server) is kept verbatim on the side, so
+// at() always returns what was stored.
+//
+// Copies share their data until one of them changes, which makes handing
+// a snapshot to the writer thread cheap.
+class ConfigTable
+{
+public:
+    int size() const { return int(m_rows.size()); }
+    void reserve(int size) { m_rows.reserve(size); }
+    void clear();
+
+    IpConfig at(int index) const;
+    quint64 id(int index) const { return m_rows[index].id; }
+    const QString &adapterGuid(int index) const { return m_adapterGuids[m_rows[index].adapter]; }
+
+    void append(const IpConfig &config);
+    void set(int index, const IpConfig &config);
+    // Moves the last row into its place
+    void removeAt(int index);
+
+    QVector<IpConfig> toConfigs() const;
+
+    static bool parseAddress(const QString &text, quint32 *address);
+    static QString formatAddress(quint32 address);
+
+private:
+    enum AddressField {
+        IpField,
+        MaskField,
+        GatewayField,
+        Dns1Field,
+        Dns2Field,
+        AddressFieldCount
+    };
+
+    enum RowFlag {
+        DhcpFlag = 0x01,
+        VerbatimFlag = 0x02    // Addresses are in m_verbatim
+    };
+
+    struct Row {
+        quint64 id = 0;
+        QString name;
+        quint32 addresses[AddressFieldCount] = {};
+        quint32 adapter = 0;   // Index into m_adapterGuids
+        quint8 present = 0;    // Bit per address field that is not empty
+        quint8 flags = 0;
+    };
+
+    Row pack(const IpConfig &config);
+    quint32 internAdapter(const QString &guid);
+
+    QVector<Row> m_rows;
+    QVector<QString> m_adapterGuids;        // Only grows; there are a handful
+    QHash<QString, quint32> m_adapterIds;
+    QHash<quint64, QStringList> m_verbatim; // Id -> address fields as text
+};
+
+#endif // CONFIGTABLE_H
@@ -0,0 +1,494 @@
+#include "ConfigTransfer.h"
+#include "ConfigDelta.h"
+#include "ConfigTable.h"
+#include "CsvReader.h"
+#include "IpConfigManager.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+const qint64 kBlockSize = 1 << 20;      // Read and write granularity
+const int kParallelMinRows = 256;       // Smaller blocks are validated inline
+
+enum Column {
+    NameColumn,
+    IpColumn,
+    MaskColumn,
+    GatewayColumn,
+    Dns1Column,
+    Dns2Column,
+    DhcpColumn,
+    AdapterColumn,
+    ColumnCount
+};
+
+// Same names as the JSON keys
+const char *const kColumnNames[ColumnCount] = {
+    "name", "ipAddress", "subnetMask", "gateway", "dns1", "dns2", "isDhcp", "adapterGuid"
+};
+
+struct PendingRow {
+    qint64 line = 0;
+    QByteArray json;    // JSON imports: the object, parsed on the pool
+    IpConfig config;    // CSV imports: already split into fields
+    QString error;
+};
+
+qint64 countLines(const QByteArray &data, qsizetype from, qsizetype to)
+{
+    return std::count(data.constBegin() + from, data.constBegin() + to, '\n');
+}
+
+bool parseBool(const QString &text, bool *value)
+{
+    const QString lower = text.trimmed().toLower();
+    if (lower.isEmpty() || lower == "false" || lower == "0" || lower == "no" || lower == QString("否")) {
+        *value = false;
+        return true;
+    }
+    if (lower == "true" || lower == "1" || lower == "yes" || lower == QString("是")) {
+        *value = true;
+        return true;
+    }
+    return false;
+}
+
+// Parses the JSON rows and validates all of them on the pool, then moves
+// them into the result in file order
+void finishRows(QVector<PendingRow> &rows, const QString &defaultAdapterGuid, QThreadPool *pool,
+                ImportResult *result)
+{
+    // Detached once here; the pool threads only touch their own rows
+    PendingRow *data = rows.data();
+    auto process = [data, &defaultAdapterGuid](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            PendingRow &row = data[i];
+            if (!row.error.isEmpty()) {
+                continue;
+            }
+            if (!row.json.isNull()) {
+                QJsonParseError parseError;
+                const QJsonDocument doc = QJsonDocument::fromJson(row.json, &parseError);
+                if (parseError.error != QJsonParseError::NoError) {
+                    row.error = QString("JSON 格式错误：%1").arg(parseError.errorString());
+                    continue;
+                }
+                row.config = IpConfigManager::parseIpConfig(doc.object());
+                row.config.id = 0;
+            }
+            if (row.config.adapterGuid.isEmpty()) {
+                row.config.adapterGuid = defaultAdapterGuid;
+            }
+            row.error = ConfigTransfer::validate(row.config);
+        }
+    };
+
+    const int count = int(rows.size());
+    const int slices = pool->maxThreadCount();
+    if (count < kParallelMinRows || slices < 2) {
+        process(0, count);
+    } else {
+        const int step = (count + slices - 1) / slices;
+        for (int begin = 0; begin < count; begin += step) {
+            const int end = qMin(count, begin + step);
+            pool->start([&process, begin, end]() { process(begin, end); });
+        }
+        pool->waitForDone();
+    }
+
+    for (PendingRow &row : rows) {
+        ++result->rows;
+        if (row.error.isEmpty()) {
+            result->configs.append(std::move(row.config));
+        } else {
+            ImportError error;
+            error.line = row.line;
+            error.message = row.error;
+            result->errors.append(error);
+        }
+    }
+    rows.clear();
+}
+
+// Splits blocks of CSV into rows. Each call takes the complete records at
+// the front of the buffer and returns how many bytes they were.
+class CsvImport
+{
+public:
+    CsvImport()
+        : m_haveHeader(false)
+        , m_line(1)
+    {
+        std::fill(m_columns, m_columns + ColumnCount, -1);
+    }
+
+    qsizetype parse(const QByteArray &buffer, bool atEnd, QVector<PendingRow> *rows, QString *error)
+    {
+        // Only whole records: cut after the last line break outside quotes
+        qsizetype cut = buffer.size();
+        if (!atEnd) {
+            cut = 0;
+            bool quoted = false;
+            for (qsizetype i = 0; i < buffer.size(); ++i) {
+                const char c = buffer.at(i);
+                if (c == '"') {
+                    quoted = !quoted;
+                } else if (c == '\n' && !quoted) {
+                    cut = i + 1;
+                }
+            }
+            if (cut == 0) {
+                return 0;
+            }
+        }
+
+        CsvReader reader(QByteArrayView(buffer.constData(), cut));
+        qsizetype counted = 0;
+        while (reader.readRecord()) {
+            m_line += countLines(buffer, counted, reader.recordOffset());
+            counted = reader.recordOffset();
+
+            if (!m_haveHeader) {
+                for (int i = 0; i < reader.fieldCount(); ++i) {
+                    const QString name = reader.text(i).trimmed();
+                    for (int column = 0; column < ColumnCount; ++column) {
+                        if (name.compare(QLatin1String(kColumnNames[column]), Qt::CaseInsensitive) == 0) {
+                            m_columns[column] = i;
+                        }
+                    }
+                }
+                if (m_columns[NameColumn] < 0) {
+                    *error = QString("CSV 第一行应为列名，且至少包含 name 列");
+                    return cut;
+                }
+                m_haveHeader = true;
+                continue;
+            }
+
+            PendingRow row;
+            row.line = m_line;
+            row.config.name = text(reader, NameColumn);
+            row.config.ipAddress = text(reader, IpColumn);
+            row.config.subnetMask = text(reader, MaskColumn);
+            row.config.gateway = text(reader, GatewayColumn);
+            row.config.dns1 = text(reader, Dns1Column);
+            row.config.dns2 = text(reader, Dns2Column);
+            row.config.adapterGuid = text(reader, AdapterColumn);
+            if (!parseBool(text(reader, DhcpColumn), &row.config.isDhcp)) {
+                row.error = QString("isDhcp 无效：%1").arg(text(reader, DhcpColumn));
+            }
+            rows->append(row);
+        }
+
+        m_line += countLines(buffer, counted, cut);
+        return cut;
+    }
+
+private:
+    QString text(const CsvReader &reader, Column column) const
+    {
+        return m_columns[column] < 0 ? QString() : reader.text(m_columns[column]).trimmed();
+    }
+
+    int m_columns[ColumnCount];     // Field index per column, -1 if absent
+    bool m_haveHeader;
+    qint64 m_line;
+};
+
+// Splits blocks of a JSON array into its elements, the same way
+class JsonImport
+{
+public:
+    JsonImport()
+        : m_started(false)
+        , m_finished(false)
+        , m_line(1)
+    {
+    }
+
+    qsizetype parse(const QByteArray &buffer, bool atEnd, QVector<PendingRow> *rows, QString *error)
+    {
+        const char *data = buffer.constData();
+        const qsizetype size = buffer.size();
+        qsizetype consumed = 0;
+        auto advanceTo = [this, &buffer, &consumed](qsizetype pos) {
+            m_line += countLines(buffer, consumed, pos);
+            consumed = pos;
+        };
+
+        if (!m_started) {
+            qsizetype pos = buffer.startsWith("\xEF\xBB\xBF") ? 3 : 0;
+            pos = skip(data, pos, size, false);
+            if (pos >= size) {
+                if (atEnd) {
+                    *error = QString("文件为空");
+                }
+                return 0;
+            }
+            if (data[pos] != '[') {
+                *error = QString("不是配置列表（JSON 数组）");
+                return size;
+            }
+            m_started = true;
+            advanceTo(pos + 1);
+        }
+
+        while (!m_finished) {
+            const qsizetype pos = skip(data, consumed, size, true);
+            if (pos >= size) {
+                break;
+            }
+            if (data[pos] == ']') {
+                m_finished = true;
+                advanceTo(pos + 1);
+                break;
+            }
+
+            const qsizetype end = valueEnd(data, pos, size);
+            if (end < 0) {
+                break;      // Continues in the next block
+            }
+
+            advanceTo(pos);
+            PendingRow row;
+            row.line = m_line;
+            if (data[pos] == '{') {
+                row.json = QByteArray(data + pos, end - pos);
+            } else {
+                row.error = QString("不是配置对象");
+            }
+            rows->append(row);
+            advanceTo(end);
+        }
+
+        if (atEnd && !m_finished) {
+            PendingRow row;
+            row.line = m_line + countLines(buffer, consumed, size);
+            row.error = QString("文件不完整，缺少结尾的 ]");
+            rows->append(row);
+            return size;
+        }
+        return consumed;
+    }
+
+private:
+    static qsizetype skip(const char *data, qsizetype pos, qsizetype size, bool commas)
+    {
+        while (pos < size && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' ||
+                              data[pos] == '\n' || (commas && data[pos] == ','))) {
+            ++pos;
+        }
+        return pos;
+    }
+
+    // End of the JSON value starting at pos, or -1 if it runs past the data
+    static qsizetype valueEnd(const char *data, qsizetype pos, qsizetype size)
+    {
+        if (data[pos] != '{' && data[pos] != '[' && data[pos] != '"') {
+            while (pos < size && data[pos] != ',' && data[pos] != ']' && data[pos] != ' ' &&
+                   data[pos] != '\t' && data[pos] != '\r' && data[pos] != '\n') {
+                ++pos;
+            }
+            return pos < size ? pos : -1;
+        }
+
+        int depth = 0;
+        bool inString = false;
+        for (qsizetype i = pos; i < size; ++i) {
+            const char c = data[i];
+            if (inString) {
+                if (c == '\\') {
+                    ++i;
+                } else if (c == '"') {
+                    inString = false;
+                    if (depth == 0) {
+                        return i + 1;
+                    }
+                }
+            } else if (c == '"') {
+                inString = true;
+            } else if (c == '{' || c == '[') {
+                ++depth;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                return i + 1;
+            }
+        }
+        return -1;
+    }
+
+    bool m_started;
+    bool m_finished;
+    qint64 m_line;
+};
+
+void appendCsvField(QByteArray &out, const QString &text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    const bool quote = utf8.contains(',') || utf8.contains('"') || utf8.contains('\n') ||
+                       utf8.contains('\r') || utf8.startsWith(' ') || utf8.endsWith(' ');
+    if (!quote) {
+        out += utf8;
+        return;
+    }
+    out += '"';
+    for (char c : utf8) {
+        if (c == '"') {
+            out += '"';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+} // namespace
+
+ConfigTransfer::Format ConfigTransfer::formatForPath(const QString &filePath)
+{
+    return QFileInfo(filePath).suffix().compare("csv", Qt::CaseInsensitive) == 0 ? Csv : Json;
+}
+
+ImportResult ConfigTransfer::importFile(const QString &filePath, const QString &defaultAdapterGuid,
+                                        const Progress &progress)
+{
+    ImportResult result;
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        result.error = file.errorString();
+        return result;
+    }
+
+    const qint64 total = file.size();
+    const Format format = formatForPath(filePath);
+    CsvImport csv;
+    JsonImport json;
+    QThreadPool pool;
+
+    QByteArray buffer;
+    QVector<PendingRow> rows;
+    bool atEnd = false;
+    while (!atEnd) {
+        const QByteArray block = file.read(kBlockSize);
+        if (block.isEmpty()) {
+            if (file.error() != QFileDevice::NoError) {
+                result.error = file.errorString();
+                return result;
+            }
+            atEnd = true;
+        }
+        // Whatever was not a complete row stays in front
+        buffer += block;
+
+        const qsizetype consumed = format == Csv ? csv.parse(buffer, atEnd, &rows, &result.error)
+                                                 : json.parse(buffer, atEnd, &rows, &result.error);
+        buffer.remove(0, consumed);
+        if (!result.error.isEmpty()) {
+            return result;
+        }
+
+        finishRows(rows, defaultAdapterGuid, &pool, &result);
+        if (progress && !progress(file.pos(), total)) {
+            result.cancelled = true;
+            return result;
+        }
+    }
+
+    qDebug() << "Imported" << result.configs.size() << "of" << result.rows << "profiles from" << filePath;
+    return result;
+}
+
+bool ConfigTransfer::exportFile(const QString &filePath, const QVector<IpConfig> &configs, QString *error)
+{
+    QSaveFile file(filePath);
+    bool ok = file.open(QIODevice::WriteOnly);
+
+    QByteArray block;
+    block.reserve(kBlockSize + 4096);
+    auto writeBlock = [&file, &block, &ok]() {
+        ok = ok && file.write(block) == block.size();
+        block.clear();
+    };
+
+    if (formatForPath(filePath) == Csv) {
+        // The BOM lets Excel detect UTF-8
+        block += "\xEF\xBB\xBF";
+        for (int column = 0; column < ColumnCount; ++column) {
+            block += column > 0 ? "," : "";
+            block += kColumnNames[column];
+        }
+        block += "\r\n";
+
+        for (const IpConfig &config : configs) {
+            appendCsvField(block, config.name);
+            for (const QString *field : { &config.ipAddress, &config.subnetMask, &config.gateway,
+                                          &config.dns1, &config.dns2 }) {
+                block += ',';
+                appendCsvField(block, *field);
+            }
+            block += config.isDhcp ? ",true," : ",false,";
+            appendCsvField(block, config.adapterGuid);
+            block += "\r\n";
+            if (block.size() >= kBlockSize) {
+                writeBlock();
+            }
+        }
+    } else {
+        // One profile per line, so the file is easy to diff and to read back
+        // in blocks
+        block += "[\n";
+        for (int i = 0; i < configs.size(); ++i) {
+            block += "    ";
+            block += QJsonDocument(IpConfigManager::serializeIpConfig(configs[i])).toJson(QJsonDocument::Compact);
+            block += i + 1 < configs.size() ? ",\n" : "\n";
+            if (block.size() >= kBlockSize) {
+                writeBlock();
+            }
+        }
+        block += "]\n";
+    }
+    writeBlock();
+
+    ok = ok && file.commit();
+    if (!ok) {
+        qWarning() << "Failed to export profiles:" << filePath << file.errorString();
+        if (error) {
+            *error = file.errorString();
+        }
+    }
+    return ok;
+}
+
+QString ConfigTransfer::validate(const IpConfig &config)
+{
+    if (config.name.trimmed().isEmpty()) {
+        return QString("缺少配置名称");
+    }
+    if (config.isDhcp) {
+        return QString();
+    }
+
+    quint32 address = 0;
+    if (!ConfigTable::parseAddress(config.ipAddress.trimmed(), &address)) {
+        return QString("IP地址无效：%1").arg(config.ipAddress);
+    }
+    if (ConfigDelta::prefixFromMask(config.subnetMask) <= 0) {
+        return QString("子网掩码无效：%1").arg(config.subnetMask);
+    }
+    if (!config.gateway.isEmpty() && !ConfigTable::parseAddress(config.gateway.trimmed(), &address)) {
+        return QString("默认网关无效：%1").arg(config.gateway);
+    }
+    for (const QString &dns : { config.dns1, config.dns2 }) {
+        if (!dns.isEmpty() && QHostAddress(dns.trimmed()).isNull()) {
+            return QString("DNS服务器无效：%1").arg(dns);
+        }
+    }
+    return QString();
+}
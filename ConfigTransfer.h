@@ -0,0 +1,57 @@
+#ifndef CONFIGTRANSFER_H
+#define CONFIGTRANSFER_H
+
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "IpConfig.h"
+
+struct ImportError {
+    qint64 line = 0;    // 1-based; where the row or object starts
+    QString message;
+};
+
+struct ImportResult {
+    QVector<IpConfig> configs;      // Valid rows in file order, without ids
+    QVector<ImportError> errors;    // In line order
+    qint64 rows = 0;
+    bool cancelled = false;
+    QString error;                  // Set if the file could not be read at all
+};
+
+// Bulk import and export of profiles, as CSV or as a JSON array like
+// ip_configs.json; the format follows the file suffix.
+//
+// CSV has a header row naming its columns, in any order, after the JSON
+// keys: name, ipAddress, subnetMask, gateway, dns1, dns2, isDhcp,
+// adapterGuid. Only name is required.
+//
+// Files are read in blocks, so memory does not grow with the file beyond
+// the rows it produces. Each block's rows are parsed and validated on a
+// thread pool; every invalid row is reported with its line and skipped.
+// Nothing touches IpConfigManager: the caller commits the result in one
+// IpConfigManager::addConfigs().
+class ConfigTransfer
+{
+public:
+    enum Format {
+        Csv,
+        Json
+    };
+
+    // Called after each block; returning false cancels the import
+    using Progress = std::function<bool(qint64 bytesRead, qint64 totalBytes)>;
+
+    static Format formatForPath(const QString &filePath);
+
+    // Rows without an adapter get defaultAdapterGuid
+    static ImportResult importFile(const QString &filePath, const QString &defaultAdapterGuid,
+                                   const Progress &progress = Progress());
+    static bool exportFile(const QString &filePath, const QVector<IpConfig> &configs,
+                           QString *error = nullptr);
+
+    // Empty if the profile could be applied as it is, else why not
+    static QString validate(const IpConfig &config);
+};
+
+#endif // CONFIGTRANSFER_H
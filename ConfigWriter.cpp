@@ -0,0 +1,204 @@
+#include "ConfigWriter.h"
+#include "BinaryConfigStore.h"
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLockFile>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+// Long enough for another instance to write a large checkpoint
+const int kStoreLockTimeoutMs = 5000;
+
+} // namespace
+
+ConfigWriter::ConfigWriter(QObject *parent)
+    : QObject(parent)
+    , m_checkpointGeneration(0)
+    , m_journalEnd(0)
+{
+}
+
+StoreFileState StoreFileState::stat(const QString &path)
+{
+    StoreFileState state;
+    state.path = path;
+    const QFileInfo info(path);
+    if (info.exists()) {
+        state.size = info.size();
+        state.modified = info.lastModified();
+    }
+    return state;
+}
+
+QByteArray StoreFileState::hashFile(const QString &path)
+{
+    QFile file(path);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!file.open(QIODevice::ReadOnly) || !hash.addData(&file)) {
+        return QByteArray();
+    }
+    return hash.result();
+}
+
+QString ConfigWriter::lockFilePath(const QString &journalPath)
+{
+    return QFileInfo(journalPath).absolutePath() + "/ip_configs.lock";
+}
+
+quint64 ConfigWriter::reserveIds(const QString &journalPath, quint64 floor, int count)
+{
+    QLockFile lock(lockFilePath(journalPath));
+    if (!lock.tryLock(kStoreLockTimeoutMs)) {
+        qWarning() << "Failed to lock config store for reserving ids:" << lockFilePath(journalPath);
+        return 0;
+    }
+
+    // The next id no instance has reserved yet
+    const QString path = QFileInfo(journalPath).absolutePath() + "/ip_configs.ids";
+    QFile counter(path);
+    quint64 next = 0;
+    if (counter.open(QIODevice::ReadOnly)) {
+        next = counter.readAll().trimmed().toULongLong();
+        counter.close();
+    }
+
+    const quint64 first = qMax(qMax(next, floor), quint64(1));
+    QSaveFile file(path);
+    const QByteArray data = QByteArray::number(first + quint64(count)) + '\n';
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "Failed to save profile id counter:" << path << file.errorString();
+        return 0;
+    }
+    return first;
+}
+
+QString ConfigWriter::parseEpoch(const QByteArray &journal)
+{
+    const qsizetype end = journal.indexOf('\n');
+    if (end < 0) {
+        return QString();
+    }
+    const QJsonObject header = QJsonDocument::fromJson(journal.left(end)).object();
+    return header["op"].toString() == "epoch" ? header["epoch"].toString() : QString();
+}
+
+QString ConfigWriter::readEpoch(const QString &journalPath)
+{
+    QFile journal(journalPath);
+    return journal.open(QIODevice::ReadOnly) ? parseEpoch(journal.readLine()) : QString();
+}
+
+bool ConfigWriter::appendJournal(quint64 generation, const QString &journalPath, const QByteArray &records)
+{
+    QMutexLocker locker(&m_fileMutex);
+    if (generation <= m_checkpointGeneration) {
+        return true;    // Already part of the checkpoint
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Not while another instance checks and empties the journal
+    QLockFile lock(lockFilePath(journalPath));
+    if (!lock.tryLock(kStoreLockTimeoutMs)) {
+        qWarning() << "Failed to lock config store for appending:" << lockFilePath(journalPath);
+        emit written(generation, false, false, timer.nsecsElapsed() / 1000, 0);
+        return false;
+    }
+
+    QFile file(journalPath);
+    const bool ok = file.open(QIODevice::WriteOnly | QIODevice::Append) &&
+                    file.write(records) == records.size() && file.flush();
+    if (!ok) {
+        qWarning() << "Failed to append to config journal:" << journalPath << file.errorString();
+    } else if (file.size() == m_journalEnd + records.size()) {
+        // Nobody else appended since the manager last read the journal, and
+        // these records are its own
+        m_journalEnd = file.size();
+    }
+
+    emit written(generation, false, ok, timer.nsecsElapsed() / 1000, ok ? records.size() : 0);
+    return ok;
+}
+
+bool ConfigWriter::writeCheckpoint(quint64 generation, IpConfigManager::StoreFormat format, const QString &path,
+                                   const QString &journalPath, const ConfigTable &configs)
+{
+    QMutexLocker locker(&m_fileMutex);
+    if (generation < m_checkpointGeneration) {
+        return true;    // A newer checkpoint is already on disk
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Held from the check to the truncation, so no other instance can
+    // append in between and have its records emptied unmerged
+    QLockFile lock(lockFilePath(journalPath));
+    if (!lock.tryLock(kStoreLockTimeoutMs)) {
+        qWarning() << "Failed to lock config store for a checkpoint:" << lockFilePath(journalPath);
+        emit written(generation, true, false, timer.nsecsElapsed() / 1000, 0);
+        return false;
+    }
+
+    // Replacing a checkpoint another process wrote, or emptying a journal
+    // it appended to, would lose its changes
+    const bool rewritten = m_checkpoint.path == path && !StoreFileState::stat(path).sameStat(m_checkpoint);
+    if (rewritten || QFileInfo(journalPath).size() != m_journalEnd || readEpoch(journalPath) != m_journalEpoch) {
+        qWarning() << "Config store was changed by another process; not writing a checkpoint";
+        emit checkpointConflict(generation);
+        return false;
+    }
+
+    // The manager keeps profiles unordered; the file lists them as created
+    QVector<IpConfig> ordered = configs.toConfigs();
+    std::sort(ordered.begin(), ordered.end(), [](const IpConfig &a, const IpConfig &b) {
+        return a.id < b.id;
+    });
+
+    const QByteArray data = format == IpConfigManager::BinaryStore ? BinaryConfigStore::encode(ordered)
+                                                                    : IpConfigManager::toJson(ordered);
+
+    QSaveFile file(path);
+    bool ok = file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit();
+    if (!ok) {
+        qWarning() << "Failed to save config file:" << path << file.errorString();
+    } else {
+        m_checkpointGeneration = generation;
+        m_checkpoint = StoreFileState::stat(path);
+        m_checkpoint.hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+
+        // Everything in the journal is in the checkpoint now. The new one
+        // starts with a fresh epoch, which tells other instances that it
+        // started over even once it has grown past where they had read.
+        const QString epoch = QString::number(QRandomGenerator::global()->generate64(), 16);
+        const QByteArray header = QJsonDocument(QJsonObject{ { "op", "epoch" }, { "epoch", epoch } })
+                                      .toJson(QJsonDocument::Compact) + '\n';
+        QFile journal(journalPath);
+        if (journal.open(QIODevice::WriteOnly | QIODevice::Truncate) && journal.write(header) == header.size() &&
+            journal.flush()) {
+            m_journalEpoch = epoch;
+        } else {
+            qWarning() << "Failed to truncate config journal:" << journalPath << journal.errorString();
+            m_journalEpoch = readEpoch(journalPath);
+        }
+        journal.close();
+        m_journalEnd = QFileInfo(journalPath).size();
+    }
+
+    const qint64 micros = timer.nsecsElapsed() / 1000;
+    if (ok) {
+        qDebug() << "Saved" << configs.size() << "IP configurations in" << micros / 1000.0 << "ms";
+    }
+    emit written(generation, true, ok, micros, ok ? data.size() : 0);
+    return ok;
+}
@@ -0,0 +1,112 @@
+#ifndef CONFIGWRITER_H
+#define CONFIGWRITER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QDateTime>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include "IpConfigManager.h"
+
+// What a store file looked like when this process last wrote or read it
+struct StoreFileState {
+    QString path;
+    qint64 size = -1;       // -1 if there was no such file
+    QDateTime modified;
+    QByteArray hash;        // SHA-1 of the content; empty if not known
+
+    // Same file, same size and time; the cheap check before any hashing
+    bool sameStat(const StoreFileState &other) const
+    {
+        return path == other.path && size == other.size && modified == other.modified;
+    }
+
+    static StoreFileState stat(const QString &path);
+    static QByteArray hashFile(const QString &path);
+};
+
+// Writes the profile store for IpConfigManager, normally on its own
+// thread. The store is a checkpoint, ip_configs.json or ip_configs.bin
+// (see BinaryConfigStore), plus a journal of
+// the changes made since, one JSON record per line:
+//
+//     {"op":"add","config":{...}}
+//     {"op":"update","config":{...}}
+//     {"op":"remove","id":42}
+//
+// A journal started by a checkpoint begins with a random epoch,
+// {"op":"epoch","epoch":"..."}, that replaying skips.
+//
+// An edit appends its record, so its cost does not depend on the size of
+// the store. A checkpoint replaces the checkpoint file atomically (QSaveFile:
+// a temporary file renamed over the old one) and then starts a new journal.
+// Crashing in between is harmless, as replaying records by id on top of a
+// checkpoint that already contains them gives the same store.
+//
+// Writes carry increasing generation numbers. Once a checkpoint of some
+// generation is written, older appends and checkpoints are skipped, and
+// writes from different threads never interleave.
+//
+// Other processes may write the same files. The writer remembers the
+// checkpoint it last wrote and how much of the journal this process has
+// seen, and refuses a checkpoint if either changed behind its back: the
+// checkpoint would drop the other writer's changes, so the manager merges
+// them first (see IpConfigManager::mergeExternalChanges()). Appends and
+// checkpoints hold a lock file (ip_configs.lock) next to the store, so
+// no other instance can append between that check and the truncation.
+class ConfigWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConfigWriter(QObject *parent = nullptr);
+
+    // Thread-safe; both block until the data is on disk and return false
+    // only when writing failed
+    bool appendJournal(quint64 generation, const QString &journalPath, const QByteArray &records);
+    bool writeCheckpoint(quint64 generation, IpConfigManager::StoreFormat format, const QString &path,
+                         const QString &journalPath, const ConfigTable &configs);
+
+    // Held during every write; hold it to read the store files in a state
+    // that the accessors below describe. They need it held.
+    QMutex *fileMutex() { return &m_fileMutex; }
+    // The QLockFile that appends and checkpoints hold across processes
+    static QString lockFilePath(const QString &journalPath);
+    // Reserves count profile ids, none below floor, that no other instance
+    // gets, in a counter (ip_configs.ids) kept under that lock. Returns the
+    // first, or 0 if the counter could not be written. Does not take the
+    // file mutex; take that first if at all, as the writes do.
+    static quint64 reserveIds(const QString &journalPath, quint64 floor, int count);
+    StoreFileState knownCheckpoint() const { return m_checkpoint; }
+    void setKnownCheckpoint(const StoreFileState &state) { m_checkpoint = state; }
+    // The manager's profiles reflect the journal up to this offset
+    qint64 journalEnd() const { return m_journalEnd; }
+    void setJournalEnd(qint64 end) { m_journalEnd = end; }
+    // The epoch of the journal that offset is in
+    QString journalEpoch() const { return m_journalEpoch; }
+    void setJournalEpoch(const QString &epoch) { m_journalEpoch = epoch; }
+
+    // The epoch in a journal's first line, or an empty string for one
+    // that has none
+    static QString parseEpoch(const QByteArray &journal);
+    static QString readEpoch(const QString &journalPath);
+
+signals:
+    // Only for writes that happened, not skipped ones
+    void written(quint64 generation, bool checkpoint, bool ok, qint64 micros, qint64 bytes);
+    // Emitted by IpConfigManager's queued writes when they are done
+    void queuedWriteDone();
+    // A checkpoint was not written because another process changed the
+    // store since this one last read it
+    void checkpointConflict(quint64 generation);
+
+private:
+    QMutex m_fileMutex;
+    quint64 m_checkpointGeneration;
+    StoreFileState m_checkpoint;
+    qint64 m_journalEnd;
+    QString m_journalEpoch;
+};
+
+#endif // CONFIGWRITER_H
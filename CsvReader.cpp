@@ -0,0 +1,133 @@
+#include "CsvReader.h"
+
+CsvReader::CsvReader(QByteArrayView data)
+    : m_data(data)
+    , m_position(0)
+    , m_recordOffset(0)
+    , m_error(false)
+{
+    if (m_data.startsWith("\xEF\xBB\xBF")) {
+        m_position = 3;
+    }
+}
+
+bool CsvReader::readRecord()
+{
+    m_fields.clear();
+
+    const char *data = m_data.data();
+    const qsizetype size = m_data.size();
+    qsizetype pos = m_position;
+
+    // Blank lines are not records
+    while (pos < size && (data[pos] == '\n' || data[pos] == '\r')) {
+        ++pos;
+    }
+    if (pos >= size) {
+        m_position = size;
+        return false;
+    }
+    m_recordOffset = pos;
+
+    for (;;) {
+        Field field;
+
+        if (pos < size && data[pos] == '"') {
+            pos = parseQuoted(pos, &field);
+
+            // Anything between the closing quote and the next separator is
+            // not valid CSV; drop it
+            while (pos < size && data[pos] != ',' && data[pos] != '\n' && data[pos] != '\r') {
+                m_error = true;
+                ++pos;
+            }
+        } else {
+            field.begin = pos;
+            while (pos < size && data[pos] != ',' && data[pos] != '\n' && data[pos] != '\r') {
+                ++pos;
+            }
+            field.length = pos - field.begin;
+        }
+
+        m_fields.append(field);
+
+        if (pos < size && data[pos] == ',') {
+            ++pos;
+            continue;
+        }
+
+        // End of record: CRLF, LF, lone CR or end of data
+        if (pos < size && data[pos] == '\r') {
+            ++pos;
+        }
+        if (pos < size && data[pos] == '\n') {
+            ++pos;
+        }
+        break;
+    }
+
+    m_position = pos;
+    return true;
+}
+
+qsizetype CsvReader::parseQuoted(qsizetype pos, Field *field)
+{
+    const char *data = m_data.data();
+    const qsizetype size = m_data.size();
+
+    ++pos;  // Opening quote
+    field->begin = pos;
+
+    while (pos < size) {
+        if (data[pos] != '"') {
+            ++pos;
+            continue;
+        }
+        if (pos + 1 < size && data[pos + 1] == '"') {
+            field->escaped = true;
+            pos += 2;
+            continue;
+        }
+
+        field->length = pos - field->begin;
+        return pos + 1;  // Closing quote
+    }
+
+    // Unterminated: take the rest of the buffer
+    m_error = true;
+    field->length = pos - field->begin;
+    return pos;
+}
+
+QByteArrayView CsvReader::field(int index) const
+{
+    if (index < 0 || index >= m_fields.size()) {
+        return QByteArrayView();
+    }
+    const Field &field = m_fields[index];
+    return m_data.sliced(field.begin, field.length);
+}
+
+QString CsvReader::text(int index) const
+{
+    if (index < 0 || index >= m_fields.size()) {
+        return QString();
+    }
+
+    const Field &field = m_fields[index];
+    const QByteArrayView bytes = m_data.sliced(field.begin, field.length);
+    if (!field.escaped) {
+        return QString::fromUtf8(bytes);
+    }
+
+    // Collapse "" into " before decoding; rare enough to copy
+    QByteArray unescaped;
+    unescaped.reserve(bytes.size());
+    for (qsizetype i = 0; i < bytes.size(); ++i) {
+        unescaped.append(bytes[i]);
+        if (bytes[i] == '"' && i + 1 < bytes.size() && bytes[i + 1] == '"') {
+            ++i;
+        }
+    }
+    return QString::fromUtf8(unescaped);
+}
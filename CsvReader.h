@@ -0,0 +1,62 @@
+#ifndef CSVREADER_H
+#define CSVREADER_H
+
+#include <QByteArrayView>
+#include <QString>
+#include <QVarLengthArray>
+
+// Streaming RFC 4180 reader over a byte buffer the caller keeps alive.
+// Fields are returned as views into that buffer; only text() allocates,
+// and only for the QString it returns.
+//
+//     CsvReader reader(output);
+//     while (reader.readRecord()) {
+//         QString name = reader.text(0);
+//     }
+//
+// Handles quoted fields with commas, line breaks and doubled quotes,
+// CRLF or LF record ends, a leading UTF-8 BOM and blank lines (skipped).
+// Malformed input never fails hard: an unterminated quote runs to the end
+// of the buffer and stray characters after a closing quote are dropped,
+// both setting hasError().
+class CsvReader
+{
+public:
+    explicit CsvReader(QByteArrayView data);
+
+    // Advances to the next record; false at the end of the data
+    bool readRecord();
+
+    int fieldCount() const { return m_fields.size(); }
+
+    // Byte offset of the current record in the data, after skipped blank
+    // lines
+    qsizetype recordOffset() const { return m_recordOffset; }
+
+    // Raw field bytes without the surrounding quotes. Doubled quotes are
+    // still doubled; use text() for the decoded value.
+    QByteArrayView field(int index) const;
+
+    // Field decoded from UTF-8 with doubled quotes collapsed; empty if the
+    // record has no such field
+    QString text(int index) const;
+
+    bool hasError() const { return m_error; }
+
+private:
+    struct Field {
+        qsizetype begin = 0;
+        qsizetype length = 0;
+        bool escaped = false;  // Contains doubled quotes
+    };
+
+    qsizetype parseQuoted(qsizetype pos, Field *field);
+
+    QByteArrayView m_data;
+    qsizetype m_position;
+    qsizetype m_recordOffset;
+    QVarLengthArray<Field, 8> m_fields;  // Reused for every record
+    bool m_error;
+};
+
+#endif // CSVREADER_H
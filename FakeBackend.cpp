@@ -0,0 +1,229 @@
+#include "FakeBackend.h"
+#include "ConfigDelta.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+namespace {
+
+QMutex stateMutex;
+QVector<AdapterState> *systemState = nullptr;  // Guarded by stateMutex
+
+QVector<AdapterState> &states()
+{
+    if (!systemState) {
+        bool ok = false;
+        int count = qEnvironmentVariableIntValue("IPTOOL_FAKE_ADAPTERS", &ok);
+        if (!ok || count < 0) {
+            count = 2;
+        }
+
+        systemState = new QVector<AdapterState>;
+        systemState->reserve(count);
+        for (int i = 0; i < count; ++i) {
+            const NetworkAdapter adapter = FakeBackend::adapter(i);
+            AdapterState state;
+            state.name = adapter.name;
+            state.guid = adapter.guid;
+            state.linkUp = true;
+            state.valid = true;
+            state.isDhcp = true;
+            state.dnsFromDhcp = true;
+            InterfaceAddress address;
+            address.address = QString("10.%1.%2.100").arg((i >> 8) & 0xFF).arg(i & 0xFF);
+            address.prefixLength = 24;
+            state.addresses.append(address);
+            state.gateways << QString("10.%1.%2.1").arg((i >> 8) & 0xFF).arg(i & 0xFF);
+            state.dnsServers << state.gateways.first();
+            systemState->append(state);
+        }
+    }
+    return *systemState;
+}
+
+AdapterState *findState(const QString &adapterName)
+{
+    for (AdapterState &state : states()) {
+        if (state.name == adapterName) {
+            return &state;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+FakeBackend::FakeBackend(QObject *parent)
+    : NetworkBackend(parent)
+    , m_latencyMs(qMax(0, qEnvironmentVariableIntValue("IPTOOL_FAKE_LATENCY_MS")))
+{
+}
+
+QString FakeBackend::name() const
+{
+    return "fake";
+}
+
+bool FakeBackend::hasPrivileges()
+{
+    return true;
+}
+
+NetworkAdapter FakeBackend::adapter(int index)
+{
+    NetworkAdapter adapter;
+    adapter.name = QString("Fake Ethernet %1").arg(index + 1);
+    adapter.description = QString("Fake Gigabit Adapter #%1").arg(index + 1);
+    adapter.guid = QString("00000000-0000-4000-8000-%1").arg(index, 12, 16, QLatin1Char('0')).toUpper();
+    return adapter;
+}
+
+QVector<NetworkAdapter> FakeBackend::enumerateAdapters()
+{
+    simulateLatency();
+
+    QMutexLocker locker(&stateMutex);
+    const int count = states().size();
+    locker.unlock();
+
+    QVector<NetworkAdapter> adapters;
+    adapters.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        adapters.append(adapter(i));
+    }
+    return adapters;
+}
+
+AdapterState FakeBackend::readState(const QString &adapterName)
+{
+    simulateLatency();
+
+    QMutexLocker locker(&stateMutex);
+    const AdapterState *state = findState(adapterName);
+    if (!state) {
+        AdapterState missing;
+        missing.name = adapterName;
+        return missing;
+    }
+    return *state;
+}
+
+QVector<AdapterState> FakeBackend::readAllStates()
+{
+    simulateLatency();
+
+    QMutexLocker locker(&stateMutex);
+    return states();
+}
+
+BackendResult FakeBackend::setStatic(const QString &adapterName, const IpConfig &config,
+                                     const ProgressCallback &onProgress)
+{
+    BackendResult result;
+    if (onProgress) {
+        onProgress(0, 1, QString("设置IP地址 %1/%2").arg(config.ipAddress, config.subnetMask));
+    }
+    simulateLatency();
+
+    QMutexLocker locker(&stateMutex);
+    AdapterState *state = findState(adapterName);
+    if (!state) {
+        result.message = QString("错误：找不到网卡“%1”。").arg(adapterName);
+        return result;
+    }
+
+    InterfaceAddress address;
+    address.address = config.ipAddress;
+    address.prefixLength = qMax(0, ConfigDelta::prefixFromMask(config.subnetMask));
+    state->addresses = QVector<InterfaceAddress>() << address;
+    state->gateways.clear();
+    if (!config.gateway.isEmpty()) {
+        state->gateways << config.gateway;
+    }
+    if (!config.dns1.isEmpty() || !config.dns2.isEmpty()) {
+        state->dnsServers.clear();
+        for (const QString &server : QStringList() << config.dns1 << config.dns2) {
+            if (!server.isEmpty()) {
+                state->dnsServers << server;
+            }
+        }
+        state->dnsFromDhcp = false;
+    }
+    state->isDhcp = false;
+    locker.unlock();
+
+    if (onProgress) {
+        onProgress(1, 1, QString("设置IP地址 %1/%2").arg(config.ipAddress, config.subnetMask));
+    }
+    result.success = true;
+    result.message = QString("IP地址修改成功！");
+    return result;
+}
+
+BackendResult FakeBackend::setDhcp(const QString &adapterName, const ProgressCallback &onProgress)
+{
+    BackendResult result;
+    if (onProgress) {
+        onProgress(0, 1, QString("切换到DHCP"));
+    }
+    simulateLatency();
+
+    QMutexLocker locker(&stateMutex);
+    AdapterState *state = findState(adapterName);
+    if (!state) {
+        result.message = QString("错误：找不到网卡“%1”。").arg(adapterName);
+        return result;
+    }
+    state->isDhcp = true;
+    state->dnsFromDhcp = true;
+    locker.unlock();
+
+    if (onProgress) {
+        onProgress(1, 1, QString("切换到DHCP"));
+    }
+    result.success = true;
+    result.message = QString("已成功切换到DHCP模式！");
+    return result;
+}
+
+BackendResult FakeBackend::applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                                      const ProgressCallback &onProgress)
+{
+    BackendResult result = NetworkBackend::applyDelta(adapterName, delta, onProgress);
+    const AdapterState &snapshot = delta.snapshot();
+    if (!result.success || snapshot.name.isEmpty()) {
+        return result;
+    }
+
+    // A restored snapshot holds more than setStatic()/setDhcp() take
+    QMutexLocker locker(&stateMutex);
+    AdapterState *state = findState(adapterName);
+    if (!state) {
+        return result;
+    }
+    if (delta.has(ConfigDelta::Address)) {
+        state->addresses = snapshot.addresses;
+    }
+    if (delta.has(ConfigDelta::PrimaryDns)) {
+        state->dnsServers = snapshot.dnsServers;
+        state->dnsFromDhcp = false;
+    } else if (delta.has(ConfigDelta::DnsDhcp)) {
+        state->dnsFromDhcp = true;
+    } else {
+        state->dnsServers = delta.live().dnsServers;
+        state->dnsFromDhcp = delta.live().dnsFromDhcp;
+    }
+    return result;
+}
+
+bool FakeBackend::startWatching()
+{
+    return false;
+}
+
+void FakeBackend::simulateLatency() const
+{
+    if (m_latencyMs > 0) {
+        QThread::msleep(m_latencyMs);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef FAKEBACKEND_H
+#define FAKEBACKEND_H
+
+#include "NetworkBackend.h"
+
+// In-memory backend for benchmarks and headless runs, selected with
+// IPTOOL_BACKEND=fake. Nothing touches the system: changes only update a
+// table that every FakeBackend instance in the process shares, so the
+// query worker sees what the apply workers wrote.
+//
+// IPTOOL_FAKE_ADAPTERS sets the number of adapters (default 2) and
+// IPTOOL_FAKE_LATENCY_MS adds a delay to every call.
+class FakeBackend : public NetworkBackend
+{
+    Q_OBJECT
+
+public:
+    explicit FakeBackend(QObject *parent = nullptr);
+
+    QString name() const override;
+    bool hasPrivileges() override;
+    QVector<NetworkAdapter> enumerateAdapters() override;
+    AdapterState readState(const QString &adapterName) override;
+    QVector<AdapterState> readAllStates() override;
+    BackendResult setStatic(const QString &adapterName, const IpConfig &config,
+                            const ProgressCallback &onProgress) override;
+    BackendResult setDhcp(const QString &adapterName,
+                          const ProgressCallback &onProgress) override;
+    BackendResult applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                             const ProgressCallback &onProgress) override;
+    bool startWatching() override;
+
+    // Adapter i as the fake system reports it
+    static NetworkAdapter adapter(int index);
+
+private:
+    void simulateLatency() const;
+
+    int m_latencyMs;
+};
+
+#endif // FAKEBACKEND_H
@@ -0,0 +1,407 @@
+#include "HelperBackend.h"
+#include "HelperServer.h"
+#include "ConfigDelta.h"
+#include "NetworkAdapterManager.h"
+#include "CommandMetrics.h"
+#include <QCoreApplication>
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QLocalSocket>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QDebug>
+
+using namespace HelperProtocol;
+
+namespace {
+
+// Covers the time the user needs to answer the UAC prompt
+const int LaunchTimeoutMs = 60000;
+
+// Several workers may need the helper at the same time; only one of them
+// launches it so the user sees a single UAC prompt
+QMutex launchMutex;
+
+} // namespace
+
+HelperBackend::HelperBackend(QObject *parent)
+    : NetworkBackend(parent)
+    , m_serverName(HelperServer::defaultServerName())
+    , m_socket(nullptr)
+    , m_nextRequestId(1)
+    , m_inCall(false)
+    , m_privileged(false)
+    , m_local(NetworkBackend::createLocal(qEnvironmentVariable("IPTOOL_HELPER_BACKEND"), this))
+    , m_cancelRequested(false)
+{
+    connect(m_local, &NetworkBackend::adaptersChanged, this, &NetworkBackend::adaptersChanged);
+}
+
+HelperBackend::~HelperBackend()
+{
+    // Closing the connection also ends the helper
+    if (m_socket) {
+        m_socket->disconnectFromServer();
+    }
+}
+
+QString HelperBackend::name() const
+{
+    return QString("helper (%1)").arg(m_local->name());
+}
+
+bool HelperBackend::hasPrivileges()
+{
+    // Without a helper yet, privileges are available on demand: the first
+    // change launches it elevated
+    if (connectToHelper()) {
+        return m_privileged;
+    }
+    return true;
+}
+
+QVector<NetworkAdapter> HelperBackend::enumerateAdapters()
+{
+    if (!connectToHelper()) {
+        return m_local->enumerateAdapters();
+    }
+
+    Message reply;
+    if (!call(EnumerateAdapters, QByteArray(), &reply) || reply.type != Adapters) {
+        return QVector<NetworkAdapter>();
+    }
+
+    Reader reader(reply.payload);
+    const QVector<NetworkAdapter> adapters = reader.readAdapters();
+    return reader.ok() ? adapters : QVector<NetworkAdapter>();
+}
+
+AdapterState HelperBackend::readState(const QString &adapterName)
+{
+    if (!connectToHelper()) {
+        return m_local->readState(adapterName);
+    }
+
+    Writer writer;
+    writer.writeString(adapterName);
+
+    Message reply;
+    if (!call(ReadState, writer.data(), &reply) || reply.type != State) {
+        AdapterState state;
+        state.name = adapterName;
+        return state;
+    }
+
+    Reader reader(reply.payload);
+    AdapterState state = reader.readState();
+    if (!reader.ok()) {
+        state = AdapterState();
+    }
+    state.name = adapterName;
+    return state;
+}
+
+QVector<AdapterState> HelperBackend::readAllStates()
+{
+    if (!connectToHelper()) {
+        return m_local->readAllStates();
+    }
+
+    Message reply;
+    if (!call(ReadAllStates, QByteArray(), &reply) || reply.type != States) {
+        return QVector<AdapterState>();
+    }
+
+    Reader reader(reply.payload);
+    const QVector<AdapterState> states = reader.readStates();
+    return reader.ok() ? states : QVector<AdapterState>();
+}
+
+BackendResult HelperBackend::setStatic(const QString &adapterName, const IpConfig &config,
+                                       const ProgressCallback &onProgress)
+{
+    Writer writer;
+    writer.writeString(adapterName);
+    writer.writeConfig(config);
+    return apply(SetStatic, writer.data(), onProgress);
+}
+
+BackendResult HelperBackend::setDhcp(const QString &adapterName, const ProgressCallback &onProgress)
+{
+    Writer writer;
+    writer.writeString(adapterName);
+    return apply(SetDhcp, writer.data(), onProgress);
+}
+
+BackendResult HelperBackend::applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                                        const ProgressCallback &onProgress)
+{
+    if (delta.snapshot().name.isEmpty()) {
+        return NetworkBackend::applyDelta(adapterName, delta, onProgress);
+    }
+
+    // A restore holds more than SetStatic/SetDhcp carry; the helper builds
+    // it again from the same states and runs it on its own backend
+    const bool withDns = delta.has(ConfigDelta::PrimaryDns) || delta.has(ConfigDelta::SecondaryDns) ||
+                         delta.has(ConfigDelta::DnsDhcp);
+    Writer writer;
+    writer.writeString(adapterName);
+    writer.writeState(delta.live());
+    writer.writeState(delta.snapshot());
+    writer.writeU8(withDns ? 1 : 0);
+    return apply(Restore, writer.data(), onProgress);
+}
+
+bool HelperBackend::startWatching()
+{
+    // The helper forwards its own notifications as Changed messages, but
+    // it only runs while changes are made; the local backend covers the
+    // rest of the session
+    return m_local->startWatching();
+}
+
+void HelperBackend::cancel()
+{
+    m_cancelRequested = true;
+}
+
+void HelperBackend::clearCancel()
+{
+    m_cancelRequested = false;
+}
+
+void HelperBackend::onReadyRead()
+{
+    readIncoming();
+
+    // Outside of call() nothing is waiting for replies; whatever is left
+    // belongs to requests that were given up on
+    if (!m_inCall) {
+        m_inbox.clear();
+    }
+}
+
+bool HelperBackend::connectToHelper()
+{
+    if (m_socket && m_socket->state() == QLocalSocket::ConnectedState) {
+        return true;
+    }
+
+    if (!m_socket) {
+        m_socket = new QLocalSocket(this);
+        connect(m_socket, &QLocalSocket::readyRead, this, &HelperBackend::onReadyRead);
+    }
+
+    m_socket->connectToServer(m_serverName);
+    if (!m_socket->waitForConnected(1000)) {
+        m_socket->abort();
+        return false;
+    }
+
+    m_buffer.clear();
+    m_inbox.clear();
+
+    Writer writer;
+    writer.writeU16(Version);
+
+    Message reply;
+    if (!call(Hello, writer.data(), &reply) || reply.type != Welcome) {
+        qWarning() << "Helper did not answer the handshake";
+        m_socket->abort();
+        return false;
+    }
+
+    Reader reader(reply.payload);
+    const quint16 version = reader.readU16();
+    const quint8 flags = reader.readU8();
+    if (!reader.ok() || version != Version) {
+        qWarning() << "Helper speaks protocol version" << version << "- expected" << Version;
+        m_socket->abort();
+        return false;
+    }
+
+    m_privileged = flags & Privileged;
+    qDebug() << "Connected to helper" << m_serverName << "privileged:" << m_privileged;
+    return true;
+}
+
+bool HelperBackend::ensureHelper()
+{
+    if (connectToHelper()) {
+        return true;
+    }
+
+    QMutexLocker locker(&launchMutex);
+    if (connectToHelper()) {
+        return true;  // Another worker launched it meanwhile
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QString program = QCoreApplication::applicationFilePath();
+    if (!NetworkAdapterManager::runElevated(program, QStringList() << "--helper" << m_serverName)) {
+        qWarning() << "Failed to launch helper" << program;
+        CommandMetrics::instance()->record("helper.launch", timer, CommandMetrics::Failed);
+        return false;
+    }
+
+    // The helper starts listening once its backend is ready; this includes
+    // the time the user spends on the UAC prompt
+    QDeadlineTimer deadline(LaunchTimeoutMs);
+    while (!deadline.hasExpired() && !m_cancelRequested) {
+        if (connectToHelper()) {
+            CommandMetrics::instance()->record("helper.launch", timer, CommandMetrics::Succeeded);
+            return true;
+        }
+        QThread::msleep(250);
+    }
+    CommandMetrics::instance()->record("helper.launch", timer,
+                                       m_cancelRequested ? CommandMetrics::Cancelled
+                                                         : CommandMetrics::TimedOut);
+    return false;
+}
+
+bool HelperBackend::call(quint8 type, const QByteArray &payload, Message *reply,
+                         const ProgressCallback &onProgress)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const quint32 requestId = m_nextRequestId++;
+    m_socket->write(encode(type, requestId, payload));
+    m_socket->flush();
+
+    m_inCall = true;
+    bool cancelSent = false;
+    bool answered = false;
+
+    while (!answered) {
+        for (auto it = m_inbox.begin(); it != m_inbox.end();) {
+            if (it->requestId != requestId) {
+                it = m_inbox.erase(it);  // Late reply to a cancelled request
+            } else if (it->type == Progress) {
+                Reader reader(it->payload);
+                const int step = reader.readU16();
+                const int totalSteps = reader.readU16();
+                const QString description = reader.readString();
+                if (reader.ok() && onProgress) {
+                    onProgress(step, totalSteps, description);
+                }
+                it = m_inbox.erase(it);
+            } else {
+                *reply = *it;
+                m_inbox.erase(it);
+                answered = true;
+                break;
+            }
+        }
+        if (answered) {
+            break;
+        }
+
+        if (m_cancelRequested && !cancelSent) {
+            m_socket->write(encode(Cancel, requestId));
+            m_socket->flush();
+            cancelSent = true;
+        }
+
+        if (m_socket->state() != QLocalSocket::ConnectedState) {
+            break;
+        }
+        // Short waits so cancel() is noticed promptly
+        if (m_socket->waitForReadyRead(50) || m_socket->bytesAvailable() > 0) {
+            if (!readIncoming()) {
+                break;
+            }
+        }
+    }
+
+    m_inCall = false;
+
+    CommandMetrics::instance()->record(requestKind(type), timer,
+                                       !answered ? CommandMetrics::Failed
+                                       : cancelSent ? CommandMetrics::Cancelled
+                                                    : CommandMetrics::Succeeded,
+                                       answered ? reply->payload.size() : 0);
+    return answered;
+}
+
+QString HelperBackend::requestKind(quint8 type)
+{
+    switch (type) {
+    case Hello:
+        return "helper.hello";
+    case EnumerateAdapters:
+        return "helper.enumerateAdapters";
+    case ReadState:
+        return "helper.readState";
+    case ReadAllStates:
+        return "helper.readAllStates";
+    case SetStatic:
+        return "helper.setStatic";
+    case SetDhcp:
+        return "helper.setDhcp";
+    case Restore:
+        return "helper.restore";
+    case CheckPrivileges:
+        return "helper.checkPrivileges";
+    default:
+        return QString("helper.0x%1").arg(type, 2, 16, QLatin1Char('0'));
+    }
+}
+
+bool HelperBackend::readIncoming()
+{
+    m_buffer.append(m_socket->readAll());
+
+    Message message;
+    for (;;) {
+        const DecodeStatus status = decode(m_buffer, &message);
+        if (status == NeedMoreData) {
+            return true;
+        }
+        if (status == Malformed) {
+            qWarning() << "Malformed message from helper, disconnecting";
+            m_buffer.clear();
+            m_socket->abort();
+            return false;
+        }
+
+        if (message.type == Changed) {
+            emit adaptersChanged();
+        } else {
+            m_inbox.append(message);
+        }
+    }
+}
+
+BackendResult HelperBackend::apply(quint8 type, const QByteArray &payload, const ProgressCallback &onProgress)
+{
+    BackendResult result;
+
+    if (!ensureHelper()) {
+        result.cancelled = m_cancelRequested;
+        result.message = result.cancelled
+            ? QString("操作已取消。")
+            : QString("错误：无法启动特权辅助进程。请在用户账户控制提示中选择\"是\"，或以管理员身份运行本程序。");
+        return result;
+    }
+
+    Message reply;
+    if (!call(type, payload, &reply, onProgress) || reply.type != Result) {
+        result.message = QString("错误：与特权辅助进程的连接已断开。");
+        return result;
+    }
+
+    Reader reader(reply.payload);
+    result.success = reader.readU8() != 0;
+    result.message = reader.readString();
+    if (!reader.ok()) {
+        result.success = false;
+        result.message = QString("错误：特权辅助进程返回了无效的结果。");
+    }
+    result.cancelled = !result.success && m_cancelRequested;
+    return result;
+}
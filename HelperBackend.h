@@ -0,0 +1,68 @@
+#ifndef HELPERBACKEND_H
+#define HELPERBACKEND_H
+
+#include "NetworkBackend.h"
+#include "HelperProtocol.h"
+#include <QList>
+#include <atomic>
+
+class QLocalSocket;
+
+// Forwards every operation to the privileged helper process (HelperServer)
+// so the GUI itself can run unprivileged. The helper is launched elevated
+// through NetworkAdapterManager::runElevated() the first time a change is
+// applied; until then, and if it cannot be started, queries are answered
+// by a local backend.
+//
+// Calls block the worker thread like every other backend; cancel() is
+// forwarded to the helper.
+class HelperBackend : public NetworkBackend
+{
+    Q_OBJECT
+
+public:
+    explicit HelperBackend(QObject *parent = nullptr);
+    ~HelperBackend();
+
+    QString name() const override;
+    bool hasPrivileges() override;
+    QVector<NetworkAdapter> enumerateAdapters() override;
+    AdapterState readState(const QString &adapterName) override;
+    QVector<AdapterState> readAllStates() override;
+    BackendResult setStatic(const QString &adapterName, const IpConfig &config,
+                            const ProgressCallback &onProgress) override;
+    BackendResult setDhcp(const QString &adapterName,
+                          const ProgressCallback &onProgress) override;
+    BackendResult applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                             const ProgressCallback &onProgress) override;
+    bool startWatching() override;
+
+    void cancel() override;
+    void clearCancel() override;
+
+private slots:
+    void onReadyRead();
+
+private:
+    bool connectToHelper();
+    bool ensureHelper();
+    bool call(quint8 type, const QByteArray &payload, HelperProtocol::Message *reply,
+              const ProgressCallback &onProgress = ProgressCallback());
+    bool readIncoming();
+    static QString requestKind(quint8 type);  // CommandMetrics label
+    BackendResult apply(quint8 type, const QByteArray &payload, const ProgressCallback &onProgress);
+
+    QString m_serverName;
+    QLocalSocket *m_socket;
+    QByteArray m_buffer;
+    QList<HelperProtocol::Message> m_inbox;
+    quint32 m_nextRequestId;
+    bool m_inCall;
+    bool m_privileged;
+
+    NetworkBackend *m_local;  // Unprivileged fallback for queries
+
+    std::atomic_bool m_cancelRequested;
+};
+
+#endif // HELPERBACKEND_H
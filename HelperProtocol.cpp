@@ -0,0 +1,269 @@
+#include "HelperProtocol.h"
+#include <QtEndian>
+
+namespace HelperProtocol {
+
+// Type byte + request id
+static const quint32 HeaderSize = 1 + 4;
+
+void Writer::writeU8(quint8 value)
+{
+    m_data.append(char(value));
+}
+
+void Writer::writeU16(quint16 value)
+{
+    char bytes[2];
+    qToBigEndian(value, bytes);
+    m_data.append(bytes, sizeof(bytes));
+}
+
+void Writer::writeU32(quint32 value)
+{
+    char bytes[4];
+    qToBigEndian(value, bytes);
+    m_data.append(bytes, sizeof(bytes));
+}
+
+void Writer::writeString(const QString &value)
+{
+    QByteArray utf8 = value.toUtf8();
+    if (utf8.size() > 0xFFFF) {
+        utf8.truncate(0xFFFF);
+    }
+    writeU16(quint16(utf8.size()));
+    m_data.append(utf8);
+}
+
+void Writer::writeStringList(const QStringList &values)
+{
+    const int count = qMin(int(values.size()), 0xFFFF);
+    writeU16(quint16(count));
+    for (int i = 0; i < count; ++i) {
+        writeString(values[i]);
+    }
+}
+
+void Writer::writeAdapter(const NetworkAdapter &adapter)
+{
+    writeString(adapter.name);
+    writeString(adapter.description);
+    writeString(adapter.guid);
+}
+
+void Writer::writeAdapters(const QVector<NetworkAdapter> &adapters)
+{
+    const int count = qMin(int(adapters.size()), 0xFFFF);
+    writeU16(quint16(count));
+    for (int i = 0; i < count; ++i) {
+        writeAdapter(adapters[i]);
+    }
+}
+
+void Writer::writeState(const AdapterState &state)
+{
+    writeString(state.name);
+    writeString(state.guid);
+
+    const int count = qMin(int(state.addresses.size()), 0xFFFF);
+    writeU16(quint16(count));
+    for (int i = 0; i < count; ++i) {
+        writeString(state.addresses[i].address);
+        writeU8(quint8(state.addresses[i].prefixLength));
+    }
+
+    writeStringList(state.gateways);
+    writeStringList(state.dnsServers);
+    writeU8((state.isDhcp ? 0x01 : 0) | (state.linkUp ? 0x02 : 0) | (state.dnsFromDhcp ? 0x04 : 0) |
+            (state.valid ? 0x08 : 0));
+}
+
+void Writer::writeStates(const QVector<AdapterState> &states)
+{
+    const int count = qMin(int(states.size()), 0xFFFF);
+    writeU16(quint16(count));
+    for (int i = 0; i < count; ++i) {
+        writeState(states[i]);
+    }
+}
+
+void Writer::writeConfig(const IpConfig &config)
+{
+    writeString(config.name);
+    writeString(config.ipAddress);
+    writeString(config.subnetMask);
+    writeString(config.gateway);
+    writeString(config.dns1);
+    writeString(config.dns2);
+    writeString(config.adapterGuid);
+    writeU8(config.isDhcp ? 1 : 0);
+}
+
+Reader::Reader(const QByteArray &data)
+    : m_data(data)
+    , m_position(0)
+    , m_error(false)
+{
+}
+
+bool Reader::take(int size)
+{
+    if (m_error || size > m_data.size() - m_position) {
+        m_error = true;
+        return false;
+    }
+    return true;
+}
+
+quint8 Reader::readU8()
+{
+    if (!take(1)) {
+        return 0;
+    }
+    return quint8(m_data[m_position++]);
+}
+
+quint16 Reader::readU16()
+{
+    if (!take(2)) {
+        return 0;
+    }
+    const quint16 value = qFromBigEndian<quint16>(m_data.constData() + m_position);
+    m_position += 2;
+    return value;
+}
+
+quint32 Reader::readU32()
+{
+    if (!take(4)) {
+        return 0;
+    }
+    const quint32 value = qFromBigEndian<quint32>(m_data.constData() + m_position);
+    m_position += 4;
+    return value;
+}
+
+QString Reader::readString()
+{
+    const int size = readU16();
+    if (!take(size)) {
+        return QString();
+    }
+    const QString value = QString::fromUtf8(m_data.constData() + m_position, size);
+    m_position += size;
+    return value;
+}
+
+QStringList Reader::readStringList()
+{
+    QStringList values;
+    const int count = readU16();
+    for (int i = 0; i < count && !m_error; ++i) {
+        values << readString();
+    }
+    return values;
+}
+
+NetworkAdapter Reader::readAdapter()
+{
+    NetworkAdapter adapter;
+    adapter.name = readString();
+    adapter.description = readString();
+    adapter.guid = readString();
+    return adapter;
+}
+
+QVector<NetworkAdapter> Reader::readAdapters()
+{
+    QVector<NetworkAdapter> adapters;
+    const int count = readU16();
+    for (int i = 0; i < count && !m_error; ++i) {
+        adapters.append(readAdapter());
+    }
+    return adapters;
+}
+
+AdapterState Reader::readState()
+{
+    AdapterState state;
+    state.name = readString();
+    state.guid = readString();
+
+    const int count = readU16();
+    for (int i = 0; i < count && !m_error; ++i) {
+        InterfaceAddress address;
+        address.address = readString();
+        address.prefixLength = readU8();
+        state.addresses.append(address);
+    }
+
+    state.gateways = readStringList();
+    state.dnsServers = readStringList();
+    const quint8 flags = readU8();
+    state.isDhcp = flags & 0x01;
+    state.linkUp = flags & 0x02;
+    state.dnsFromDhcp = flags & 0x04;
+    state.valid = flags & 0x08;
+    return state;
+}
+
+QVector<AdapterState> Reader::readStates()
+{
+    QVector<AdapterState> states;
+    const int count = readU16();
+    for (int i = 0; i < count && !m_error; ++i) {
+        states.append(readState());
+    }
+    return states;
+}
+
+IpConfig Reader::readConfig()
+{
+    IpConfig config;
+    config.name = readString();
+    config.ipAddress = readString();
+    config.subnetMask = readString();
+    config.gateway = readString();
+    config.dns1 = readString();
+    config.dns2 = readString();
+    config.adapterGuid = readString();
+    config.isDhcp = readU8() != 0;
+    return config;
+}
+
+QByteArray encode(quint8 type, quint32 requestId, const QByteArray &payload)
+{
+    Writer writer;
+    writer.writeU32(quint32(HeaderSize + payload.size()));
+    writer.writeU8(type);
+    writer.writeU32(requestId);
+
+    QByteArray frame = writer.data();
+    frame.append(payload);
+    return frame;
+}
+
+DecodeStatus decode(QByteArray &buffer, Message *message)
+{
+    if (buffer.size() < 4) {
+        return NeedMoreData;
+    }
+
+    const quint32 length = qFromBigEndian<quint32>(buffer.constData());
+    if (length < HeaderSize || length > MaxFrameSize) {
+        return Malformed;
+    }
+    if (quint32(buffer.size()) - 4 < length) {
+        return NeedMoreData;
+    }
+
+    const char *frame = buffer.constData() + 4;
+    message->type = quint8(frame[0]);
+    message->requestId = qFromBigEndian<quint32>(frame + 1);
+    message->payload = QByteArray(frame + HeaderSize, int(length - HeaderSize));
+
+    buffer.remove(0, int(4 + length));
+    return Decoded;
+}
+
+} // namespace HelperProtocol
@@ -0,0 +1,119 @@
+#ifndef HELPERPROTOCOL_H
+#define HELPERPROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include "IpConfigManager.h"
+#include "NetworkBackend.h"
+
+// Wire format between the GUI (HelperBackend) and the privileged helper
+// (HelperServer). Every message is one frame:
+//
+//     u32 length | u8 type | u32 request id | payload
+//
+// where length counts everything after itself. Integers are big-endian,
+// strings are u16 length + UTF-8 and lists are u16 count + items. Request
+// id 0 is reserved for unsolicited messages (Changed).
+//
+// Both ends treat the other as untrusted: frames above MaxFrameSize and
+// payloads that do not parse close the connection.
+namespace HelperProtocol {
+
+const quint16 Version = 3;
+const quint32 MaxFrameSize = 1024 * 1024;
+
+enum MessageType : quint8 {
+    // GUI -> helper
+    Hello = 0x01,               // u16 version
+    EnumerateAdapters = 0x02,
+    ReadState = 0x03,           // string adapter
+    SetStatic = 0x04,           // string adapter, config
+    SetDhcp = 0x05,             // string adapter
+    CheckPrivileges = 0x06,
+    Cancel = 0x07,              // request id = operation to cancel
+    ReadAllStates = 0x08,
+    Restore = 0x09,             // string adapter, state live, state snapshot, u8 withDns
+
+    // Helper -> GUI
+    Welcome = 0x81,             // u16 version, u8 flags (WelcomeFlag)
+    Adapters = 0x82,            // list of adapter
+    State = 0x83,               // state
+    Progress = 0x84,            // u16 step, u16 total, string description
+    Result = 0x85,              // u8 success, string message
+    Privileges = 0x86,          // u8 privileged
+    Changed = 0x87,
+    States = 0x88               // list of state
+};
+
+enum WelcomeFlag : quint8 {
+    Privileged = 0x01,
+    Watching = 0x02
+};
+
+struct Message {
+    quint8 type = 0;
+    quint32 requestId = 0;
+    QByteArray payload;
+};
+
+// Serializes payload fields in the order they are written
+class Writer
+{
+public:
+    void writeU8(quint8 value);
+    void writeU16(quint16 value);
+    void writeU32(quint32 value);
+    void writeString(const QString &value);
+    void writeStringList(const QStringList &values);
+    void writeAdapter(const NetworkAdapter &adapter);
+    void writeAdapters(const QVector<NetworkAdapter> &adapters);
+    void writeState(const AdapterState &state);
+    void writeStates(const QVector<AdapterState> &states);
+    void writeConfig(const IpConfig &config);
+
+    const QByteArray &data() const { return m_data; }
+
+private:
+    QByteArray m_data;
+};
+
+// Reads payload fields back. Reading past the end sets an error and
+// returns empty values; callers check ok() once at the end.
+class Reader
+{
+public:
+    explicit Reader(const QByteArray &data);
+
+    quint8 readU8();
+    quint16 readU16();
+    quint32 readU32();
+    QString readString();
+    QStringList readStringList();
+    NetworkAdapter readAdapter();
+    QVector<NetworkAdapter> readAdapters();
+    AdapterState readState();
+    QVector<AdapterState> readStates();
+    IpConfig readConfig();
+
+    // True if every read succeeded and the payload was consumed exactly
+    bool ok() const { return !m_error && m_position == m_data.size(); }
+
+private:
+    bool take(int size);
+
+    QByteArray m_data;
+    int m_position;
+    bool m_error;
+};
+
+QByteArray encode(quint8 type, quint32 requestId, const QByteArray &payload = QByteArray());
+
+enum DecodeStatus { NeedMoreData, Decoded, Malformed };
+
+// Removes one complete frame from the front of buffer
+DecodeStatus decode(QByteArray &buffer, Message *message);
+
+} // namespace HelperProtocol
+
+#endif // HELPERPROTOCOL_H
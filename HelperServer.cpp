@@ -0,0 +1,469 @@
+#include "HelperServer.h"
+#include "ConfigDelta.h"
+#include "NetworkWorker.h"
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMetaObject>
+#include <QThread>
+#include <QTimer>
+#include <QDebug>
+
+using namespace HelperProtocol;
+
+namespace {
+
+// Exit if the GUI never connects, e.g. because it died during the UAC prompt
+const int IdleTimeoutMs = 30000;
+
+bool isIpv4(const QString &value)
+{
+    QHostAddress address;
+    return address.setAddress(value) && address.protocol() == QAbstractSocket::IPv4Protocol;
+}
+
+// The name ends up as a netsh argument in a script run with admin rights.
+// Windows PowerShell 5.1 does not escape an embedded '"' when it passes
+// arguments to a native program, so one could add arguments of its own;
+// only what interface names are made of gets through.
+bool isValidAdapterName(const QString &name)
+{
+    if (name.isEmpty() || name.size() > 256 || name.trimmed() != name) {
+        return false;
+    }
+    for (const QChar &c : name) {
+        if (!c.isLetterOrNumber() && !QStringLiteral(" -_.()#").contains(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The helper runs with more rights than the GUI, so nothing reaches the
+// backend that is not a plain address
+bool isValidConfig(const IpConfig &config)
+{
+    if (config.isDhcp) {
+        return true;
+    }
+    if (!isIpv4(config.ipAddress) || !isIpv4(config.subnetMask)) {
+        return false;
+    }
+    for (const QString &optional : {config.gateway, config.dns1, config.dns2}) {
+        if (!optional.isEmpty() && !isIpv4(optional)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Same for the states a restore is built from; every address in them can
+// end up in a netsh call
+bool isValidState(const AdapterState &state)
+{
+    for (const InterfaceAddress &address : state.addresses) {
+        if (!isIpv4(address.address) || address.prefixLength < 0 || address.prefixLength > 32) {
+            return false;
+        }
+    }
+    for (const QString &address : state.gateways + state.dnsServers) {
+        if (!isIpv4(address)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+HelperServer::HelperServer(const QString &serverName, QObject *parent)
+    : QObject(parent)
+    , m_serverName(serverName)
+    , m_server(new QLocalServer(this))
+    , m_idleTimer(new QTimer(this))
+    , m_probe(NetworkBackend::create(this))
+    , m_privileged(false)
+    , m_watching(false)
+{
+    qRegisterMetaType<NetworkAdapter>();
+    qRegisterMetaType<QVector<NetworkAdapter>>();
+    qRegisterMetaType<IpConfig>();
+    qRegisterMetaType<AdapterState>();
+    qRegisterMetaType<NetworkState>();
+
+    connect(m_server, &QLocalServer::newConnection, this, &HelperServer::onNewConnection);
+    connect(m_probe, &NetworkBackend::adaptersChanged, this, &HelperServer::onAdaptersChanged);
+
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(IdleTimeoutMs);
+    connect(m_idleTimer, &QTimer::timeout, this, []() {
+        qWarning() << "Helper: no client connected, exiting";
+        QCoreApplication::exit(1);
+    });
+    m_idleTimer->start();
+
+    // Settle the privilege question before accepting clients
+    m_privileged = m_probe->hasPrivileges();
+    m_watching = m_probe->startWatching();
+
+    // Only the same user may connect
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    QLocalServer::removeServer(m_serverName);
+    if (!m_server->listen(m_serverName)) {
+        qWarning() << "Helper: cannot listen on" << m_serverName << m_server->errorString();
+        QMetaObject::invokeMethod(qApp, []() {
+            QCoreApplication::exit(1);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    qDebug() << "Helper listening on" << m_server->fullServerName() << "backend:" << m_probe->name()
+             << "privileged:" << m_privileged << "watching:" << m_watching;
+}
+
+HelperServer::~HelperServer()
+{
+    qDeleteAll(m_sessions);
+}
+
+int HelperServer::run(const QString &serverName)
+{
+    // The helper inherits the GUI's environment; IPTOOL_BACKEND=helper
+    // there would make the helper connect to itself
+    if (qEnvironmentVariable("IPTOOL_BACKEND").toLower() == "helper") {
+        qputenv("IPTOOL_BACKEND", qgetenv("IPTOOL_HELPER_BACKEND"));
+    }
+
+    // The GUI is recording to that file already; the helper's own commands
+    // go next to it
+    const QByteArray recordPath = qgetenv("IPTOOL_RECORD");
+    if (!recordPath.isEmpty()) {
+        qputenv("IPTOOL_RECORD", recordPath + ".helper");
+    }
+
+    HelperServer server(serverName.isEmpty() ? defaultServerName() : serverName);
+    return QCoreApplication::exec();
+}
+
+QString HelperServer::defaultServerName()
+{
+    const QString overrideName = qEnvironmentVariable("IPTOOL_HELPER");
+    if (!overrideName.isEmpty()) {
+        return overrideName;
+    }
+
+    QString user = qEnvironmentVariable("USERNAME");
+    if (user.isEmpty()) {
+        user = qEnvironmentVariable("USER");
+    }
+    return QString("ChangeIPTool-helper-%1").arg(user);
+}
+
+void HelperServer::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        m_idleTimer->stop();
+
+        HelperSession *session = new HelperSession(this, socket);
+        connect(session, &HelperSession::closed, this, &HelperServer::onSessionClosed);
+        m_sessions.append(session);
+    }
+}
+
+void HelperServer::onSessionClosed()
+{
+    HelperSession *session = qobject_cast<HelperSession *>(sender());
+    m_sessions.removeAll(session);
+    session->deleteLater();
+
+    // The helper lives exactly as long as its GUI
+    if (m_sessions.isEmpty()) {
+        QCoreApplication::quit();
+    }
+}
+
+void HelperServer::onAdaptersChanged()
+{
+    for (HelperSession *session : m_sessions) {
+        session->notifyChanged();
+    }
+}
+
+HelperSession::HelperSession(HelperServer *server, QLocalSocket *socket, QObject *parent)
+    : QObject(parent)
+    , m_server(server)
+    , m_socket(socket)
+    , m_greeted(false)
+    , m_thread(new QThread(this))
+    , m_worker(new NetworkWorker)
+{
+    m_socket->setParent(this);
+
+    // The backend is created lazily on the session thread
+    m_worker->moveToThread(m_thread);
+    connect(m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+
+    connect(m_worker, &NetworkWorker::adaptersReady, this, &HelperSession::onAdaptersReady);
+    connect(m_worker, &NetworkWorker::adapterStateReady, this, &HelperSession::onAdapterStateReady);
+    connect(m_worker, &NetworkWorker::networkStateReady, this, &HelperSession::onNetworkStateReady);
+    connect(m_worker, &NetworkWorker::operationProgress, this, &HelperSession::onOperationProgress);
+    connect(m_worker, &NetworkWorker::operationFinished, this, &HelperSession::onOperationFinished);
+
+    connect(m_socket, &QLocalSocket::readyRead, this, &HelperSession::onReadyRead);
+    connect(m_socket, &QLocalSocket::disconnected, this, &HelperSession::closed);
+
+    m_thread->setObjectName("HelperSession");
+    m_thread->start();
+}
+
+HelperSession::~HelperSession()
+{
+    m_worker->cancelAll();
+    m_thread->quit();
+    m_thread->wait();
+}
+
+void HelperSession::notifyChanged()
+{
+    if (m_greeted) {
+        send(Changed, 0);
+    }
+}
+
+void HelperSession::onReadyRead()
+{
+    m_buffer.append(m_socket->readAll());
+
+    Message message;
+    for (;;) {
+        const DecodeStatus status = decode(m_buffer, &message);
+        if (status == NeedMoreData) {
+            break;
+        }
+        if (status == Malformed || !handleMessage(message)) {
+            qWarning() << "Helper: protocol error, dropping client";
+            m_socket->abort();
+            return;
+        }
+    }
+}
+
+bool HelperSession::handleMessage(const Message &message)
+{
+    Reader reader(message.payload);
+
+    if (!m_greeted) {
+        if (message.type != Hello) {
+            return false;
+        }
+        const quint16 version = reader.readU16();
+        if (!reader.ok() || version != Version) {
+            qWarning() << "Helper: unsupported protocol version" << version;
+            return false;
+        }
+
+        m_greeted = true;
+        Writer writer;
+        writer.writeU16(Version);
+        writer.writeU8((m_server->isPrivileged() ? Privileged : 0) |
+                       (m_server->isWatching() ? Watching : 0));
+        send(Welcome, message.requestId, writer.data());
+        return true;
+    }
+
+    // Each session has its own worker, so request ids are operation ids
+    const quint32 requestId = message.requestId;
+    const quint64 id = requestId;
+    NetworkWorker *worker = m_worker;
+
+    switch (message.type) {
+    case EnumerateAdapters:
+        if (!reader.ok()) {
+            return false;
+        }
+        m_pending.insert(requestId, message.type);
+        QMetaObject::invokeMethod(worker, [worker, id]() {
+            worker->fetchAdapters(id);
+        }, Qt::QueuedConnection);
+        return true;
+
+    case ReadState: {
+        const QString adapterName = reader.readString();
+        if (!reader.ok() || !isValidAdapterName(adapterName)) {
+            return false;
+        }
+        m_pending.insert(requestId, message.type);
+        QMetaObject::invokeMethod(worker, [worker, id, adapterName]() {
+            worker->fetchAdapterState(id, adapterName);
+        }, Qt::QueuedConnection);
+        return true;
+    }
+
+    case ReadAllStates:
+        if (!reader.ok()) {
+            return false;
+        }
+        m_pending.insert(requestId, message.type);
+        QMetaObject::invokeMethod(worker, [worker, id]() {
+            worker->fetchNetworkState(id);
+        }, Qt::QueuedConnection);
+        return true;
+
+    case SetStatic:
+    case SetDhcp: {
+        const QString adapterName = reader.readString();
+        IpConfig config;
+        if (message.type == SetStatic) {
+            config = reader.readConfig();
+            config.isDhcp = false;
+        } else {
+            config.isDhcp = true;
+        }
+        if (!reader.ok() || !isValidAdapterName(adapterName)) {
+            return false;
+        }
+        if (!isValidConfig(config)) {
+            sendResult(requestId, false, QString("错误：无效的IP配置。"));
+            return true;
+        }
+        m_pending.insert(requestId, message.type);
+        QMetaObject::invokeMethod(worker, [worker, id, adapterName, config]() {
+            worker->applyConfig(id, adapterName, config);
+        }, Qt::QueuedConnection);
+        return true;
+    }
+
+    case Restore: {
+        const QString adapterName = reader.readString();
+        AdapterState live = reader.readState();
+        AdapterState snapshot = reader.readState();
+        const bool withDns = reader.readU8() != 0;
+        if (!reader.ok() || !isValidAdapterName(adapterName)) {
+            return false;
+        }
+        if (!isValidState(live) || !isValidState(snapshot)) {
+            sendResult(requestId, false, QString("错误：无效的IP配置。"));
+            return true;
+        }
+        live.name = adapterName;
+        snapshot.name = adapterName;
+        const ConfigDelta delta = ConfigDelta::restore(live, snapshot, withDns);
+        if (delta.isEmpty()) {
+            sendResult(requestId, true, QString());
+            return true;
+        }
+        m_pending.insert(requestId, message.type);
+        QMetaObject::invokeMethod(worker, [worker, id, adapterName, delta]() {
+            worker->applyDelta(id, adapterName, delta);
+        }, Qt::QueuedConnection);
+        return true;
+    }
+
+    case CheckPrivileges: {
+        if (!reader.ok()) {
+            return false;
+        }
+        Writer writer;
+        writer.writeU8(m_server->isPrivileged() ? 1 : 0);
+        send(Privileges, requestId, writer.data());
+        return true;
+    }
+
+    case Cancel: {
+        if (!reader.ok()) {
+            return false;
+        }
+        auto it = m_pending.find(requestId);
+        if (it == m_pending.end()) {
+            return true;  // Already answered
+        }
+
+        m_worker->cancel(id);
+
+        // Changes always report how far they got; a cancelled query may
+        // never produce a result, so answer it here
+        if (it.value() != SetStatic && it.value() != SetDhcp && it.value() != Restore) {
+            m_pending.erase(it);
+            sendResult(requestId, false, QString("操作已取消。"));
+        }
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+void HelperSession::send(quint8 type, quint32 requestId, const QByteArray &payload)
+{
+    m_socket->write(encode(type, requestId, payload));
+}
+
+void HelperSession::sendResult(quint32 requestId, bool success, const QString &message)
+{
+    Writer writer;
+    writer.writeU8(success ? 1 : 0);
+    writer.writeString(message);
+    send(Result, requestId, writer.data());
+}
+
+void HelperSession::onAdaptersReady(quint64 operationId, const QVector<NetworkAdapter> &adapters)
+{
+    const quint32 requestId = quint32(operationId);
+    if (!m_pending.remove(requestId)) {
+        return;
+    }
+
+    Writer writer;
+    writer.writeAdapters(adapters);
+    send(Adapters, requestId, writer.data());
+}
+
+void HelperSession::onAdapterStateReady(quint64 operationId, const AdapterState &state)
+{
+    const quint32 requestId = quint32(operationId);
+    if (!m_pending.remove(requestId)) {
+        return;
+    }
+
+    Writer writer;
+    writer.writeState(state);
+    send(State, requestId, writer.data());
+}
+
+void HelperSession::onNetworkStateReady(quint64 operationId, const NetworkState &state)
+{
+    const quint32 requestId = quint32(operationId);
+    if (!m_pending.remove(requestId)) {
+        return;
+    }
+
+    Writer writer;
+    writer.writeStates(state.adapters);
+    send(States, requestId, writer.data());
+}
+
+void HelperSession::onOperationProgress(quint64 operationId, int step, int totalSteps, const QString &description)
+{
+    const quint32 requestId = quint32(operationId);
+    if (!m_pending.contains(requestId)) {
+        return;
+    }
+
+    Writer writer;
+    writer.writeU16(quint16(step));
+    writer.writeU16(quint16(totalSteps));
+    writer.writeString(description);
+    send(Progress, requestId, writer.data());
+}
+
+void HelperSession::onOperationFinished(quint64 operationId, bool success, const QString &message)
+{
+    const quint32 requestId = quint32(operationId);
+    if (!m_pending.remove(requestId)) {
+        return;
+    }
+
+    sendResult(requestId, success, message);
+}
@@ -0,0 +1,101 @@
+#ifndef HELPERSERVER_H
+#define HELPERSERVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include "HelperProtocol.h"
+#include "NetworkBackend.h"
+
+class QLocalServer;
+class QLocalSocket;
+class QThread;
+class QTimer;
+class NetworkWorker;
+class HelperSession;
+
+// The privileged side of HelperBackend, started as
+//     ChangeIPTool --helper <server name>
+// Every GUI connection gets its own session with a NetworkWorker and a
+// backend that stay warm for as long as it is connected, so operations on
+// different connections run in parallel. The helper exits when the last
+// connection closes (or when none shows up).
+//
+// Privileges are checked once at startup and answered from that result.
+// Nothing in here depends on actually being elevated, so on Linux the
+// helper runs fine as a normal process for testing.
+class HelperServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HelperServer(const QString &serverName, QObject *parent = nullptr);
+    ~HelperServer();
+
+    // Entry point for --helper; runs the event loop
+    static int run(const QString &serverName);
+
+    static QString defaultServerName();
+
+    bool isPrivileged() const { return m_privileged; }
+    bool isWatching() const { return m_watching; }
+
+private slots:
+    void onNewConnection();
+    void onSessionClosed();
+    void onAdaptersChanged();
+
+private:
+    QString m_serverName;
+    QLocalServer *m_server;
+    QList<HelperSession *> m_sessions;
+    QTimer *m_idleTimer;
+
+    // Answers privilege checks and watches for changes on behalf of all
+    // sessions
+    NetworkBackend *m_probe;
+    bool m_privileged;
+    bool m_watching;
+};
+
+// One connected GUI backend
+class HelperSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    HelperSession(HelperServer *server, QLocalSocket *socket, QObject *parent = nullptr);
+    ~HelperSession();
+
+    void notifyChanged();
+
+signals:
+    void closed();
+
+private slots:
+    void onReadyRead();
+    void onAdaptersReady(quint64 operationId, const QVector<NetworkAdapter> &adapters);
+    void onAdapterStateReady(quint64 operationId, const AdapterState &state);
+    void onNetworkStateReady(quint64 operationId, const NetworkState &state);
+    void onOperationProgress(quint64 operationId, int step, int totalSteps, const QString &description);
+    void onOperationFinished(quint64 operationId, bool success, const QString &message);
+
+private:
+    bool handleMessage(const HelperProtocol::Message &message);
+    void send(quint8 type, quint32 requestId, const QByteArray &payload = QByteArray());
+    void sendResult(quint32 requestId, bool success, const QString &message);
+
+    HelperServer *m_server;
+    QLocalSocket *m_socket;
+    QByteArray m_buffer;
+    bool m_greeted;
+    QHash<quint32, quint8> m_pending;   // Request id -> message type
+
+    QThread *m_thread;
+    NetworkWorker *m_worker;
+};
+
+#endif // HELPERSERVER_H
@@ -0,0 +1,21 @@
+#ifndef IPCONFIG_H
+#define IPCONFIG_H
+
+#include <QMetaType>
+#include <QString>
+
+struct IpConfig {
+    quint64 id = 0;       // Assigned by IpConfigManager, stable across saves; 0 if not stored
+    QString name;
+    QString ipAddress;
+    QString subnetMask;
+    QString gateway;
+    QString dns1;
+    QString dns2;
+    bool isDhcp = false;
+    QString adapterGuid;  // Associate config with specific adapter
+};
+
+Q_DECLARE_METATYPE(IpConfig)
+
+#endif // IPCONFIG_H
@@ -1,173 +1,1191 @@
 #include "IpConfigManager.h"
+#include "BinaryConfigStore.h"
+#include "ConfigWriter.h"
 #include <QJsonDocument>
+#include <QJsonParseError>
 #include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QDir>
+#include <QMap>
+#include <QMutexLocker>
 #include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
+#include <QMetaObject>
 #include <QDebug>
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+const int kSaveDelayMs = 250;           // Changes within this window share one write
+const int kMinCompactRecords = 1000;    // Journal length that may trigger a checkpoint
+const int kMergeDelayMs = 100;          // After the last change to the files
+const int kIdBlock = 64;                // Profile ids reserved at a time
+
+// A missing file reads as an empty array
+bool readJsonArray(const QString &filePath, QJsonArray *array, QString *error)
+{
+    QFile file(filePath);
+    if (!file.exists()) {
+        return true;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        *error = parseError.errorString();
+        return false;
+    }
+    if (!doc.isArray()) {
+        *error = QString("not a list of profiles");
+        return false;
+    }
+
+    *array = doc.array();
+    return true;
+}
+
+// Calls apply for each complete line of the journal and returns where the
+// last one ends. Stops before a damaged line.
+qsizetype readRecords(const QByteArray &data, const std::function<void(const QJsonObject &)> &apply,
+                      bool *damaged)
+{
+    qsizetype start = 0;
+    while (start < data.size()) {
+        const qsizetype end = data.indexOf('\n', start);
+        if (end < 0) {
+            break;      // Not finished writing, or never will be
+        }
+
+        const QByteArray line = data.mid(start, end - start).trimmed();
+        if (!line.isEmpty()) {
+            QJsonParseError error;
+            const QJsonObject record = QJsonDocument::fromJson(line, &error).object();
+            if (error.error != QJsonParseError::NoError) {
+                qWarning() << "Config journal is damaged at offset" << start << ":" << error.errorString();
+                *damaged = true;
+                return start;
+            }
+            apply(record);
+        }
+        start = end + 1;
+    }
+    return start;
+}
+
+// An add or update sets the whole profile, a removal only config->id.
+// False for records to skip.
+bool parseRecord(const QJsonObject &record, IpConfig *config, bool *remove)
+{
+    const QString op = record["op"].toString();
+    if (op == "add" || op == "update") {
+        *config = IpConfigManager::parseIpConfig(record["config"].toObject());
+        *remove = false;
+        return config->id != 0;
+    }
+    if (op == "remove") {
+        config->id = quint64(qMax(0.0, record["id"].toDouble()));
+        *remove = true;
+        return true;
+    }
+    if (op == "epoch") {
+        return false;   // The journal's header; see ConfigWriter
+    }
+
+    qWarning() << "Unknown config journal record" << op;
+    return false;
+}
+
+bool sameConfig(const IpConfig &a, const IpConfig &b)
+{
+    return a.id == b.id && a.name == b.name && a.ipAddress == b.ipAddress &&
+           a.subnetMask == b.subnetMask && a.gateway == b.gateway && a.dns1 == b.dns1 &&
+           a.dns2 == b.dns2 && a.isDhcp == b.isDhcp && a.adapterGuid == b.adapterGuid;
+}
+
+} // namespace
+
+// The store as it was when the batch began, and what the batch has done
+// since. The containers are implicitly shared, so the snapshot costs a
+// copy of each only once the batch changes it.
+struct IpConfigManager::BatchState {
+    ConfigTable configs;
+    QHash<quint64, int> positions;
+    QHash<QString, QVector<quint64>> adapterIndex;
+    QVector<int> lazy;
+    ConfigIndex index;
+    quint64 nextId = 1;
+    quint64 idLimit = 0;
+
+    QByteArray records;     // Journal records, written at the commit
+    int recordCount = 0;
+    int mutations = 0;
+};
 
 IpConfigManager::IpConfigManager(QObject *parent)
     : QObject(parent)
+    , m_format(JsonStore)
+    , m_nextId(1)
+    , m_idLimit(0)
+    , m_binary(nullptr)
+    , m_batch(nullptr)
+    , m_writerThread(new QThread(this))
+    , m_writer(new ConfigWriter)
+    , m_saveTimer(new QTimer(this))
+    , m_pendingRecordCount(0)
+    , m_journalRecords(0)
+    , m_generation(0)
+    , m_writesInFlight(0)
+    , m_watcher(new QFileSystemWatcher(this))
+    , m_mergeTimer(new QTimer(this))
 {
+    m_writer->moveToThread(m_writerThread);
+    connect(m_writerThread, &QThread::finished, m_writer, &QObject::deleteLater);
+    connect(m_writer, &ConfigWriter::written, this, &IpConfigManager::onConfigWritten);
+    connect(m_writer, &ConfigWriter::queuedWriteDone, this, [this]() {
+        --m_writesInFlight;
+        emit persistenceStatsChanged();
+    });
+    connect(m_writer, &ConfigWriter::checkpointConflict, this, [this]() {
+        m_mergeTimer->start();
+    });
+    if (qEnvironmentVariable("IPTOOL_STORE_FORMAT") == QLatin1String("binary")) {
+        m_format = BinaryStore;
+    }
+
+    m_writerThread->setObjectName("ConfigWriter");
+    m_writerThread->start();
+
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(kSaveDelayMs);
+    connect(m_saveTimer, &QTimer::timeout, this, &IpConfigManager::writeBehind);
+
+    m_mergeTimer->setSingleShot(true);
+    m_mergeTimer->setInterval(kMergeDelayMs);
+    connect(m_mergeTimer, &QTimer::timeout, this, &IpConfigManager::mergeExternalChanges);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &IpConfigManager::onStoreFileChanged);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &IpConfigManager::onStoreFileChanged);
+
     loadFromFile();
+    watchStoreFiles();
+}
+
+IpConfigManager::~IpConfigManager()
+{
+    // Whatever an open batch did is not written
+    delete m_batch;
+    m_batch = nullptr;
+    flush();
+    m_writerThread->quit();
+    m_writerThread->wait();
+    delete m_binary;
 }
 
 QVector<IpConfig> IpConfigManager::getConfigs() const
 {
-    return m_configs;
+    // Ids are handed out in increasing order
+    QVector<IpConfig> result;
+    result.reserve(m_configs.size());
+    for (int i = 0; i < m_configs.size(); ++i) {
+        result.append(configAt(i));
+    }
+    std::sort(result.begin(), result.end(), [](const IpConfig &a, const IpConfig &b) {
+        return a.id < b.id;
+    });
+    return result;
 }
 
 QVector<IpConfig> IpConfigManager::getConfigsForAdapter(const QString &adapterGuid) const
 {
+    const QVector<quint64> ids = m_adapterIndex.value(adapterGuid);
+
     QVector<IpConfig> result;
-    for (const IpConfig &config : m_configs) {
-        if (config.adapterGuid == adapterGuid) {
-            result.append(config);
-        }
+    result.reserve(ids.size());
+    for (quint64 id : ids) {
+        result.append(configAt(m_positions.value(id)));
     }
     return result;
 }
 
-void IpConfigManager::addConfig(const IpConfig &config)
+QVector<quint64> IpConfigManager::configIdsForAdapter(const QString &adapterGuid) const
 {
-    m_configs.append(config);
-    saveToFile();
-    emit configListChanged();
+    return m_adapterIndex.value(adapterGuid);
 }
 
-void IpConfigManager::removeConfig(int index)
+QVector<quint64> IpConfigManager::searchConfigs(const QString &text, const QString &adapterGuid) const
 {
-    if (index >= 0 && index < m_configs.size()) {
-        m_configs.removeAt(index);
-        saveToFile();
-        emit configListChanged();
+    const QString query = text.trimmed();
+    quint32 network = 0;
+    int prefixLength = 0;
+    quint32 address = 0;
+    QVector<quint64> ids;
+    if (ConfigIndex::parseSubnet(query, &network, &prefixLength)) {
+        ids = findInSubnet(network, prefixLength);
+    } else if (ConfigTable::parseAddress(query, &address)) {
+        ids = findContaining(address);
+    } else {
+        ids = findByNamePrefix(query);
     }
+
+    // The adapter is known without decoding the profile
+    if (!adapterGuid.isNull()) {
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [this, &adapterGuid](quint64 id) {
+            return m_configs.adapterGuid(m_positions.value(id)) != adapterGuid;
+        }), ids.end());
+    }
+    return ids;
 }
 
-void IpConfigManager::removeConfigForAdapter(const QString &adapterGuid, int index)
+QVector<quint64> IpConfigManager::findByNamePrefix(const QString &prefix) const
 {
-    QVector<IpConfig> adapterConfigs = getConfigsForAdapter(adapterGuid);
-    if (index >= 0 && index < adapterConfigs.size()) {
-        IpConfig configToRemove = adapterConfigs[index];
-        // Find and remove from main list
-        for (int i = 0; i < m_configs.size(); ++i) {
-            if (m_configs[i].name == configToRemove.name &&
-                m_configs[i].adapterGuid == configToRemove.adapterGuid &&
-                m_configs[i].ipAddress == configToRemove.ipAddress) {
-                m_configs.removeAt(i);
-                saveToFile();
-                emit configListChanged();
-                return;
+    return index().findByNamePrefix(prefix);
+}
+
+QVector<quint64> IpConfigManager::findInSubnet(quint32 network, int prefixLength) const
+{
+    return index().findInSubnet(network, prefixLength);
+}
+
+QVector<quint64> IpConfigManager::findContaining(quint32 address) const
+{
+    return index().findContaining(address);
+}
+
+QVector<ConfigConflict> IpConfigManager::conflictsFor(const IpConfig &config) const
+{
+    return index().conflicts(config);
+}
+
+bool IpConfigManager::hasConflicts(quint64 id) const
+{
+    return index().hasConflicts(id);
+}
+
+bool IpConfigManager::contains(quint64 id) const
+{
+    return m_positions.contains(id);
+}
+
+IpConfig IpConfigManager::getConfig(quint64 id) const
+{
+    const auto it = m_positions.constFind(id);
+    if (it == m_positions.constEnd()) {
+        return IpConfig();
+    }
+    return configAt(*it);
+}
+
+quint64 IpConfigManager::addConfig(const IpConfig &config)
+{
+    IpConfig stored = config;
+    stored.id = allocateIds(1);
+    insert(stored);
+    journal("add", stored);
+    noteChange(stored.id, Added, stored.adapterGuid);
+    publishChanges();
+    return stored.id;
+}
+
+QVector<quint64> IpConfigManager::addConfigs(const QVector<IpConfig> &configs)
+{
+    QVector<quint64> ids;
+    ids.reserve(configs.size());
+    quint64 id = configs.isEmpty() ? 0 : allocateIds(int(configs.size()));
+    for (const IpConfig &config : configs) {
+        IpConfig stored = config;
+        stored.id = id++;
+        insert(stored);
+
+        QJsonObject record;
+        record["op"] = QLatin1String("add");
+        record["config"] = serializeIpConfig(stored);
+        appendRecord(record);
+        noteChange(stored.id, Added, stored.adapterGuid);
+        ids.append(stored.id);
+    }
+
+    if (!ids.isEmpty()) {
+        // A large batch makes the journal long enough that this write is a
+        // checkpoint
+        scheduleWrite(int(ids.size()));
+        publishChanges();
+    }
+    return ids;
+}
+
+bool IpConfigManager::updateConfig(quint64 id, const IpConfig &config)
+{
+    const auto it = m_positions.constFind(id);
+    if (it == m_positions.constEnd()) {
+        return false;
+    }
+
+    IpConfig stored = configAt(*it);
+    stored.name = config.name;
+    stored.ipAddress = config.ipAddress;
+    stored.subnetMask = config.subnetMask;
+    stored.gateway = config.gateway;
+    stored.dns1 = config.dns1;
+    stored.dns2 = config.dns2;
+    stored.isDhcp = config.isDhcp;
+    // Keep the original adapterGuid
+    put(stored);
+    journal("update", stored);
+    noteChange(id, Updated, stored.adapterGuid);
+    publishChanges();
+    return true;
+}
+
+bool IpConfigManager::moveConfig(quint64 id, const QString &adapterGuid)
+{
+    const auto it = m_positions.constFind(id);
+    if (it == m_positions.constEnd()) {
+        return false;
+    }
+
+    IpConfig moved = configAt(*it);
+    if (moved.adapterGuid == adapterGuid) {
+        return true;
+    }
+
+    const QString from = moved.adapterGuid;
+    moved.adapterGuid = adapterGuid;
+    put(moved);
+    journal("update", moved);
+    noteChange(id, Updated, from);
+    noteChange(id, Updated, adapterGuid);
+    publishChanges();
+    return true;
+}
+
+bool IpConfigManager::removeConfig(quint64 id)
+{
+    const auto it = m_positions.constFind(id);
+    if (it == m_positions.constEnd()) {
+        return false;
+    }
+
+    const QString adapterGuid = m_configs.adapterGuid(*it);
+    erase(id);
+    journalRemove(id);
+    noteChange(id, Removed, adapterGuid);
+    publishChanges();
+    return true;
+}
+
+bool IpConfigManager::beginBatch()
+{
+    if (m_batch) {
+        return false;
+    }
+
+    m_batch = new BatchState;
+    m_batch->configs = m_configs;
+    m_batch->positions = m_positions;
+    m_batch->adapterIndex = m_adapterIndex;
+    m_batch->lazy = m_lazy;
+    m_batch->index = m_index;
+    m_batch->nextId = m_nextId;
+    m_batch->idLimit = m_idLimit;
+    return true;
+}
+
+void IpConfigManager::commitBatch()
+{
+    if (!m_batch) {
+        return;
+    }
+
+    BatchState *batch = m_batch;
+    m_batch = nullptr;
+
+    m_pendingRecords += batch->records;
+    m_pendingRecordCount += batch->recordCount;
+    // Also picks up earlier records whose write the batch held back
+    scheduleWrite(batch->mutations);
+    delete batch;
+
+    publishChanges();
+}
+
+void IpConfigManager::rollbackBatch()
+{
+    if (!m_batch) {
+        return;
+    }
+
+    // A binary checkpoint is not released while a batch is open, so the
+    // snapshot's undecoded entries are still valid
+    m_configs = m_batch->configs;
+    m_positions = m_batch->positions;
+    m_adapterIndex = m_batch->adapterIndex;
+    m_lazy = m_batch->lazy;
+    m_index = m_batch->index;
+    m_nextId = m_batch->nextId;
+    m_idLimit = m_batch->idLimit;
+    delete m_batch;
+    m_batch = nullptr;
+
+    m_changes.clear();
+    m_changedAdapters.clear();
+
+    // Earlier changes held back by the batch
+    if (m_pendingRecordCount > 0 && !m_saveTimer->isActive()) {
+        m_saveTimer->start();
+    }
+}
+
+void IpConfigManager::noteChange(quint64 id, ChangeKind kind, const QString &adapterGuid)
+{
+    m_changedAdapters.insert(adapterGuid);
+
+    const auto it = m_changes.find(id);
+    if (it == m_changes.end()) {
+        m_changes.insert(id, kind);
+    } else if (*it == Added) {
+        // Still new; or, removed again, never there at all
+        if (kind == Removed) {
+            m_changes.erase(it);
+        }
+    } else {
+        *it = kind;
+    }
+}
+
+void IpConfigManager::publishChanges()
+{
+    if (m_batch) {
+        return;     // At the commit
+    }
+
+    ConfigChangeSet changes;
+    for (auto it = m_changes.constBegin(); it != m_changes.constEnd(); ++it) {
+        switch (it.value()) {
+        case Added:
+            changes.added.append(it.key());
+            break;
+        case Updated:
+            changes.updated.append(it.key());
+            break;
+        case Removed:
+            changes.removed.append(it.key());
+            break;
+        }
+    }
+    std::sort(changes.added.begin(), changes.added.end());
+    std::sort(changes.updated.begin(), changes.updated.end());
+    std::sort(changes.removed.begin(), changes.removed.end());
+    changes.adapters = m_changedAdapters;
+
+    // A profile's conflicts change with other profiles, maybe on another
+    // adapter
+    if (m_index.isBuilt()) {
+        const QSet<quint64> conflictChanges = m_index.takeConflictChanges();
+        for (quint64 id : conflictChanges) {
+            const auto it = m_positions.constFind(id);
+            if (it != m_positions.constEnd()) {
+                changes.adapters.insert(m_configs.adapterGuid(*it));
             }
         }
     }
+
+    m_changes.clear();
+    m_changedAdapters.clear();
+    if (!changes.isEmpty()) {
+        emit configsChanged(changes);
+    }
 }
 
-void IpConfigManager::updateConfig(int index, const IpConfig &config)
+void IpConfigManager::clear()
 {
-    if (index >= 0 && index < m_configs.size()) {
-        m_configs[index] = config;
-        saveToFile();
-        emit configListChanged();
+    m_configs.clear();
+    m_positions.clear();
+    m_adapterIndex.clear();
+    m_nextId = 1;
+    m_idLimit = 0;
+    m_lazy.clear();
+    m_index.clear();
+    delete m_binary;
+    m_binary = nullptr;
+}
+
+// Other instances add profiles to the same store, so ids come from blocks
+// reserved in a counter they share rather than only from m_nextId
+quint64 IpConfigManager::allocateIds(int count)
+{
+    if (m_nextId + quint64(count) > m_idLimit) {
+        const int block = qMax(count, kIdBlock);
+        const quint64 first = ConfigWriter::reserveIds(getJournalFilePath(), m_nextId, block);
+        if (first != 0) {
+            m_nextId = first;
+            m_idLimit = first + quint64(block);
+        } else {
+            qWarning() << "Assigning profile ids that another instance may also use";
+        }
+    }
+
+    const quint64 first = m_nextId;
+    m_nextId += quint64(count);
+    return first;
+}
+
+void IpConfigManager::insert(const IpConfig &config)
+{
+    m_positions.insert(config.id, m_configs.size());
+    m_adapterIndex[config.adapterGuid].append(config.id);
+    m_configs.append(config);
+    if (m_binary) {
+        m_lazy.append(-1);
+    }
+    if (m_index.isBuilt()) {
+        m_index.add(config);
+    }
+    m_nextId = qMax(m_nextId, config.id + 1);
+}
+
+void IpConfigManager::put(const IpConfig &config)
+{
+    const auto it = m_positions.constFind(config.id);
+    if (it != m_positions.constEnd() && m_configs.adapterGuid(*it) == config.adapterGuid) {
+        m_configs.set(*it, config);
+        if (m_binary) {
+            m_lazy[*it] = -1;
+        }
+        if (m_index.isBuilt()) {
+            m_index.remove(config.id);
+            m_index.add(config);
+        }
+        return;
+    }
+
+    erase(config.id);
+    insert(config);
+}
+
+bool IpConfigManager::erase(quint64 id)
+{
+    const auto it = m_positions.find(id);
+    if (it == m_positions.end()) {
+        return false;
+    }
+
+    const int index = *it;
+    m_positions.erase(it);
+    if (m_index.isBuilt()) {
+        m_index.remove(id);
+    }
+
+    auto adapter = m_adapterIndex.find(m_configs.adapterGuid(index));
+    if (adapter != m_adapterIndex.end()) {
+        adapter->removeOne(id);
+        if (adapter->isEmpty()) {
+            m_adapterIndex.erase(adapter);
+        }
+    }
+
+    // Fill the gap with the last profile instead of shifting the rest
+    const int last = m_configs.size() - 1;
+    m_configs.removeAt(index);
+    if (index != last) {
+        m_positions[m_configs.id(index)] = index;
+        if (m_binary) {
+            m_lazy[index] = m_lazy[last];
+        }
+    }
+    if (m_binary) {
+        m_lazy.removeLast();
     }
+    return true;
 }
 
-void IpConfigManager::updateConfigForAdapter(const QString &adapterGuid, int index, const IpConfig &config)
+IpConfig IpConfigManager::configAt(int position) const
 {
-    QVector<IpConfig> adapterConfigs = getConfigsForAdapter(adapterGuid);
-    if (index >= 0 && index < adapterConfigs.size()) {
-        IpConfig oldConfig = adapterConfigs[index];
-        // Find and update in main list
+    if (m_binary && m_lazy[position] >= 0) {
+        return m_binary->decode(m_lazy[position]);
+    }
+    return m_configs.at(position);
+}
+
+const ConfigIndex &IpConfigManager::index() const
+{
+    if (!m_index.isBuilt()) {
         for (int i = 0; i < m_configs.size(); ++i) {
-            if (m_configs[i].adapterGuid == oldConfig.adapterGuid &&
-                m_configs[i].name == oldConfig.name &&
-                m_configs[i].ipAddress == oldConfig.ipAddress) {
-                m_configs[i].name = config.name;
-                m_configs[i].ipAddress = config.ipAddress;
-                m_configs[i].subnetMask = config.subnetMask;
-                m_configs[i].gateway = config.gateway;
-                m_configs[i].dns1 = config.dns1;
-                m_configs[i].dns2 = config.dns2;
-                m_configs[i].isDhcp = config.isDhcp;
-                // Keep the original adapterGuid
-                saveToFile();
-                emit configListChanged();
-                return;
-            }
+            m_index.add(configAt(i));
         }
+        m_index.setBuilt();
+        // Nothing has changed for whoever shows conflicts next
+        m_index.takeConflictChanges();
     }
+    return m_index;
 }
 
-IpConfig IpConfigManager::getConfig(int index) const
+void IpConfigManager::materialize()
 {
-    if (index >= 0 && index < m_configs.size()) {
-        return m_configs[index];
+    if (!m_binary) {
+        return;
     }
-    return IpConfig();
+
+    for (int i = 0; i < m_configs.size(); ++i) {
+        if (m_lazy[i] >= 0) {
+            m_configs.set(i, m_binary->decode(m_lazy[i]));
+        }
+    }
+    m_lazy.clear();
+    delete m_binary;
+    m_binary = nullptr;
 }
 
 void IpConfigManager::loadFromFile()
 {
-    QString filePath = getConfigFilePath();
-    QFile file(filePath);
+    if (m_batch) {
+        qWarning() << "Reloading the config store discards an open batch";
+        rollbackBatch();
+    }
 
-    if (!file.exists()) {
-        qWarning() << "Config file does not exist:" << filePath;
+    // Pending records must reach the journal before it is read back
+    flush();
+
+    // No write of this process's can come in between
+    QMutexLocker locker(m_writer->fileMutex());
+
+    const StoreFormat otherFormat = m_format == BinaryStore ? JsonStore : BinaryStore;
+    QString filePath = getConfigFilePath(m_format);
+    StoreFormat fileFormat = m_format;
+    bool convert = false;
+    if (!QFile::exists(filePath) && QFile::exists(getConfigFilePath(otherFormat))) {
+        filePath = getConfigFilePath(otherFormat);
+        fileFormat = otherFormat;
+        convert = true;
+    }
+
+    bool assigned = false;
+    if (fileFormat == BinaryStore && QFile::exists(filePath)) {
+        if (!loadBinary(filePath, &assigned)) {
+            return;
+        }
+    } else {
+        if (!QFile::exists(filePath)) {
+            qWarning() << "Config file does not exist:" << filePath;
+        }
+
+        QJsonArray array;
+        QString error;
+        if (!readJsonArray(filePath, &array, &error)) {
+            qWarning() << "Failed to load config file:" << filePath << error;
+            return;
+        }
+
+        clear();
+
+        // Files from before ids existed, or with duplicates from hand editing,
+        // get fresh ids after the highest one in use
+        QVector<IpConfig> configs;
+        configs.reserve(array.size());
+        for (const QJsonValue &value : array) {
+            if (value.isObject()) {
+                configs.append(parseIpConfig(value.toObject()));
+                m_nextId = qMax(m_nextId, configs.last().id + 1);
+            }
+        }
+
+        for (IpConfig &config : configs) {
+            if (config.id == 0 || m_positions.contains(config.id)) {
+                config.id = allocateIds(1);
+                assigned = true;
+            }
+            insert(config);
+        }
+    }
+
+    QFile journal(getJournalFilePath());
+    const QByteArray records = journal.open(QIODevice::ReadOnly) ? journal.readAll() : QByteArray();
+    bool torn = false;
+    m_journalRecords = replayJournal(records, &torn);
+
+    // What is on disk from here on, and not written by this process, is
+    // someone else's; see mergeExternalChanges()
+    m_writer->setKnownCheckpoint(StoreFileState::stat(getConfigFilePath()));
+    m_writer->setJournalEnd(records.size());
+    m_writer->setJournalEpoch(ConfigWriter::parseEpoch(records));
+    locker.unlock();
+
+    qDebug() << "Loaded" << m_configs.size() << "IP configurations," << m_journalRecords
+             << "from the journal";
+
+    // A checkpoint also starts a fresh journal, so nothing gets appended
+    // after a torn record
+    if (assigned || torn || convert) {
+        // Once converted, the old file would only be a stale second copy
+        if (saveToFile() && convert) {
+            QFile::remove(filePath);
+        }
+    }
+}
+
+bool IpConfigManager::loadBinary(const QString &filePath, bool *assigned)
+{
+    BinaryConfigStore *store = new BinaryConfigStore;
+    QString error;
+    if (!store->open(filePath, &error)) {
+        qWarning() << "Failed to load config file:" << filePath << error;
+        delete store;
+        return false;
+    }
+
+    clear();
+    m_binary = store;
+
+    const int count = store->count();
+    m_configs.reserve(count);
+    m_lazy.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        m_nextId = qMax(m_nextId, store->id(i) + 1);
+    }
+
+    // Only the id and the adapter are read now; see configAt()
+    for (int i = 0; i < count; ++i) {
+        IpConfig config;
+        config.id = store->id(i);
+        if (config.id == 0 || m_positions.contains(config.id)) {
+            config = store->decode(i);
+            config.id = allocateIds(1);
+            insert(config);
+            *assigned = true;
+            continue;
+        }
+        config.adapterGuid = store->adapterGuid(i);
+        insert(config);
+        m_lazy.last() = i;
+    }
+    return true;
+}
+
+int IpConfigManager::replayJournal(const QByteArray &data, bool *torn)
+{
+    // Replaying by id is idempotent, so records that already made it into
+    // the checkpoint do no harm
+    int replayed = 0;
+    bool damaged = false;
+    const qsizetype end = readRecords(data, [this, &replayed](const QJsonObject &record) {
+        applyRecord(record, false);
+        ++replayed;
+    }, &damaged);
+
+    // Anything after the last complete record is a write that did not finish
+    *torn = damaged || end < data.size();
+    return replayed;
+}
+
+void IpConfigManager::applyRecord(const QJsonObject &record, bool merge)
+{
+    IpConfig config;
+    bool remove = false;
+    if (!parseRecord(record, &config, &remove)) {
         return;
     }
 
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Failed to open config file:" << filePath;
+    if (merge) {
+        if (remove) {
+            mergeRemoval(config.id);
+        } else {
+            mergeConfig(config);
+        }
+    } else if (remove) {
+        erase(config.id);
+    } else {
+        put(config);
+    }
+}
+
+// Like put() and erase(), but only what actually changes is noted
+void IpConfigManager::mergeConfig(const IpConfig &config)
+{
+    const auto it = m_positions.constFind(config.id);
+    if (it == m_positions.constEnd()) {
+        insert(config);
+        noteChange(config.id, Added, config.adapterGuid);
         return;
     }
 
-    QByteArray data = file.readAll();
-    file.close();
+    const IpConfig current = configAt(*it);
+    if (sameConfig(current, config)) {
+        return;     // Typically a record of this process's own
+    }
+    put(config);
+    noteChange(config.id, Updated, current.adapterGuid);
+    noteChange(config.id, Updated, config.adapterGuid);
+}
+
+void IpConfigManager::mergeRemoval(quint64 id)
+{
+    const auto it = m_positions.constFind(id);
+    if (it == m_positions.constEnd()) {
+        return;
+    }
 
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+    const QString adapterGuid = m_configs.adapterGuid(*it);
+    erase(id);
+    noteChange(id, Removed, adapterGuid);
+}
 
-    if (error.error != QJsonParseError::NoError) {
-        qWarning() << "Failed to parse config file:" << error.errorString();
+void IpConfigManager::mergeExternalChanges()
+{
+    // Merged between batches, not into one
+    if (m_batch) {
+        m_mergeTimer->start();
+        return;
+    }
+    if (!storeChangedOnDisk()) {
         return;
     }
 
-    m_configs.clear();
-    QJsonArray array = doc.array();
+    // Everything merged so far predates a rewrite noticed now
+    QMutexLocker locker(m_writer->fileMutex());
+    const qint64 mergedEnd = m_writer->journalEnd();
+    const QString mergedEpoch = m_writer->journalEpoch();
+    locker.unlock();
 
-    for (const QJsonValue &value : array) {
-        if (value.isObject()) {
-            m_configs.append(parseIpConfig(value.toObject()));
+    // With this process's own records on disk as well, replaying the files
+    // in order gives the latest version of every profile
+    flush();
+
+    locker.relock();
+    const QString path = getConfigFilePath();
+    StoreFileState checkpoint = StoreFileState::stat(path);
+    const StoreFileState known = m_writer->knownCheckpoint();
+    bool rewritten = false;
+    if (!checkpoint.sameStat(known)) {
+        if (checkpoint.size < 0) {
+            // Merging that would remove every profile; the next checkpoint
+            // writes the file again
+            qWarning() << "Config file was removed by another process:" << path;
+        } else {
+            // Only touched, or copied back as it was
+            checkpoint.hash = StoreFileState::hashFile(path);
+            rewritten = checkpoint.hash.isEmpty() || checkpoint.hash != known.hash;
         }
     }
 
-    qDebug() << "Loaded" << m_configs.size() << "IP configurations";
+    const QString journalPath = getJournalFilePath();
+    const qint64 journalSize = QFileInfo(journalPath).size();
+    const QString epoch = ConfigWriter::readEpoch(journalPath);
+    qint64 journalEnd = m_writer->journalEnd();
+    bool assigned = false;
+    // The epoch, not the size, tells a journal that started over: it may
+    // already have grown back past where this process had read
+    const bool startedOver = epoch != mergedEpoch || journalSize < mergedEnd;
+    if (rewritten || startedOver || journalSize < journalEnd) {
+        // A journal that started over goes with a compacted checkpoint and
+        // is replayed whole. A checkpoint rewritten next to an untouched
+        // journal (a script replacing the file) already supersedes the
+        // records merged before it; only those written since go on top.
+        const qint64 from = startedOver ? 0 : mergedEnd;
+        if (!mergeCheckpoint(from, &journalEnd, &assigned)) {
+            journalEnd = journalSize;
+        }
+    } else if (journalSize > journalEnd) {
+        // Only the records appended since
+        QFile journal(journalPath);
+        if (journal.open(QIODevice::ReadOnly) && journal.seek(journalEnd)) {
+            const QByteArray tail = journal.readAll();
+            bool damaged = false;
+            const qsizetype end = readRecords(tail, [this](const QJsonObject &record) {
+                applyRecord(record, true);
+            }, &damaged);
+            // A partial record is still being written and is read next
+            // time; a damaged one never gets better
+            journalEnd += damaged ? tail.size() : end;
+        }
+    }
+
+    m_writer->setKnownCheckpoint(checkpoint);
+    m_writer->setJournalEnd(journalEnd);
+    m_writer->setJournalEpoch(epoch);
+    locker.unlock();
+
+    if (!m_changes.isEmpty()) {
+        qDebug() << "Merged" << m_changes.size() << "profiles changed by another process";
+    }
+    publishChanges();
+
+    // Give profiles that came without ids the ones they got here
+    if (assigned) {
+        saveToFile();
+    }
 }
 
-void IpConfigManager::saveToFile()
+// Compares the checkpoint plus the journal from journalFrom on with the
+// profiles in memory, and merges the difference. Needs the writer's file
+// mutex held.
+bool IpConfigManager::mergeCheckpoint(qint64 journalFrom, qint64 *journalEnd, bool *assigned)
 {
-    QString filePath = getConfigFilePath();
-    QJsonArray array;
+    const QString path = getConfigFilePath();
+    QVector<IpConfig> loaded;
+    QString error;
+    if (m_format == BinaryStore) {
+        BinaryConfigStore store;
+        if (!store.open(path, &error)) {
+            qWarning() << "Failed to merge config file:" << path << error;
+            return false;
+        }
+        loaded.reserve(store.count());
+        for (int i = 0; i < store.count(); ++i) {
+            loaded.append(store.decode(i));
+        }
+    } else {
+        QJsonArray array;
+        if (!readJsonArray(path, &array, &error)) {
+            qWarning() << "Failed to merge config file:" << path << error;
+            return false;
+        }
+        loaded.reserve(array.size());
+        for (const QJsonValue &value : array) {
+            if (value.isObject()) {
+                loaded.append(parseIpConfig(value.toObject()));
+            }
+        }
+    }
 
-    for (const IpConfig &config : m_configs) {
-        array.append(serializeIpConfig(config));
+    // Ordered by id, so new profiles are added in the order they were
+    // created; missing or duplicate ids are replaced as loadFromFile() does
+    QMap<quint64, IpConfig> disk;
+    for (const IpConfig &config : std::as_const(loaded)) {
+        m_nextId = qMax(m_nextId, config.id + 1);
+    }
+    for (IpConfig &config : loaded) {
+        if (config.id == 0 || disk.contains(config.id)) {
+            config.id = allocateIds(1);
+            *assigned = true;
+        }
+        disk.insert(config.id, config);
     }
 
-    QJsonDocument doc(array);
-    QByteArray data = doc.toJson(QJsonDocument::Indented);
+    QFile journal(getJournalFilePath());
+    QByteArray records;
+    if (journal.open(QIODevice::ReadOnly) && journal.seek(journalFrom)) {
+        records = journal.readAll();
+    }
+    bool damaged = false;
+    const qsizetype end = readRecords(records, [&disk](const QJsonObject &record) {
+        IpConfig config;
+        bool remove = false;
+        if (!parseRecord(record, &config, &remove)) {
+            return;
+        }
+        if (remove) {
+            disk.remove(config.id);
+        } else {
+            disk.insert(config.id, config);
+        }
+    }, &damaged);
+    *journalEnd = journalFrom + (damaged ? records.size() : end);
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly)) {
-        qWarning() << "Failed to save config file:" << filePath;
+    QVector<quint64> removed;
+    for (int i = 0; i < m_configs.size(); ++i) {
+        if (!disk.contains(m_configs.id(i))) {
+            removed.append(m_configs.id(i));
+        }
+    }
+    for (quint64 id : std::as_const(removed)) {
+        mergeRemoval(id);
+    }
+    for (const IpConfig &config : std::as_const(disk)) {
+        mergeConfig(config);
+    }
+    return true;
+}
+
+// Two stats; the common case when the files changed because this
+// process wrote them
+bool IpConfigManager::storeChangedOnDisk() const
+{
+    QMutexLocker locker(m_writer->fileMutex());
+    return !StoreFileState::stat(getConfigFilePath()).sameStat(m_writer->knownCheckpoint()) ||
+           QFileInfo(getJournalFilePath()).size() != m_writer->journalEnd();
+}
+
+void IpConfigManager::watchStoreFiles()
+{
+    // The directory's watch sees the files being created and replaced
+    const QString filePath = getConfigFilePath();
+    const QStringList paths = { QFileInfo(filePath).absolutePath(), filePath, getJournalFilePath() };
+    const QStringList watched = m_watcher->files() + m_watcher->directories();
+    for (const QString &path : paths) {
+        if (!watched.contains(path) && QFileInfo::exists(path)) {
+            m_watcher->addPath(path);
+        }
+    }
+}
+
+void IpConfigManager::onStoreFileChanged()
+{
+    // A checkpoint renames a new file over the old one, which ends the
+    // watch on it
+    watchStoreFiles();
+    m_mergeTimer->start();
+}
+
+bool IpConfigManager::saveToFile()
+{
+    commitBatch();
+
+    // The checkpoint is refused if another process writes after the merge;
+    // merge once more then
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        mergeExternalChanges();
+        m_saveTimer->stop();
+        materialize();
+        if (m_writer->writeCheckpoint(++m_generation, m_format, getConfigFilePath(), getJournalFilePath(),
+                                      m_configs)) {
+            m_pendingRecords.clear();
+            m_pendingRecordCount = 0;
+            m_journalRecords = 0;
+            return true;
+        }
+    }
+
+    // The pending records still go to the journal
+    if (m_pendingRecordCount > 0) {
+        m_saveTimer->start();
+    }
+    return false;
+}
+
+ConfigStoreStats IpConfigManager::persistenceStats() const
+{
+    ConfigStoreStats stats = m_stats;
+    stats.pendingWrites = m_writesInFlight + (m_pendingRecordCount > 0 ? 1 : 0);
+    stats.journalRecords = m_journalRecords + m_pendingRecordCount;
+    return stats;
+}
+
+void IpConfigManager::journal(const char *op, const IpConfig &config)
+{
+    QJsonObject record;
+    record["op"] = QLatin1String(op);
+    record["config"] = serializeIpConfig(config);
+    appendRecord(record);
+    scheduleWrite(1);
+}
+
+void IpConfigManager::journalRemove(quint64 id)
+{
+    QJsonObject record;
+    record["op"] = QLatin1String("remove");
+    record["id"] = double(id);
+    appendRecord(record);
+    scheduleWrite(1);
+}
+
+void IpConfigManager::appendRecord(const QJsonObject &record)
+{
+    QByteArray &records = m_batch ? m_batch->records : m_pendingRecords;
+    records += QJsonDocument(record).toJson(QJsonDocument::Compact);
+    records += '\n';
+    ++(m_batch ? m_batch->recordCount : m_pendingRecordCount);
+}
+
+void IpConfigManager::scheduleWrite(int mutations)
+{
+    if (m_batch) {
+        m_batch->mutations += mutations;
         return;
     }
 
-    file.write(data);
-    file.close();
+    m_stats.mutations += mutations;
+    if (!m_saveTimer->isActive()) {
+        m_saveTimer->start();
+    }
+    emit persistenceStatsChanged();
+}
+
+void IpConfigManager::writeBehind()
+{
+    // A checkpoint now could contain uncommitted changes; the commit
+    // schedules this again
+    if (m_pendingRecordCount == 0 || m_batch) {
+        return;
+    }
+
+    const quint64 generation = ++m_generation;
+    const QString path = getConfigFilePath();
+    const QString journalPath = getJournalFilePath();
+    const QByteArray records = m_pendingRecords;
+    m_journalRecords += m_pendingRecordCount;
+    m_pendingRecords.clear();
+    m_pendingRecordCount = 0;
+
+    // Compact once replaying the journal would take about as long as
+    // reading half the store
+    const StoreFormat format = m_format;
+    const bool compact = m_journalRecords >= qMax(kMinCompactRecords, int(m_configs.size() / 2));
+    ConfigTable configs;
+    if (compact) {
+        // Shared until the next change, so handing it over is cheap; the
+        // writer thread turns it back into text
+        materialize();
+        configs = m_configs;
+        m_journalRecords = 0;
+    }
+
+    ++m_writesInFlight;
+    ConfigWriter *writer = m_writer;
+    QMetaObject::invokeMethod(writer, [writer, generation, format, path, journalPath, records, configs,
+                                       compact]() {
+        // A checkpoint that was not written leaves the records to the journal
+        if (!compact || !writer->writeCheckpoint(generation, format, path, journalPath, configs)) {
+            writer->appendJournal(generation, journalPath, records);
+        }
+        emit writer->queuedWriteDone();
+    }, Qt::QueuedConnection);
+    emit persistenceStatsChanged();
+}
+
+void IpConfigManager::flush()
+{
+    // Queued writes run in order, so an empty call behind them waits for all
+    if (m_writesInFlight > 0) {
+        QMetaObject::invokeMethod(m_writer, []() {}, Qt::BlockingQueuedConnection);
+    }
+
+    if (m_pendingRecordCount > 0) {
+        m_saveTimer->stop();
+        m_journalRecords += m_pendingRecordCount;
+        m_writer->appendJournal(++m_generation, getJournalFilePath(), m_pendingRecords);
+        m_pendingRecords.clear();
+        m_pendingRecordCount = 0;
+    }
+}
 
-    qDebug() << "Saved" << m_configs.size() << "IP configurations";
+void IpConfigManager::onConfigWritten(quint64 generation, bool checkpoint, bool ok, qint64 micros, qint64 bytes)
+{
+    Q_UNUSED(generation);
+
+    // Also reached directly from saveToFile() and flush()
+    ++m_stats.writes;
+    if (checkpoint && ok) {
+        ++m_stats.checkpoints;
+    }
+    if (!ok) {
+        ++m_stats.failedWrites;
+    }
+    m_stats.lastFlushMs = micros / 1000.0;
+    m_stats.lastFlushBytes = bytes;
+    emit persistenceStatsChanged();
 }
 
 QString IpConfigManager::getConfigFilePath() const
+{
+    return getConfigFilePath(m_format);
+}
+
+QString IpConfigManager::getConfigFilePath(StoreFormat format) const
 {
     QString appDataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     QDir dir(appDataPath);
@@ -176,12 +1194,19 @@ QString IpConfigManager::getConfigFilePath() const
         dir.mkpath(".");
     }
 
-    return appDataPath + "/ip_configs.json";
+    return appDataPath + (format == BinaryStore ? "/ip_configs.bin" : "/ip_configs.json");
 }
 
-IpConfig IpConfigManager::parseIpConfig(const QJsonObject &obj) const
+QString IpConfigManager::getJournalFilePath() const
+{
+    // The same for both formats, so converting the checkpoint keeps it
+    return getConfigFilePath(JsonStore) + ".journal";
+}
+
+IpConfig IpConfigManager::parseIpConfig(const QJsonObject &obj)
 {
     IpConfig config;
+    config.id = quint64(qMax(0.0, obj["id"].toDouble()));
     config.name = obj["name"].toString();
     config.ipAddress = obj["ipAddress"].toString();
     config.subnetMask = obj["subnetMask"].toString();
@@ -193,9 +1218,10 @@ IpConfig IpConfigManager::parseIpConfig(const QJsonObject &obj) const
     return config;
 }
 
-QJsonObject IpConfigManager::serializeIpConfig(const IpConfig &config) const
+QJsonObject IpConfigManager::serializeIpConfig(const IpConfig &config)
 {
     QJsonObject obj;
+    obj["id"] = double(config.id);
     obj["name"] = config.name;
     obj["ipAddress"] = config.ipAddress;
     obj["subnetMask"] = config.subnetMask;
@@ -206,3 +1232,12 @@ QJsonObject IpConfigManager::serializeIpConfig(const IpConfig &config) const
     obj["adapterGuid"] = config.adapterGuid;
     return obj;
 }
+
+QByteArray IpConfigManager::toJson(const QVector<IpConfig> &configs)
+{
+    QJsonArray array;
+    for (const IpConfig &config : configs) {
+        array.append(serializeIpConfig(config));
+    }
+    return QJsonDocument(array).toJson(QJsonDocument::Indented);
+}
@@ -2,51 +2,280 @@
 #define IPCONFIGMANAGER_H
 
 #include <QObject>
+#include <QHash>
+#include <QSet>
 #include <QString>
+#include <QVector>
 #include <QJsonArray>
 #include <QJsonObject>
+#include "IpConfig.h"
+#include "ConfigIndex.h"
+#include "ConfigTable.h"
 
-struct IpConfig {
-    QString name;
-    QString ipAddress;
-    QString subnetMask;
-    QString gateway;
-    QString dns1;
-    QString dns2;
-    bool isDhcp;
-    QString adapterGuid;  // Associate config with specific adapter
+struct ConfigStoreStats {
+    int pendingWrites = 0;      // Changed but not yet on disk, or being written
+    quint64 mutations = 0;
+    quint64 writes = 0;         // Fewer than mutations when bursts were coalesced
+    quint64 failedWrites = 0;
+    quint64 checkpoints = 0;    // Writes of the whole store
+    int journalRecords = 0;     // Since the last checkpoint
+    double lastFlushMs = 0;     // On the writer thread
+    qint64 lastFlushBytes = 0;
 };
 
-Q_DECLARE_METATYPE(IpConfig)
+// What one mutation, or one committed batch, did to the store. A profile
+// added and removed again within a batch is not listed.
+struct ConfigChangeSet {
+    QVector<quint64> added;
+    QVector<quint64> updated;
+    QVector<quint64> removed;
+    QSet<QString> adapters;     // Whose profile lists changed, including a move's source,
+                                // or whose profiles' conflicts did
 
+    bool isEmpty() const { return added.isEmpty() && updated.isEmpty() && removed.isEmpty(); }
+};
+
+class QFileSystemWatcher;
+class QThread;
+class QTimer;
+class ConfigWriter;
+class BinaryConfigStore;
+
+// Owns the saved profiles. Every profile has an id that never changes, and
+// lookups, updates and removals go by id in O(1).
+// Profiles are kept densely and packed in a ConfigTable (removal swaps
+// the last one in), with an id -> position hash and, per adapter GUID,
+// the ids of its profiles in the order they were added.
+//
+// Each change is saved as one record appended to a journal next to
+// ip_configs.json; loading replays the journal on top of the file. Saving
+// is write-behind: the records of a burst of changes are appended in one
+// write on a background thread (see ConfigWriter). Once the journal has
+// grown to a fair share of the store, that write is a compaction instead:
+// a new checkpoint of the whole store, after which the journal starts
+// over. saveToFile() checkpoints synchronously; the destructor waits for
+// pending records, so nothing is lost on shutdown.
+//
+// The checkpoint is JSON (ip_configs.json) unless IPTOOL_STORE_FORMAT is
+// "binary", which selects ip_configs.bin (see BinaryConfigStore). A binary
+// checkpoint is read into memory on load and profiles are decoded when
+// they are first read, so startup does not build the strings of profiles
+// that are never shown. If only the other format's file exists, it is
+// loaded and converted.
+//
+// Mutations between beginBatch() and commitBatch() are one change: their
+// journal records are written together and configsChanged() is emitted
+// once, at the commit. rollbackBatch() restores the store as it was at
+// beginBatch() from a copy-on-write snapshot. ConfigBatch wraps this for
+// a scope.
+//
+// Searches and conflict checks go through a ConfigIndex, built on the
+// first use (building it decodes every profile, which startup avoids) and
+// kept up to date by every change after that.
+//
+// Several processes may share the store. The manager watches its files,
+// and when another process writes them (a stat, then a hash, tells its
+// own writes from theirs) merges the difference by id and reports it
+// through configsChanged() like any other change. Journal records it has
+// not seen yet are replayed on top, so a profile ends up as the last
+// record written for it says, whichever process wrote it; this process's
+// pending records are written first and count as written then.
+//
+// A rewritten checkpoint is compared with memory profile by profile. If
+// the journal started over too (another instance compacted, so its epoch
+// header changed; see ConfigWriter), the whole journal is replayed on it,
+// as a restart would. If the journal was left alone (a script replaced
+// the file), the new file wins over every record merged before it was
+// noticed, including deletions it undoes and profiles it drops; only
+// records written since are replayed on top.
+// Nothing is merged while a batch is open. A checkpoint is never written
+// over changes that have not been merged (see ConfigWriter).
 class IpConfigManager : public QObject
 {
     Q_OBJECT
 
 public:
+    enum StoreFormat {
+        JsonStore,
+        BinaryStore
+    };
+
     explicit IpConfigManager(QObject *parent = nullptr);
+    ~IpConfigManager();
 
+    // In the order they were added
     QVector<IpConfig> getConfigs() const;
     QVector<IpConfig> getConfigsForAdapter(const QString &adapterGuid) const;
-    void addConfig(const IpConfig &config);
-    void removeConfig(int index);
-    void removeConfigForAdapter(const QString &adapterGuid, int index);
-    void updateConfig(int index, const IpConfig &config);
-    void updateConfigForAdapter(const QString &adapterGuid, int index, const IpConfig &config);
-    IpConfig getConfig(int index) const;
+    QVector<quint64> configIdsForAdapter(const QString &adapterGuid) const;
+
+    // Ids of the profiles matching text, as typed into a search box:
+    // - "10.20.0.0/16" (or "/255.255.0.0"): whose IP address is inside, by address;
+    // - "10.20.3.4": whose subnet contains that address, most specific first;
+    // - anything else: whose name starts with it, ignoring case, by name.
+    // With adapterGuid, only that adapter's.
+    QVector<quint64> searchConfigs(const QString &text, const QString &adapterGuid = QString()) const;
+    QVector<quint64> findByNamePrefix(const QString &prefix) const;
+    QVector<quint64> findInSubnet(quint32 network, int prefixLength) const;
+    QVector<quint64> findContaining(quint32 address) const;
+
+    // What is wrong with config among the stored profiles, whether it is
+    // stored or only being edited; its own stored version does not count
+    QVector<ConfigConflict> conflictsFor(const IpConfig &config) const;
+    bool hasConflicts(quint64 id) const;
+
+    bool contains(quint64 id) const;
+    // A default IpConfig (id 0) if there is no such profile
+    IpConfig getConfig(quint64 id) const;
 
+    // Returns the new profile's id; config.id is ignored
+    quint64 addConfig(const IpConfig &config);
+    // Adds all of them as one change: one configsChanged() and one
+    // coalesced write. Returns the new ids in order.
+    QVector<quint64> addConfigs(const QVector<IpConfig> &configs);
+    // Keeps the id and adapterGuid of the stored profile
+    bool updateConfig(quint64 id, const IpConfig &config);
+    // Assigns the profile to another adapter; it is listed there last
+    bool moveConfig(quint64 id, const QString &adapterGuid);
+    bool removeConfig(quint64 id);
+
+    // False if a batch is already open; the caller's mutations then join it
+    bool beginBatch();
+    void commitBatch();
+    void rollbackBatch();
+    bool inBatch() const { return m_batch != nullptr; }
+
+    // Rolls back an open batch first
     void loadFromFile();
-    void saveToFile();
+    // Writes a checkpoint now, on this thread, including any pending change;
+    // commits an open batch first
+    bool saveToFile();
+    // Done on its own shortly after the files change
+    void mergeExternalChanges();
+
+    StoreFormat storeFormat() const { return m_format; }
+
+    ConfigStoreStats persistenceStats() const;
+
+    static IpConfig parseIpConfig(const QJsonObject &obj);
+    static QJsonObject serializeIpConfig(const IpConfig &config);
+    static QByteArray toJson(const QVector<IpConfig> &configs);
 
 signals:
-    void configListChanged();
+    void configsChanged(const ConfigChangeSet &changes);
+    void persistenceStatsChanged();
+
+private slots:
+    void onConfigWritten(quint64 generation, bool checkpoint, bool ok, qint64 micros, qint64 bytes);
+    void onStoreFileChanged();
 
 private:
     QString getConfigFilePath() const;
-    IpConfig parseIpConfig(const QJsonObject &obj) const;
-    QJsonObject serializeIpConfig(const IpConfig &config) const;
+    QString getConfigFilePath(StoreFormat format) const;
+    QString getJournalFilePath() const;
+    void journal(const char *op, const IpConfig &config);
+    void journalRemove(quint64 id);
+    void appendRecord(const QJsonObject &record);
+    void scheduleWrite(int mutations);
+    void writeBehind();
+    void flush();
+    int replayJournal(const QByteArray &data, bool *torn);
+    void applyRecord(const QJsonObject &record, bool merge);
+    void mergeConfig(const IpConfig &config);
+    void mergeRemoval(quint64 id);
+    bool mergeCheckpoint(qint64 journalFrom, qint64 *journalEnd, bool *assigned);
+    bool storeChangedOnDisk() const;
+    void watchStoreFiles();
+    void clear();
+    quint64 allocateIds(int count);
+    void insert(const IpConfig &config);
+    void put(const IpConfig &config);
+    bool erase(quint64 id);
+    bool loadBinary(const QString &filePath, bool *assigned);
+
+    enum ChangeKind {
+        Added,
+        Updated,
+        Removed
+    };
+    void noteChange(quint64 id, ChangeKind kind, const QString &adapterGuid);
+    void publishChanges();
+    IpConfig configAt(int position) const;
+    void materialize();
+    const ConfigIndex &index() const;
+
+    StoreFormat m_format;
+    ConfigTable m_configs;                              // Unordered; see m_adapterIndex
+    QHash<quint64, int> m_positions;                    // Id -> index in m_configs
+    QHash<QString, QVector<quint64>> m_adapterIndex;    // Adapter GUID -> ids, oldest first
+    quint64 m_nextId;
+    quint64 m_idLimit;                                  // End of the ids reserved for this process
+
+    // While profiles loaded from a binary checkpoint are undecoded, their
+    // m_configs entry holds only id and adapterGuid, and m_lazy (parallel
+    // to m_configs) their record in m_binary; -1 once decoded or replaced
+    BinaryConfigStore *m_binary;
+    QVector<int> m_lazy;
+
+    mutable ConfigIndex m_index;            // Built by index() on demand
+
+    struct BatchState;
+    BatchState *m_batch;                    // Open batch, or null
+    QHash<quint64, ChangeKind> m_changes;   // Not yet published
+    QSet<QString> m_changedAdapters;
+
+    QThread *m_writerThread;
+    ConfigWriter *m_writer;
+    QTimer *m_saveTimer;        // Coalescing window
+    QByteArray m_pendingRecords;
+    int m_pendingRecordCount;
+    int m_journalRecords;       // Written or queued since the last checkpoint
+    quint64 m_generation;       // Of the last write handed to m_writer
+    int m_writesInFlight;
+    ConfigStoreStats m_stats;
+
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_mergeTimer;       // Lets a burst of file changes settle
+};
+
+// Opens a batch for the current scope and rolls it back unless commit()
+// was called:
+//
+//     ConfigBatch batch(manager);
+//     for (quint64 id : ids) {
+//         manager->removeConfig(id);
+//     }
+//     batch.commit();
+//
+// Inside an already open batch it does nothing; the outer one decides.
+class ConfigBatch
+{
+public:
+    explicit ConfigBatch(IpConfigManager *manager)
+        : m_manager(manager)
+        , m_open(manager->beginBatch())
+    {
+    }
+
+    ~ConfigBatch()
+    {
+        if (m_open) {
+            m_manager->rollbackBatch();
+        }
+    }
+
+    void commit()
+    {
+        if (m_open) {
+            m_open = false;
+            m_manager->commitBatch();
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(ConfigBatch)
 
-    QVector<IpConfig> m_configs;
+    IpConfigManager *m_manager;
+    bool m_open;
 };
 
 #endif // IPCONFIGMANAGER_H
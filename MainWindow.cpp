@@ -11,47 +11,86 @@
 #include <QDialog>
 #include <QDialogButtonBox>
 #include <QCheckBox>
-#include <QTimer>
 #include <QTableWidget>
 #include <QTableWidgetItem>
 #include <QHeaderView>
+#include <QFileDialog>
+#include <QFile>
+#include <QFileInfo>
+#include <QProgressDialog>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QAbstractButton>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QColor>
+#include <QStyle>
+#include "CommandDeadlines.h"
+#include "CommandMetrics.h"
+#include "ConfigTransfer.h"
+
+namespace {
+
+// How long a new profile may go unconfirmed before it is reverted
+const int kConfirmTimeoutSec = 30;
+
+} // namespace
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_adapterCombo(nullptr)
+    , m_searchEdit(nullptr)
     , m_configTableWidget(nullptr)
     , m_ipConfigManager(new IpConfigManager(this))
     , m_networkManager(new NetworkAdapterManager(this))
+    , m_adaptersRequestId(0)
+    , m_stateRequestId(0)
+    , m_applyOperationId(0)
+    , m_adminKnown(false)
+    , m_isAdmin(false)
+    , m_autoRevert(true)
 {
     setupUi();
     createMenuBar();
 
-    // Check for administrator privileges
-    if (!NetworkAdapterManager::isAdmin()) {
-        m_statusLabel->setText("警告：未以管理员身份运行。修改IP需要管理员权限。");
-        m_statusLabel->setStyleSheet("QLabel { color: orange; font-weight: bold; }");
-    }
-
-    // Show loading message
-    m_statusLabel->setText("正在加载网卡列表...");
-    m_statusLabel->setStyleSheet("QLabel { color: blue; }");
-
-    // Load adapters asynchronously to prevent UI freezing
-    QTimer::singleShot(100, this, &MainWindow::loadAdapters);
-
     // Connect signals
-    connect(m_ipConfigManager, &IpConfigManager::configListChanged,
-            this, &MainWindow::onConfigListChanged);
+    connect(m_ipConfigManager, &IpConfigManager::configsChanged,
+            this, &MainWindow::onConfigsChanged);
+    connect(m_networkManager, &NetworkAdapterManager::adaptersReady,
+            this, &MainWindow::onAdaptersReady);
+    connect(m_networkManager, &NetworkAdapterManager::networkStateReady,
+            this, &MainWindow::onNetworkStateReady);
+    connect(m_networkManager, &NetworkAdapterManager::adapterAdded,
+            this, &MainWindow::onAdapterAdded);
+    connect(m_networkManager, &NetworkAdapterManager::adapterRemoved,
+            this, &MainWindow::onAdapterRemoved);
+    connect(m_networkManager, &NetworkAdapterManager::adapterUpdated,
+            this, &MainWindow::onAdapterUpdated);
+    connect(m_networkManager, &NetworkAdapterManager::adapterStateChanged,
+            this, &MainWindow::onAdapterStateChanged);
+    connect(m_networkManager, &NetworkAdapterManager::adminStatusReady,
+            this, &MainWindow::onAdminStatusReady);
+    connect(m_networkManager, &NetworkAdapterManager::operationProgress,
+            this, &MainWindow::onOperationProgress);
     connect(m_networkManager, &NetworkAdapterManager::operationFinished,
-            this, [this](bool success, const QString &message) {
-        m_statusLabel->setText(message);
-        if (success) {
-            m_statusLabel->setStyleSheet("QLabel { color: green; }");
-            onRefreshAdapters();
-        } else {
-            m_statusLabel->setStyleSheet("QLabel { color: red; font-weight: bold; }");
-        }
-    });
+            this, &MainWindow::onOperationFinished);
+    connect(m_networkManager, &NetworkAdapterManager::operationSuperseded,
+            this, &MainWindow::onOperationSuperseded);
+    connect(m_networkManager, &NetworkAdapterManager::confirmationRequired,
+            this, &MainWindow::onConfirmationRequired);
+    connect(m_networkManager, &NetworkAdapterManager::applyConfirmed,
+            this, &MainWindow::onApplyConfirmed);
+    connect(m_networkManager, &NetworkAdapterManager::revertStarted,
+            this, &MainWindow::onRevertStarted);
+    connect(m_networkManager, &NetworkAdapterManager::revertFinished,
+            this, &MainWindow::onRevertFinished);
+    connect(CommandDeadlines::instance(), &CommandDeadlines::deadlineExceeded,
+            this, &MainWindow::onDeadlineExceeded);
+
+    // Both requests run on the network worker thread, so the window is
+    // responsive while PowerShell answers
+    m_networkManager->requestAdminStatus();
+    loadAdapters();
 }
 
 MainWindow::~MainWindow()
@@ -84,12 +123,17 @@ void MainWindow::setupUi()
     QGroupBox *configGroup = new QGroupBox(QString("IP配置列表"), this);
     QVBoxLayout *configLayout = new QVBoxLayout(configGroup);
 
+    m_searchEdit = new QLineEdit(this);
+    m_searchEdit->setPlaceholderText(QString("搜索配置名称、IP地址或网段（如 10.20.0.0/16）"));
+    m_searchEdit->setClearButtonEnabled(true);
+    connect(m_searchEdit, &QLineEdit::textChanged, this, &MainWindow::onSearchTextChanged);
+
     m_configTableWidget = new QTableWidget(this);
     m_configTableWidget->setMinimumHeight(250);
     m_configTableWidget->setColumnCount(4);
     m_configTableWidget->setHorizontalHeaderLabels(QStringList() << "配置名称" << "IP地址" << "子网掩码" << "默认网关");
     m_configTableWidget->setSelectionBehavior(QAbstractItemView::SelectRows);
-    m_configTableWidget->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_configTableWidget->setSelectionMode(QAbstractItemView::ExtendedSelection);
     m_configTableWidget->horizontalHeader()->setStretchLastSection(true);
     m_configTableWidget->verticalHeader()->setVisible(false);
     connect(m_configTableWidget, &QTableWidget::itemSelectionChanged,
@@ -104,6 +148,10 @@ void MainWindow::setupUi()
     m_addButton = new QPushButton(QString("添加"), this);
     connect(m_addButton, &QPushButton::clicked, this, &MainWindow::onAddConfig);
 
+    m_captureButton = new QPushButton(QString("保存当前设置"), this);
+    m_captureButton->setToolTip(QString("以网卡当前的IP设置创建新配置"));
+    connect(m_captureButton, &QPushButton::clicked, this, &MainWindow::onCaptureConfig);
+
     m_editButton = new QPushButton(QString("编辑"), this);
     m_editButton->setEnabled(false);
     connect(m_editButton, &QPushButton::clicked, this, &MainWindow::onEditConfig);
@@ -112,11 +160,24 @@ void MainWindow::setupUi()
     m_deleteButton->setEnabled(false);
     connect(m_deleteButton, &QPushButton::clicked, this, &MainWindow::onDeleteConfig);
 
+    m_moveButton = new QPushButton(QString("移动到..."), this);
+    m_moveButton->setToolTip(QString("把选中的配置移到另一个网卡"));
+    m_moveButton->setEnabled(false);
+    connect(m_moveButton, &QPushButton::clicked, this, &MainWindow::onMoveConfigs);
+
+    m_cancelButton = new QPushButton(QString("取消操作"), this);
+    m_cancelButton->setEnabled(false);
+    connect(m_cancelButton, &QPushButton::clicked, this, &MainWindow::onCancelOperation);
+
     buttonLayout->addWidget(m_applyButton);
     buttonLayout->addWidget(m_addButton);
+    buttonLayout->addWidget(m_captureButton);
     buttonLayout->addWidget(m_editButton);
     buttonLayout->addWidget(m_deleteButton);
+    buttonLayout->addWidget(m_moveButton);
+    buttonLayout->addWidget(m_cancelButton);
 
+    configLayout->addWidget(m_searchEdit);
     configLayout->addWidget(m_configTableWidget);
     configLayout->addLayout(buttonLayout);
 
@@ -151,11 +212,22 @@ void MainWindow::createMenuBar()
 
     QMenu *fileMenu = menuBar->addMenu(tr("&File"));
 
+    QAction *importAction = fileMenu->addAction(tr("&Import Profiles..."));
+    connect(importAction, &QAction::triggered, this, &MainWindow::onImportConfigs);
+
+    QAction *exportAction = fileMenu->addAction(tr("&Export Profiles..."));
+    connect(exportAction, &QAction::triggered, this, &MainWindow::onExportConfigs);
+
+    fileMenu->addSeparator();
+
     QAction *exitAction = fileMenu->addAction(tr("E&xit"));
     connect(exitAction, &QAction::triggered, this, &QMainWindow::close);
 
     QMenu *helpMenu = menuBar->addMenu(tr("&Help"));
 
+    QAction *diagnosticsAction = helpMenu->addAction(tr("&Diagnostics..."));
+    connect(diagnosticsAction, &QAction::triggered, this, &MainWindow::onShowDiagnostics);
+
     QAction *aboutAction = helpMenu->addAction(tr("&About"));
     connect(aboutAction, &QAction::triggered, [this]() {
         QMessageBox::about(this, tr("About IP Address Changer"),
@@ -172,35 +244,27 @@ void MainWindow::createMenuBar()
 
 void MainWindow::loadAdapters()
 {
-    m_adapters = m_networkManager->getAdapters();
-    m_adapterCombo->clear();
-
-    int maxWidth = 300; // Minimum width
+    // Show loading message
+    m_statusLabel->setText("正在加载网卡列表...");
+    m_statusLabel->setStyleSheet("QLabel { color: blue; }");
 
-    for (const NetworkAdapter &adapter : m_adapters) {
-        QString displayText = adapter.name;
-        if (!adapter.description.isEmpty() && adapter.description != adapter.name) {
-            displayText += QString(" (%1)").arg(adapter.description);
-        }
-        m_adapterCombo->addItem(displayText, adapter.name);
+    m_adaptersRequestId = m_networkManager->requestAdapters();
+}
 
-        // Calculate width needed for this text
-        QFontMetrics fm(m_adapterCombo->font());
-        int textWidth = fm.width(displayText) + 50; // Add extra space for padding and dropdown arrow
-        if (textWidth > maxWidth) {
-            maxWidth = textWidth;
-        }
+void MainWindow::onAdaptersReady(quint64 operationId, const QVector<NetworkAdapter> &adapters)
+{
+    // The combo box itself is maintained from the adapterAdded/Removed/Updated
+    // signals; only the status line belongs to this request
+    if (operationId != m_adaptersRequestId) {
+        return;
     }
 
-    // Set the combobox width based on content
-    m_adapterCombo->setMinimumWidth(maxWidth);
-
-    if (m_adapters.isEmpty()) {
+    if (adapters.isEmpty()) {
         m_statusLabel->setText(QString("未找到网络适配器"));
         m_statusLabel->setStyleSheet("QLabel { color: orange; }");
     } else {
         // Restore ready message after loading
-        if (!NetworkAdapterManager::isAdmin()) {
+        if (m_adminKnown && !m_isAdmin) {
             m_statusLabel->setText("警告：未以管理员身份运行。修改IP需要管理员权限。");
             m_statusLabel->setStyleSheet("QLabel { color: orange; font-weight: bold; }");
         } else {
@@ -208,45 +272,89 @@ void MainWindow::loadAdapters()
             m_statusLabel->setStyleSheet("QLabel { color: green; }");
         }
     }
+}
+
+static QString adapterDisplayText(const NetworkAdapter &adapter)
+{
+    QString displayText = adapter.name;
+    if (!adapter.description.isEmpty() && adapter.description != adapter.name) {
+        displayText += QString(" (%1)").arg(adapter.description);
+    }
+    return displayText;
+}
+
+void MainWindow::onAdapterAdded(const NetworkAdapter &adapter)
+{
+    // Adding the first item selects it, which triggers onAdapterChanged()
+    m_adapterCombo->addItem(adapterDisplayText(adapter), adapter.guid);
+    updateAdapterComboWidth();
+}
+
+void MainWindow::onAdapterRemoved(const NetworkAdapter &adapter)
+{
+    // Removing the current item moves the selection, which triggers
+    // onAdapterChanged(); any other removal keeps the selection
+    const int index = m_adapterCombo->findData(adapter.guid);
+    if (index >= 0) {
+        m_adapterCombo->removeItem(index);
+        updateAdapterComboWidth();
+    }
+}
+
+void MainWindow::onAdapterUpdated(const NetworkAdapter &adapter)
+{
+    const int index = m_adapterCombo->findData(adapter.guid);
+    if (index < 0) {
+        return;
+    }
+
+    m_adapterCombo->setItemText(index, adapterDisplayText(adapter));
+    updateAdapterComboWidth();
+
+    if (index == m_adapterCombo->currentIndex()) {
+        onAdapterChanged(index);
+    }
+}
+
+void MainWindow::updateAdapterComboWidth()
+{
+    int maxWidth = 300; // Minimum width
+
+    QFontMetrics fm(m_adapterCombo->font());
+    for (int i = 0; i < m_adapterCombo->count(); ++i) {
+        int textWidth = fm.horizontalAdvance(m_adapterCombo->itemText(i)) + 50; // Add extra space for padding and dropdown arrow
+        if (textWidth > maxWidth) {
+            maxWidth = textWidth;
+        }
+    }
 
-    onAdapterChanged(m_adapterCombo->currentIndex());
+    // Set the combobox width based on content
+    m_adapterCombo->setMinimumWidth(maxWidth);
 }
 
 void MainWindow::onAdapterChanged(int index)
 {
     Q_UNUSED(index);
-    QString adapterName = getCurrentAdapterName();
+    QString currentAdapterGuid = getCurrentAdapterGuid();
 
-    if (!adapterName.isEmpty()) {
-        // Find the adapter details first
-        QString currentAdapterGuid;
-        for (const NetworkAdapter &adapter : m_adapters) {
-            if (adapter.name == adapterName) {
-                QString infoText = QString("适配器: %1").arg(adapter.description);
-                if (!adapter.guid.isEmpty()) {
-                    infoText += QString("\nGUID: %1").arg(adapter.guid);
-                }
-                m_adapterInfoLabel->setText(infoText);
-                currentAdapterGuid = adapter.guid;
-                break;
-            }
-        }
+    if (!currentAdapterGuid.isEmpty()) {
+        const NetworkAdapter adapter = m_networkManager->adapterByGuid(currentAdapterGuid);
+        showAdapterInfo(adapter);
 
         // Refresh config list for this adapter
         refreshConfigList(currentAdapterGuid);
 
-        // Show loading message first
-        m_currentIpLabel->setText(QString("Current IP: Loading..."));
-
-        // Use QTimer to delay IP retrieval, preventing UI freezing
-        QTimer::singleShot(100, this, [this, adapterName]() {
-            QString currentIp = m_networkManager->getCurrentIpAddress(adapterName);
-            if (!currentIp.isEmpty()) {
-                m_currentIpLabel->setText(QString("Current IP: %1").arg(currentIp));
-            } else {
-                m_currentIpLabel->setText(QString("Current IP: Not configured or DHCP"));
+        // The snapshot covers every adapter and is kept current by the
+        // manager, so switching adapters normally costs no query at all
+        const AdapterState cached = m_networkManager->cachedState(adapter.name);
+        if (!cached.name.isEmpty()) {
+            showAdapterState(cached);
+        } else {
+            m_currentIpLabel->setText(QString("Current IP: Loading..."));
+            if (m_stateRequestId == 0) {
+                m_stateRequestId = m_networkManager->requestNetworkState();
             }
-        });
+        }
     } else {
         m_currentIpLabel->setText(QString("Current IP: No adapter selected"));
         m_adapterInfoLabel->setText(QString("Adapter Info: Not selected"));
@@ -254,12 +362,74 @@ void MainWindow::onAdapterChanged(int index)
     }
 }
 
+void MainWindow::showAdapterInfo(const NetworkAdapter &adapter)
+{
+    QString infoText = QString("适配器: %1").arg(adapter.description);
+    if (!adapter.guid.isEmpty()) {
+        infoText += QString("\nGUID: %1").arg(adapter.guid);
+    }
+    m_adapterInfoLabel->setText(infoText);
+}
+
+void MainWindow::onNetworkStateReady(quint64 operationId, const NetworkState &state)
+{
+    if (operationId != m_stateRequestId) {
+        return;
+    }
+    m_stateRequestId = 0;
+
+    // Changed adapters were already shown through adapterStateChanged();
+    // this only resolves "Loading..." for an adapter the snapshot lacks
+    QString adapterName = getCurrentAdapterName();
+    if (!adapterName.isEmpty() && !state.find(adapterName)) {
+        m_currentIpLabel->setText(QString("Current IP: Not available"));
+    }
+}
+
+void MainWindow::onAdapterStateChanged(const AdapterState &state)
+{
+    if (state.name == getCurrentAdapterName()) {
+        showAdapterState(state);
+    }
+}
+
+void MainWindow::showAdapterState(const AdapterState &state)
+{
+    QStringList addresses;
+    for (const InterfaceAddress &address : state.addresses) {
+        addresses << address.address;
+    }
+
+    if (!addresses.isEmpty()) {
+        m_currentIpLabel->setText(QString("Current IP: %1").arg(addresses.join(", ")));
+    } else {
+        m_currentIpLabel->setText(QString("Current IP: Not configured or DHCP"));
+    }
+}
+
+void MainWindow::onAdminStatusReady(quint64 operationId, bool isAdmin)
+{
+    Q_UNUSED(operationId);
+    m_adminKnown = true;
+    m_isAdmin = isAdmin;
+
+    // Check for administrator privileges
+    if (!isAdmin) {
+        m_statusLabel->setText("警告：未以管理员身份运行。修改IP需要管理员权限。");
+        m_statusLabel->setStyleSheet("QLabel { color: orange; font-weight: bold; }");
+    }
+}
+
 void MainWindow::onConfigSelected()
 {
-    bool hasSelection = m_configTableWidget->selectedItems().count() > 0;
-    m_applyButton->setEnabled(hasSelection);
-    m_editButton->setEnabled(hasSelection);
-    m_deleteButton->setEnabled(hasSelection);
+    const int selected = selectedConfigIds().size();
+    // Applying again while a change is pending is fine: the scheduler
+    // replaces a request that has not started yet, and a change awaiting
+    // confirmation keeps its watchdog until the new one has its own
+    m_applyButton->setEnabled(selected == 1);
+    m_editButton->setEnabled(selected == 1);
+    m_deleteButton->setEnabled(selected > 0);
+    m_moveButton->setEnabled(selected > 0 && m_adapterCombo->count() > 1);
 }
 
 void MainWindow::onApplyConfig()
@@ -270,8 +440,9 @@ void MainWindow::onApplyConfig()
         return;
     }
 
-    // Check for administrator privileges before applying
-    if (!NetworkAdapterManager::isAdmin()) {
+    // Check for administrator privileges before applying; the worker checks
+    // again if the answer has not arrived yet
+    if (m_adminKnown && !m_isAdmin) {
         QMessageBox::warning(this, QString("权限不足"),
             QString("修改IP地址需要管理员权限。\n\n"
                "请按以下步骤操作：\n"
@@ -282,18 +453,9 @@ void MainWindow::onApplyConfig()
         return;
     }
 
-    int currentRow = m_configTableWidget->currentRow();
-    if (currentRow < 0) {
-        return;
-    }
-
-    // Get the config for current adapter and row
-    QString currentAdapterGuid = getCurrentAdapterGuid();
-    QVector<IpConfig> adapterConfigs = m_ipConfigManager->getConfigsForAdapter(currentAdapterGuid);
-
-    if (currentRow >= 0 && currentRow < adapterConfigs.size()) {
-        IpConfig config = adapterConfigs[currentRow];
-        applyConfig(config);
+    const quint64 configId = currentConfigId();
+    if (m_ipConfigManager->contains(configId)) {
+        applyConfig(m_ipConfigManager->getConfig(configId));
     }
 }
 
@@ -316,45 +478,228 @@ void MainWindow::applyConfig(const IpConfig &config)
                              config.gateway, config.dns1);
     }
 
-    reply = QMessageBox::question(this, QString("确认IP修改"),
-                                 question,
-                                 QMessageBox::Yes | QMessageBox::No);
+    // Dry run against the cached state; only these steps will be executed
+    const ConfigDelta delta = m_networkManager->planApply(adapterName, config);
+    if (m_networkManager->cachedState(adapterName).name.isEmpty()) {
+        question += QString("\n\n尚未获取到网卡的当前设置，将应用全部设置。");
+    } else if (delta.isEmpty()) {
+        question += QString("\n\n当前设置与该配置一致，无需修改。");
+    } else {
+        question += QString("\n\n将执行的修改：\n%1").arg(delta.describe().join('\n'));
+    }
+
+    QMessageBox box(QMessageBox::Question, QString("确认IP修改"), question,
+                    QMessageBox::Yes | QMessageBox::No, this);
+    QCheckBox *revertCheckBox = new QCheckBox(
+        QString("应用后等待确认，%1 秒内未确认则自动还原").arg(kConfirmTimeoutSec), &box);
+    revertCheckBox->setChecked(m_autoRevert);
+    box.setCheckBox(revertCheckBox);
+    reply = QMessageBox::StandardButton(box.exec());
 
     if (reply == QMessageBox::Yes) {
-        bool success;
+        m_autoRevert = revertCheckBox->isChecked();
+        m_applyOperationId = m_networkManager->applyConfig(adapterName, config,
+                                                           m_autoRevert ? kConfirmTimeoutSec : 0);
+        m_applyOperations.insert(m_applyOperationId);
+        m_cancelButton->setEnabled(true);
+        m_statusLabel->setText(QString("正在应用IP配置..."));
+        m_statusLabel->setStyleSheet("QLabel { color: blue; }");
+    }
+}
 
-        if (config.isDhcp) {
-            success = m_networkManager->setDhcp(adapterName);
-        } else {
-            success = m_networkManager->setIpAddress(
-                adapterName,
-                config.ipAddress,
-                config.subnetMask,
-                config.gateway,
-                config.dns1,
-                config.dns2
-            );
-        }
-
-        if (success) {
-            QMessageBox::information(this, QString("成功"),
-                                   QString("IP配置已成功应用！\n\n"
-                                      "注意：更改可能需要几秒钟才能生效。"));
+void MainWindow::onCancelOperation()
+{
+    if (m_applyOperations.isEmpty()) {
+        return;
+    }
+
+    const QSet<quint64> operations = m_applyOperations;
+    for (quint64 operationId : operations) {
+        m_networkManager->cancel(operationId);
+    }
+    m_cancelButton->setEnabled(false);
+    m_statusLabel->setText(QString("正在取消..."));
+}
+
+void MainWindow::onOperationProgress(quint64 operationId, int step, int totalSteps, const QString &description)
+{
+    if (operationId != m_applyOperationId) {
+        return;
+    }
+
+    m_statusLabel->setText(QString("正在应用IP配置 (%1/%2)：%3").arg(step).arg(totalSteps).arg(description));
+    m_statusLabel->setStyleSheet("QLabel { color: blue; }");
+}
+
+void MainWindow::onOperationFinished(quint64 operationId, bool success, const QString &message)
+{
+    if (!m_applyOperations.remove(operationId)) {
+        return;
+    }
+
+    m_cancelButton->setEnabled(!m_applyOperations.isEmpty());
+
+    // Earlier applies (e.g. on another adapter) only update the status line
+    if (operationId != m_applyOperationId) {
+        m_statusLabel->setText(message);
+        m_statusLabel->setStyleSheet(success ? "QLabel { color: green; }"
+                                             : "QLabel { color: red; font-weight: bold; }");
+        return;
+    }
+
+    m_applyOperationId = 0;
+
+    m_statusLabel->setText(message);
+    if (success && m_confirmBoxes.contains(operationId)) {
+        // The confirmation prompt takes the place of the success message
+        m_statusLabel->setStyleSheet("QLabel { color: green; }");
+    } else if (success) {
+        m_statusLabel->setStyleSheet("QLabel { color: green; }");
+        QMessageBox::information(this, QString("成功"),
+                               QString("IP配置已成功应用！\n\n"
+                                  "注意：更改可能需要几秒钟才能生效。"));
+    } else {
+        m_statusLabel->setStyleSheet("QLabel { color: red; font-weight: bold; }");
+        QMessageBox::critical(this, QString("失败"),
+                            QString("应用IP配置失败。\n\n"
+                               "错误信息显示在状态栏中。\n\n"
+                               "请确保您以管理员身份运行此程序。"));
+    }
+}
+
+void MainWindow::onOperationSuperseded(quint64 operationId, quint64 replacedBy)
+{
+    Q_UNUSED(replacedBy);
+
+    // Never started; the newer request for the same adapter takes over
+    m_applyOperations.remove(operationId);
+}
+
+void MainWindow::onConfirmationRequired(quint64 operationId, const QString &adapterName, int timeoutSec)
+{
+    // Asked again when an apply that replaced it was dropped
+    closeConfirmBox(operationId);
+
+    // Not modal: the prompt must not keep the watchdog's events waiting
+    QMessageBox *box = new QMessageBox(QMessageBox::Question, QString("确认新设置"), QString(),
+                                       QMessageBox::NoButton, this);
+    box->setAttribute(Qt::WA_DeleteOnClose);
+    QPushButton *keepButton = box->addButton(QString("保留设置"), QMessageBox::AcceptRole);
+    box->addButton(QString("立即还原"), QMessageBox::RejectRole);
+    box->setDefaultButton(keepButton);
+
+    QElapsedTimer shown;
+    shown.start();
+    auto updateText = [box, adapterName, timeoutSec, shown]() {
+        const qint64 remaining = qMax<qint64>(0, timeoutSec - shown.elapsed() / 1000);
+        box->setText(QString("新设置已应用到网卡 '%1'。\n\n"
+                             "如果网络连接正常，请点击\"保留设置\"。\n"
+                             "%2 秒内未确认（且无法连通网关）将自动还原为之前的设置。")
+                         .arg(adapterName).arg(remaining));
+    };
+    updateText();
+
+    QTimer *countdown = new QTimer(box);
+    connect(countdown, &QTimer::timeout, box, updateText);
+    countdown->start(1000);
+
+    connect(box, &QMessageBox::buttonClicked, this, [this, operationId, keepButton](QAbstractButton *button) {
+        if (!m_confirmBoxes.remove(operationId)) {
+            return;
+        }
+        if (button == keepButton) {
+            m_networkManager->confirmApply(operationId);
         } else {
-            QMessageBox::critical(this, QString("失败"),
-                                QString("应用IP配置失败。\n\n"
-                                   "错误信息显示在状态栏中。\n\n"
-                                   "请确保您以管理员身份运行此程序。"));
+            m_networkManager->revertApply(operationId);
         }
+    });
+    connect(box, &QObject::destroyed, this, [this, operationId]() {
+        m_confirmBoxes.remove(operationId);
+    });
+
+    m_confirmBoxes.insert(operationId, box);
+    box->open();
+}
+
+void MainWindow::closeConfirmBox(quint64 operationId)
+{
+    QMessageBox *box = m_confirmBoxes.take(operationId);
+    if (box) {
+        box->close();
     }
 }
 
+void MainWindow::onApplyConfirmed(quint64 operationId, bool reachable, qint64 elapsedMs)
+{
+    closeConfirmBox(operationId);
+
+    m_statusLabel->setText(reachable
+        ? QString("新设置已生效：%1 毫秒后网关可达，已自动确认。").arg(elapsedMs)
+        : QString("新设置已确认保留。"));
+    m_statusLabel->setStyleSheet("QLabel { color: green; }");
+}
+
+void MainWindow::onRevertStarted(quint64 operationId, const QString &reason)
+{
+    closeConfirmBox(operationId);
+
+    m_statusLabel->setText(QString("%1，正在还原之前的设置...").arg(reason));
+    m_statusLabel->setStyleSheet("QLabel { color: #d97706; font-weight: bold; }");
+}
+
+void MainWindow::onRevertFinished(quint64 operationId, bool success, const QString &message,
+                                  qint64 revertMs, qint64 outageMs)
+{
+    closeConfirmBox(operationId);
+
+    if (success) {
+        m_statusLabel->setText(QString("已还原之前的设置：还原用时 %1 毫秒，从应用到还原完成共中断 %2 毫秒。")
+                                   .arg(revertMs).arg(outageMs));
+        m_statusLabel->setStyleSheet("QLabel { color: #d97706; font-weight: bold; }");
+    } else {
+        m_statusLabel->setText(QString("还原之前的设置失败（%1 毫秒）：%2").arg(revertMs).arg(message));
+        m_statusLabel->setStyleSheet("QLabel { color: red; font-weight: bold; }");
+        QMessageBox::critical(this, QString("还原失败"),
+                              QString("未能还原网卡之前的设置。\n\n%1").arg(message));
+    }
+}
+
+void MainWindow::onDeadlineExceeded(const QString &kind, int timeoutMs, int attempt, bool retrying)
+{
+    Q_UNUSED(attempt);
+
+    // Applies report their own failure; this covers background queries
+    m_statusLabel->setText(retrying
+        ? QString("命令 %1 在 %2 毫秒内未完成，正在重试...").arg(kind).arg(timeoutMs)
+        : QString("命令 %1 在 %2 毫秒内未完成，已放弃。").arg(kind).arg(timeoutMs));
+    m_statusLabel->setStyleSheet("QLabel { color: #d97706; }");
+}
+
+quint64 MainWindow::currentConfigId() const
+{
+    const QVector<quint64> ids = selectedConfigIds();
+    return ids.size() == 1 ? ids.first() : 0;
+}
+
+QVector<quint64> MainWindow::selectedConfigIds() const
+{
+    QVector<quint64> ids;
+    for (const QModelIndex &index : m_configTableWidget->selectionModel()->selectedRows(0)) {
+        const QTableWidgetItem *item = m_configTableWidget->item(index.row(), 0);
+        if (item) {
+            ids.append(item->data(Qt::UserRole).toULongLong());
+        }
+    }
+    return ids;
+}
+
 QString MainWindow::getCurrentAdapterName() const
 {
-    if (m_adapterCombo->currentIndex() < 0) {
+    QString adapterGuid = getCurrentAdapterGuid();
+    if (adapterGuid.isEmpty()) {
         return QString();
     }
-    return m_adapterCombo->currentData().toString();
+    return m_networkManager->adapterByGuid(adapterGuid).name;
 }
 
 QString MainWindow::getCurrentAdapterGuid() const
@@ -362,13 +707,7 @@ QString MainWindow::getCurrentAdapterGuid() const
     if (m_adapterCombo->currentIndex() < 0) {
         return QString();
     }
-    QString adapterName = m_adapterCombo->currentData().toString();
-    for (const NetworkAdapter &adapter : m_adapters) {
-        if (adapter.name == adapterName) {
-            return adapter.guid;
-        }
-    }
-    return QString();
+    return m_adapterCombo->currentData().toString();
 }
 
 void MainWindow::onAddConfig()
@@ -381,20 +720,46 @@ void MainWindow::onAddConfig()
     showAddConfigDialog();
 }
 
-void MainWindow::showAddConfigDialog()
+void MainWindow::onCaptureConfig()
+{
+    QString adapterGuid = getCurrentAdapterGuid();
+    if (adapterGuid.isEmpty()) {
+        QMessageBox::warning(this, QString("错误"), QString("请先选择一个网络适配器。"));
+        return;
+    }
+
+    // Straight from the cached snapshot; no query needed
+    const AdapterState state = m_networkManager->cachedState(getCurrentAdapterName());
+    if (state.name.isEmpty()) {
+        QMessageBox::warning(this, QString("错误"), QString("尚未获取到该网卡的当前设置，请稍后再试。"));
+        return;
+    }
+
+    IpConfig config = ConfigDelta::configFromState(state);
+    config.name = QString("%1 当前设置").arg(state.name);
+    config.adapterGuid = adapterGuid;
+    // Worth keeping even when DHCP assigned them
+    config.dns1 = state.dnsServers.value(0);
+    config.dns2 = state.dnsServers.value(1);
+
+    showAddConfigDialog(config);
+}
+
+void MainWindow::showAddConfigDialog(const IpConfig &initial)
 {
     QDialog dialog(this);
     dialog.setWindowTitle(QString("添加IP配置"));
 
     QFormLayout *formLayout = new QFormLayout(&dialog);
 
-    QLineEdit *nameEdit = new QLineEdit(&dialog);
-    QLineEdit *ipEdit = new QLineEdit(&dialog);
-    QLineEdit *subnetEdit = new QLineEdit(&dialog);
-    QLineEdit *gatewayEdit = new QLineEdit(&dialog);
-    QLineEdit *dns1Edit = new QLineEdit(&dialog);
-    QLineEdit *dns2Edit = new QLineEdit(&dialog);
+    QLineEdit *nameEdit = new QLineEdit(initial.name, &dialog);
+    QLineEdit *ipEdit = new QLineEdit(initial.ipAddress, &dialog);
+    QLineEdit *subnetEdit = new QLineEdit(initial.subnetMask, &dialog);
+    QLineEdit *gatewayEdit = new QLineEdit(initial.gateway, &dialog);
+    QLineEdit *dns1Edit = new QLineEdit(initial.dns1, &dialog);
+    QLineEdit *dns2Edit = new QLineEdit(initial.dns2, &dialog);
     QCheckBox *dhcpCheckBox = new QCheckBox(QString("使用DHCP（自动获取IP）"), &dialog);
+    dhcpCheckBox->setChecked(initial.isDhcp);
 
     ipEdit->setPlaceholderText("192.168.1.100");
     subnetEdit->setPlaceholderText("255.255.255.0");
@@ -427,9 +792,20 @@ void MainWindow::showAddConfigDialog()
         QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
     buttonBox->button(QDialogButtonBox::Ok)->setText(QString("确定"));
     buttonBox->button(QDialogButtonBox::Cancel)->setText(QString("取消"));
+
+    const QString adapterGuid = getCurrentAdapterGuid();
+    setupConflictCheck(&dialog, formLayout, buttonBox, dhcpCheckBox, { ipEdit, subnetEdit, gatewayEdit },
+                       [adapterGuid, dhcpCheckBox, ipEdit, subnetEdit, gatewayEdit]() {
+        IpConfig edited;
+        edited.adapterGuid = adapterGuid;
+        edited.isDhcp = dhcpCheckBox->isChecked();
+        edited.ipAddress = ipEdit->text();
+        edited.subnetMask = subnetEdit->text();
+        edited.gateway = gatewayEdit->text();
+        return edited;
+    });
     formLayout->addRow(buttonBox);
 
-    connect(buttonBox, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
     connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
 
     if (dialog.exec() == QDialog::Accepted) {
@@ -458,24 +834,21 @@ void MainWindow::showAddConfigDialog()
 
 void MainWindow::onEditConfig()
 {
-    int currentRow = m_configTableWidget->currentRow();
-    if (currentRow < 0) {
+    const quint64 configId = currentConfigId();
+    if (configId == 0) {
         return;
     }
 
-    showEditConfigDialog(currentRow);
+    showEditConfigDialog(configId);
 }
 
-void MainWindow::showEditConfigDialog(int index)
+void MainWindow::showEditConfigDialog(quint64 configId)
 {
-    QString currentAdapterGuid = getCurrentAdapterGuid();
-    QVector<IpConfig> adapterConfigs = m_ipConfigManager->getConfigsForAdapter(currentAdapterGuid);
-
-    if (index < 0 || index >= adapterConfigs.size()) {
+    if (!m_ipConfigManager->contains(configId)) {
         return;
     }
 
-    IpConfig config = adapterConfigs[index];
+    IpConfig config = m_ipConfigManager->getConfig(configId);
 
     QDialog dialog(this);
     dialog.setWindowTitle(QString("编辑IP配置"));
@@ -516,9 +889,19 @@ void MainWindow::showEditConfigDialog(int index)
         QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
     buttonBox->button(QDialogButtonBox::Ok)->setText(QString("确定"));
     buttonBox->button(QDialogButtonBox::Cancel)->setText(QString("取消"));
+
+    // The stored version of this profile does not conflict with itself
+    setupConflictCheck(&dialog, formLayout, buttonBox, dhcpCheckBox, { ipEdit, subnetEdit, gatewayEdit },
+                       [config, dhcpCheckBox, ipEdit, subnetEdit, gatewayEdit]() {
+        IpConfig edited = config;
+        edited.isDhcp = dhcpCheckBox->isChecked();
+        edited.ipAddress = ipEdit->text();
+        edited.subnetMask = subnetEdit->text();
+        edited.gateway = gatewayEdit->text();
+        return edited;
+    });
     formLayout->addRow(buttonBox);
 
-    connect(buttonBox, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
     connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
 
     if (dialog.exec() == QDialog::Accepted) {
@@ -533,38 +916,152 @@ void MainWindow::showEditConfigDialog(int index)
             config.dns2 = dns2Edit->text();
         }
 
-        // Update in the main list using the new method
-        m_ipConfigManager->updateConfigForAdapter(currentAdapterGuid, index, config);
+        m_ipConfigManager->updateConfig(configId, config);
         QMessageBox::information(this, QString("成功"), QString("IP配置更新成功。"));
     }
 }
 
+// Lists the edited profile's conflicts under the form as it changes, and
+// asks before accepting it with any: some overlaps are deliberate
+void MainWindow::setupConflictCheck(QDialog *dialog, QFormLayout *formLayout, QDialogButtonBox *buttonBox,
+                                    QCheckBox *dhcpCheckBox, const QList<QLineEdit *> &addressEdits,
+                                    const std::function<IpConfig()> &editedConfig)
+{
+    QLabel *conflictLabel = new QLabel(dialog);
+    conflictLabel->setWordWrap(true);
+    conflictLabel->setStyleSheet("color: #ff9966;");
+    formLayout->addRow(conflictLabel);
+
+    auto updateConflicts = [this, conflictLabel, editedConfig]() {
+        const IpConfig edited = editedConfig();
+        const QStringList lines = describeConflicts(edited, m_ipConfigManager->conflictsFor(edited));
+        conflictLabel->setText(lines.join('\n'));
+        conflictLabel->setVisible(!lines.isEmpty());
+    };
+    for (QLineEdit *edit : addressEdits) {
+        connect(edit, &QLineEdit::textChanged, dialog, updateConflicts);
+    }
+    connect(dhcpCheckBox, &QCheckBox::stateChanged, dialog, updateConflicts);
+    updateConflicts();
+
+    connect(buttonBox, &QDialogButtonBox::accepted, dialog, [dialog, conflictLabel]() {
+        if (!conflictLabel->text().isEmpty() &&
+            QMessageBox::question(dialog, QString("配置冲突"),
+                                  QString("该配置存在以下冲突：\n%1\n\n仍然保存吗？").arg(conflictLabel->text()),
+                                  QMessageBox::Yes | QMessageBox::No, QMessageBox::No) != QMessageBox::Yes) {
+            return;
+        }
+        dialog->accept();
+    });
+}
+
+QStringList MainWindow::describeConflicts(const IpConfig &config, const QVector<ConfigConflict> &conflicts) const
+{
+    // Enough to act on; a profile can overlap with hundreds of others
+    const int kMaxLines = 10;
+
+    QStringList lines;
+    for (const ConfigConflict &conflict : conflicts) {
+        if (lines.size() == kMaxLines) {
+            lines << QString("……共 %1 项冲突").arg(conflicts.size());
+            break;
+        }
+
+        const IpConfig other = m_ipConfigManager->getConfig(conflict.otherId);
+        switch (conflict.kind) {
+        case ConfigConflict::DuplicateAddress: {
+            const QString adapterName = m_networkManager->adapterByGuid(other.adapterGuid).name;
+            lines << QString("IP地址 %1 与配置“%2”（%3）相同")
+                         .arg(config.ipAddress, other.name,
+                              adapterName.isEmpty() ? QString("未知网卡") : adapterName);
+            break;
+        }
+        case ConfigConflict::SubnetOverlap:
+            lines << QString("子网与配置“%1”的子网 %2/%3 重叠")
+                         .arg(other.name, other.ipAddress, other.subnetMask);
+            break;
+        case ConfigConflict::GatewayOutsideSubnet:
+            lines << QString("默认网关 %1 不在子网 %2/%3 内")
+                         .arg(config.gateway, config.ipAddress, config.subnetMask);
+            break;
+        }
+    }
+    return lines;
+}
+
 void MainWindow::onDeleteConfig()
 {
-    int currentRow = m_configTableWidget->currentRow();
-    if (currentRow < 0) {
+    const QVector<quint64> configIds = selectedConfigIds();
+    if (configIds.isEmpty()) {
         return;
     }
 
     QMessageBox::StandardButton reply = QMessageBox::question(
         this,
         QString("确认删除"),
-        QString("确定要删除此IP配置吗？"),
+        configIds.size() == 1 ? QString("确定要删除此IP配置吗？")
+                              : QString("确定要删除选中的 %1 个IP配置吗？").arg(configIds.size()),
         QMessageBox::Yes | QMessageBox::No
     );
 
     if (reply == QMessageBox::Yes) {
-        QString currentAdapterGuid = getCurrentAdapterGuid();
-        m_ipConfigManager->removeConfigForAdapter(currentAdapterGuid, currentRow);
+        // One write and one table refresh for the whole selection
+        ConfigBatch batch(m_ipConfigManager);
+        for (quint64 configId : configIds) {
+            m_ipConfigManager->removeConfig(configId);
+        }
+        batch.commit();
         QMessageBox::information(this, QString("成功"), QString("IP配置删除成功。"));
     }
 }
 
+void MainWindow::onMoveConfigs()
+{
+    const QVector<quint64> configIds = selectedConfigIds();
+    const QString currentGuid = getCurrentAdapterGuid();
+    if (configIds.isEmpty()) {
+        return;
+    }
+
+    QStringList names;
+    QStringList guids;
+    for (int i = 0; i < m_adapterCombo->count(); ++i) {
+        const QString guid = m_adapterCombo->itemData(i).toString();
+        if (guid != currentGuid) {
+            names.append(m_adapterCombo->itemText(i));
+            guids.append(guid);
+        }
+    }
+    if (guids.isEmpty()) {
+        return;
+    }
+
+    bool ok = false;
+    const QString target = QInputDialog::getItem(
+        this, QString("移动IP配置"),
+        QString("把选中的 %1 个配置移动到：").arg(configIds.size()),
+        names, 0, false, &ok);
+    if (!ok) {
+        return;
+    }
+    const QString targetGuid = guids.value(names.indexOf(target));
+
+    ConfigBatch batch(m_ipConfigManager);
+    for (quint64 configId : configIds) {
+        m_ipConfigManager->moveConfig(configId, targetGuid);
+    }
+    batch.commit();
+}
+
 void MainWindow::onRefreshAdapters()
 {
+    // The manager diffs the new list against its cache, so only changed
+    // adapters touch the combo box
     loadAdapters();
-    m_statusLabel->setText(tr("Network adapters refreshed"));
-    m_statusLabel->setStyleSheet("QLabel { color: green; }");
+
+    if (m_stateRequestId == 0) {
+        m_stateRequestId = m_networkManager->requestNetworkState();
+    }
 }
 
 void MainWindow::refreshConfigList()
@@ -581,7 +1078,16 @@ void MainWindow::refreshConfigList()
 void MainWindow::refreshConfigList(const QString &adapterGuid)
 {
     m_configTableWidget->setRowCount(0);
-    QVector<IpConfig> configs = m_ipConfigManager->getConfigsForAdapter(adapterGuid);
+    QVector<IpConfig> configs;
+    const QString search = m_searchEdit->text().trimmed();
+    if (search.isEmpty()) {
+        configs = m_ipConfigManager->getConfigsForAdapter(adapterGuid);
+    } else {
+        // Answered from the manager's indexes, in the order they give
+        for (quint64 id : m_ipConfigManager->searchConfigs(search, adapterGuid)) {
+            configs.append(m_ipConfigManager->getConfig(id));
+        }
+    }
 
     m_configTableWidget->setRowCount(configs.size());
 
@@ -589,7 +1095,9 @@ void MainWindow::refreshConfigList(const QString &adapterGuid)
         const IpConfig &config = configs[i];
 
         // Configuration name
+        // Rows are addressed by profile id, not by position
         QTableWidgetItem *nameItem = new QTableWidgetItem(config.name);
+        nameItem->setData(Qt::UserRole, config.id);
         nameItem->setFlags(nameItem->flags() & ~Qt::ItemIsEditable);
         m_configTableWidget->setItem(i, 0, nameItem);
 
@@ -620,17 +1128,258 @@ void MainWindow::refreshConfigList(const QString &adapterGuid)
             gatewayItem->setFlags(gatewayItem->flags() & ~Qt::ItemIsEditable);
             m_configTableWidget->setItem(i, 3, gatewayItem);
         }
+
+        // Kept by the manager as profiles change; the details are only
+        // worked out for the rows that have any
+        if (m_ipConfigManager->hasConflicts(config.id)) {
+            const QString details = describeConflicts(config, m_ipConfigManager->conflictsFor(config)).join('\n');
+            nameItem->setIcon(style()->standardIcon(QStyle::SP_MessageBoxWarning));
+            for (int column = 0; column < m_configTableWidget->columnCount(); ++column) {
+                QTableWidgetItem *item = m_configTableWidget->item(i, column);
+                item->setForeground(QColor(255, 153, 102));
+                item->setToolTip(details);
+            }
+        }
     }
 
     m_configTableWidget->setCurrentCell(-1, -1);
     onConfigSelected();
 }
 
-void MainWindow::onConfigListChanged()
+void MainWindow::onSearchTextChanged()
 {
     refreshConfigList();
 }
 
+void MainWindow::onConfigsChanged(const ConfigChangeSet &changes)
+{
+    // Only the selected adapter's profiles are on screen
+    if (changes.adapters.contains(getCurrentAdapterGuid())) {
+        refreshConfigList();
+    }
+}
+
+static void fillDiagnosticsTable(QTableWidget *table, const QVector<CommandKindStats> &stats,
+                                 const QVector<CommandDeadline> &deadlines)
+{
+    QHash<QString, int> timeouts;
+    for (const CommandDeadline &deadline : deadlines) {
+        timeouts.insert(deadline.kind, deadline.timeoutMs);
+    }
+
+    auto millis = [](qint64 micros) {
+        return QString::number(micros / 1000.0, 'f', 1);
+    };
+
+    table->setRowCount(stats.size());
+    for (int row = 0; row < stats.size(); ++row) {
+        const CommandKindStats &entry = stats[row];
+        const QStringList cells = QStringList()
+            << entry.kind
+            << QString::number(entry.count)
+            << QString::number(entry.failed)
+            << QString::number(entry.timedOut)
+            << QString::number(entry.cancelled)
+            << QString::number(entry.spawns)
+            << QString::number(entry.outputBytes)
+            << millis(entry.latency.percentile(50))
+            << millis(entry.latency.percentile(90))
+            << millis(entry.latency.percentile(99))
+            << millis(entry.latency.max())
+            << (timeouts.contains(entry.kind) ? QString::number(timeouts.value(entry.kind)) : QString("-"));
+        for (int column = 0; column < cells.size(); ++column) {
+            QTableWidgetItem *item = new QTableWidgetItem(cells[column]);
+            if (column > 0) {
+                item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            }
+            table->setItem(row, column, item);
+        }
+    }
+    table->resizeColumnsToContents();
+}
+
+void MainWindow::onShowDiagnostics()
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(QString("诊断信息"));
+    dialog.resize(900, 400);
+
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+
+    QTableWidget *table = new QTableWidget(&dialog);
+    table->setColumnCount(12);
+    table->setHorizontalHeaderLabels(QStringList() << "类型" << "次数" << "失败" << "超时" << "取消"
+                                                   << "启动进程" << "输出字节"
+                                                   << "p50 (ms)" << "p90 (ms)" << "p99 (ms)" << "最大 (ms)"
+                                                   << "超时限制 (ms)");
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->verticalHeader()->setVisible(false);
+    layout->addWidget(table);
+
+    QLabel *schedulerLabel = new QLabel(&dialog);
+    layout->addWidget(schedulerLabel);
+
+    QLabel *storeLabel = new QLabel(&dialog);
+    layout->addWidget(storeLabel);
+
+    auto refresh = [this, table, schedulerLabel, storeLabel]() {
+        fillDiagnosticsTable(table, CommandMetrics::instance()->snapshot(),
+                             CommandDeadlines::instance()->snapshot());
+
+        const ApplySchedulerStats stats = m_networkManager->schedulerStats();
+        schedulerLabel->setText(QString("应用队列：等待 %1，执行中 %2，已完成 %3，被取代 %4，"
+                                        "平均耗时 %5 ms，最长 %6 ms")
+                                    .arg(stats.queueDepth).arg(stats.running)
+                                    .arg(stats.completed).arg(stats.superseded)
+                                    .arg(stats.averageLatencyMs, 0, 'f', 1)
+                                    .arg(stats.maxLatencyMs, 0, 'f', 1));
+
+        const ConfigStoreStats store = m_ipConfigManager->persistenceStats();
+        storeLabel->setText(QString("配置文件：待写入 %1，修改 %2 次，写入 %3 次（失败 %4），"
+                                    "检查点 %5 次，日志中 %6 条记录，最近一次写入 %7 ms / %8 字节")
+                                .arg(store.pendingWrites).arg(store.mutations)
+                                .arg(store.writes).arg(store.failedWrites)
+                                .arg(store.checkpoints).arg(store.journalRecords)
+                                .arg(store.lastFlushMs, 0, 'f', 1).arg(store.lastFlushBytes));
+    };
+    refresh();
+
+    QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+    QPushButton *refreshButton = buttonBox->addButton(QString("刷新"), QDialogButtonBox::ActionRole);
+    QPushButton *resetButton = buttonBox->addButton(QString("清零"), QDialogButtonBox::ResetRole);
+    QPushButton *exportButton = buttonBox->addButton(QString("导出JSON..."), QDialogButtonBox::ActionRole);
+    layout->addWidget(buttonBox);
+
+    connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    connect(refreshButton, &QPushButton::clicked, &dialog, refresh);
+    connect(resetButton, &QPushButton::clicked, &dialog, [refresh]() {
+        CommandMetrics::instance()->reset();
+        refresh();
+    });
+    connect(exportButton, &QPushButton::clicked, &dialog, [this, &dialog]() {
+        const QString fileName = QFileDialog::getSaveFileName(&dialog, QString("导出诊断信息"),
+                                                              "iptool-metrics.json",
+                                                              QString("JSON (*.json)"));
+        if (fileName.isEmpty()) {
+            return;
+        }
+
+        QJsonObject json = CommandMetrics::instance()->toJson();
+        const ApplySchedulerStats stats = m_networkManager->schedulerStats();
+        QJsonObject scheduler;
+        scheduler["queueDepth"] = stats.queueDepth;
+        scheduler["running"] = stats.running;
+        scheduler["completed"] = double(stats.completed);
+        scheduler["superseded"] = double(stats.superseded);
+        scheduler["lastLatencyMs"] = stats.lastLatencyMs;
+        scheduler["averageLatencyMs"] = stats.averageLatencyMs;
+        scheduler["maxLatencyMs"] = stats.maxLatencyMs;
+        json["scheduler"] = scheduler;
+        json["deadlines"] = CommandDeadlines::instance()->toJson();
+
+        const ConfigStoreStats store = m_ipConfigManager->persistenceStats();
+        QJsonObject configStore;
+        configStore["pendingWrites"] = store.pendingWrites;
+        configStore["mutations"] = double(store.mutations);
+        configStore["writes"] = double(store.writes);
+        configStore["failedWrites"] = double(store.failedWrites);
+        configStore["checkpoints"] = double(store.checkpoints);
+        configStore["journalRecords"] = store.journalRecords;
+        configStore["lastFlushMs"] = store.lastFlushMs;
+        configStore["lastFlushBytes"] = double(store.lastFlushBytes);
+        json["configStore"] = configStore;
+
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QMessageBox::warning(&dialog, QString("错误"),
+                                 QString("无法写入文件：%1").arg(file.errorString()));
+            return;
+        }
+        file.write(QJsonDocument(json).toJson(QJsonDocument::Indented));
+    });
+
+    dialog.exec();
+}
+
+void MainWindow::onImportConfigs()
+{
+    const QString fileName = QFileDialog::getOpenFileName(this, QString("导入IP配置"), QString(),
+                                                          QString("IP配置 (*.csv *.json);;CSV (*.csv);;JSON (*.json)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QProgressDialog progress(QString("正在读取 %1 ...").arg(QFileInfo(fileName).fileName()),
+                             QString("取消"), 0, 1000, this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+
+    // Rows without an adapter column go to the selected adapter
+    const ImportResult result = ConfigTransfer::importFile(
+        fileName, getCurrentAdapterGuid(), [&progress](qint64 bytesRead, qint64 totalBytes) {
+            progress.setValue(totalBytes > 0 ? int(bytesRead * 1000 / totalBytes) : 0);
+            return !progress.wasCanceled();
+        });
+    progress.reset();
+
+    if (!result.error.isEmpty()) {
+        QMessageBox::warning(this, QString("错误"), QString("无法导入文件：%1").arg(result.error));
+        return;
+    }
+    if (result.cancelled) {
+        return;
+    }
+
+    if (!result.errors.isEmpty()) {
+        // Listing every error of a very broken file helps nobody
+        const int kMaxListed = 1000;
+        QStringList lines;
+        for (int i = 0; i < result.errors.size() && i < kMaxListed; ++i) {
+            lines.append(QString("第 %1 行：%2").arg(result.errors[i].line).arg(result.errors[i].message));
+        }
+        if (result.errors.size() > kMaxListed) {
+            lines.append(QString("……另有 %1 行错误").arg(result.errors.size() - kMaxListed));
+        }
+
+        QMessageBox box(QMessageBox::Warning, QString("导入IP配置"),
+                        QString("共 %1 行，其中 %2 行有错误，将被跳过。")
+                            .arg(result.rows).arg(result.errors.size()),
+                        QMessageBox::NoButton, this);
+        box.setDetailedText(lines.join('\n'));
+        if (result.configs.isEmpty()) {
+            box.setStandardButtons(QMessageBox::Ok);
+            box.exec();
+            return;
+        }
+        box.setInformativeText(QString("是否导入其余 %1 个有效配置？").arg(result.configs.size()));
+        box.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+        box.button(QMessageBox::Yes)->setText(QString("导入"));
+        box.button(QMessageBox::No)->setText(QString("取消"));
+        if (box.exec() != QMessageBox::Yes) {
+            return;
+        }
+    }
+
+    m_ipConfigManager->addConfigs(result.configs);
+    QMessageBox::information(this, QString("成功"), QString("已导入 %1 个IP配置。").arg(result.configs.size()));
+}
+
+void MainWindow::onExportConfigs()
+{
+    const QString fileName = QFileDialog::getSaveFileName(this, QString("导出IP配置"),
+                                                          "ip_configs.csv",
+                                                          QString("CSV (*.csv);;JSON (*.json)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QString error;
+    if (!ConfigTransfer::exportFile(fileName, m_ipConfigManager->getConfigs(), &error)) {
+        QMessageBox::warning(this, QString("错误"), QString("无法写入文件：%1").arg(error));
+    }
+}
+
 void MainWindow::applyDarkTheme()
 {
     // Dark theme stylesheet
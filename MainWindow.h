@@ -7,13 +7,24 @@
 #include <QPushButton>
 #include <QLineEdit>
 #include <QLabel>
+#include <QHash>
+#include <QSet>
+#include <functional>
 #include "IpConfigManager.h"
 #include "NetworkAdapterManager.h"
 
+class QCheckBox;
+class QDialog;
+class QDialogButtonBox;
+class QFormLayout;
+class QMessageBox;
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
+    friend class ChangeIPToolBench;
+
 public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
@@ -23,10 +34,33 @@ private slots:
     void onConfigSelected();
     void onApplyConfig();
     void onAddConfig();
+    void onCaptureConfig();
     void onEditConfig();
     void onDeleteConfig();
+    void onMoveConfigs();
+    void onSearchTextChanged();
     void onRefreshAdapters();
-    void onConfigListChanged();
+    void onConfigsChanged(const ConfigChangeSet &changes);
+    void onCancelOperation();
+    void onAdaptersReady(quint64 operationId, const QVector<NetworkAdapter> &adapters);
+    void onNetworkStateReady(quint64 operationId, const NetworkState &state);
+    void onAdapterAdded(const NetworkAdapter &adapter);
+    void onAdapterRemoved(const NetworkAdapter &adapter);
+    void onAdapterUpdated(const NetworkAdapter &adapter);
+    void onAdapterStateChanged(const AdapterState &state);
+    void onAdminStatusReady(quint64 operationId, bool isAdmin);
+    void onOperationProgress(quint64 operationId, int step, int totalSteps, const QString &description);
+    void onOperationFinished(quint64 operationId, bool success, const QString &message);
+    void onOperationSuperseded(quint64 operationId, quint64 replacedBy);
+    void onConfirmationRequired(quint64 operationId, const QString &adapterName, int timeoutSec);
+    void onApplyConfirmed(quint64 operationId, bool reachable, qint64 elapsedMs);
+    void onRevertStarted(quint64 operationId, const QString &reason);
+    void onRevertFinished(quint64 operationId, bool success, const QString &message,
+                          qint64 revertMs, qint64 outageMs);
+    void onDeadlineExceeded(const QString &kind, int timeoutMs, int attempt, bool retrying);
+    void onShowDiagnostics();
+    void onImportConfigs();
+    void onExportConfigs();
 
 private:
     void setupUi();
@@ -34,21 +68,35 @@ private:
     void loadAdapters();
     void refreshConfigList();
     void refreshConfigList(const QString &adapterGuid);
-    void showAddConfigDialog();
-    void showEditConfigDialog(int index);
+    void showAddConfigDialog(const IpConfig &initial = IpConfig());
+    void showEditConfigDialog(quint64 configId);
+    void setupConflictCheck(QDialog *dialog, QFormLayout *formLayout, QDialogButtonBox *buttonBox,
+                            QCheckBox *dhcpCheckBox, const QList<QLineEdit *> &addressEdits,
+                            const std::function<IpConfig()> &editedConfig);
+    QStringList describeConflicts(const IpConfig &config, const QVector<ConfigConflict> &conflicts) const;
     void applyConfig(const IpConfig &config);
+    quint64 currentConfigId() const;    // 0 unless exactly one row is selected
+    QVector<quint64> selectedConfigIds() const;
     QString getCurrentAdapterName() const;
     QString getCurrentAdapterGuid() const;
+    void showAdapterInfo(const NetworkAdapter &adapter);
+    void showAdapterState(const AdapterState &state);
+    void updateAdapterComboWidth();
     void applyDarkTheme();
+    void closeConfirmBox(quint64 operationId);
 
     // UI Components
     QComboBox *m_adapterCombo;
+    QLineEdit *m_searchEdit;
     QTableWidget *m_configTableWidget;
     QPushButton *m_applyButton;
     QPushButton *m_addButton;
+    QPushButton *m_captureButton;
     QPushButton *m_editButton;
     QPushButton *m_deleteButton;
+    QPushButton *m_moveButton;
     QPushButton *m_refreshButton;
+    QPushButton *m_cancelButton;
     QLabel *m_currentIpLabel;
     QLabel *m_adapterInfoLabel;
     QLabel *m_statusLabel;
@@ -57,7 +105,15 @@ private:
     IpConfigManager *m_ipConfigManager;
     NetworkAdapterManager *m_networkManager;
 
-    QVector<NetworkAdapter> m_adapters;
+    // Pending asynchronous requests; results for older ids are ignored
+    quint64 m_adaptersRequestId;
+    quint64 m_stateRequestId;
+    quint64 m_applyOperationId;         // Most recent apply
+    QSet<quint64> m_applyOperations;    // All applies still in flight
+    bool m_adminKnown;
+    bool m_isAdmin;
+    bool m_autoRevert;                  // Last choice in the apply dialog
+    QHash<quint64, QMessageBox *> m_confirmBoxes;  // Applies awaiting confirmation
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,896 @@
+#include "NetlinkBackend.h"
+#include "ConfigDelta.h"
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QHostAddress>
+#include <QSocketNotifier>
+#include <QDebug>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+namespace {
+
+const quint8 kOperStateUnknown = 0;  // IF_OPER_UNKNOWN, reported by dummy and tun links
+const quint8 kOperStateUp = 6;       // IF_OPER_UP
+
+// Builds one netlink message: fixed header, family header, attributes
+class NetlinkRequest
+{
+public:
+    NetlinkRequest(quint16 type, quint16 flags)
+        : m_type(type)
+        , m_flags(flags)
+    {
+    }
+
+    void append(const void *data, int length)
+    {
+        m_payload.append(static_cast<const char *>(data), length);
+        m_payload.append(NLMSG_ALIGN(length) - length, '\0');
+    }
+
+    void addAttribute(quint16 type, const void *data, int length)
+    {
+        rtattr attribute;
+        attribute.rta_type = type;
+        attribute.rta_len = RTA_LENGTH(length);
+        m_payload.append(reinterpret_cast<const char *>(&attribute), sizeof(attribute));
+        append(data, length);
+    }
+
+    void addAddress(quint16 type, quint32 hostOrderAddress)
+    {
+        const quint32 networkOrder = htonl(hostOrderAddress);
+        addAttribute(type, &networkOrder, sizeof(networkOrder));
+    }
+
+    QByteArray finish(quint32 sequence) const
+    {
+        nlmsghdr header;
+        std::memset(&header, 0, sizeof(header));
+        header.nlmsg_len = NLMSG_HDRLEN + m_payload.size();
+        header.nlmsg_type = m_type;
+        header.nlmsg_flags = m_flags;
+        header.nlmsg_seq = sequence;
+
+        QByteArray message(reinterpret_cast<const char *>(&header), sizeof(header));
+        message.append(NLMSG_HDRLEN - int(sizeof(header)), '\0');
+        message.append(m_payload);
+        return message;
+    }
+
+private:
+    quint16 m_type;
+    quint16 m_flags;
+    QByteArray m_payload;
+};
+
+template <typename Handler>
+void forEachAttribute(rtattr *attribute, int length, Handler handler)
+{
+    for (; RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length)) {
+        handler(attribute);
+    }
+}
+
+QString attributeString(rtattr *attribute)
+{
+    return QString::fromLocal8Bit(static_cast<const char *>(RTA_DATA(attribute)),
+                                  int(qstrnlen(static_cast<const char *>(RTA_DATA(attribute)),
+                                               RTA_PAYLOAD(attribute))));
+}
+
+quint32 attributeAddress(rtattr *attribute)
+{
+    quint32 networkOrder = 0;
+    if (size_t(RTA_PAYLOAD(attribute)) >= sizeof(networkOrder)) {
+        std::memcpy(&networkOrder, RTA_DATA(attribute), sizeof(networkOrder));
+    }
+    return ntohl(networkOrder);
+}
+
+QString addressToString(quint32 hostOrderAddress)
+{
+    return QHostAddress(hostOrderAddress).toString();
+}
+
+bool parseAddress(const QString &text, quint32 &address)
+{
+    bool ok = false;
+    address = QHostAddress(text.trimmed()).toIPv4Address(&ok);
+    return ok;
+}
+
+// Accepts either a dotted mask or a bare prefix length
+bool parsePrefix(const QString &text, int &prefixLength)
+{
+    bool isNumber = false;
+    prefixLength = text.trimmed().toInt(&isNumber);
+    if (isNumber) {
+        return prefixLength >= 0 && prefixLength <= 32;
+    }
+
+    quint32 mask = 0;
+    if (!parseAddress(text, mask)) {
+        return false;
+    }
+
+    // The mask must be contiguous ones followed by zeros
+    const quint32 inverted = ~mask;
+    if ((inverted & (inverted + 1)) != 0) {
+        return false;
+    }
+
+    prefixLength = 0;
+    while (prefixLength < 32 && (mask & (0x80000000u >> prefixLength))) {
+        prefixLength++;
+    }
+    return true;
+}
+
+QString linkGuid(const QByteArray &hardwareAddress, const QString &name)
+{
+    // Links have no GUID; the hardware address is the stable identity,
+    // falling back to the name for links without one
+    if (hardwareAddress.count('\0') == hardwareAddress.size()) {
+        return name;
+    }
+    return QString::fromLatin1(hardwareAddress.toHex(':'));
+}
+
+QString errorText(int error)
+{
+    return QString::fromLocal8Bit(std::strerror(-error));
+}
+
+} // namespace
+
+class NetlinkSocket
+{
+public:
+    explicit NetlinkSocket(quint32 groups = 0)
+        : m_fd(-1)
+        , m_sequence(0)
+        , m_buffer(65536)
+    {
+        m_fd = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (m_fd < 0) {
+            qWarning() << "Failed to open rtnetlink socket:" << std::strerror(errno);
+            return;
+        }
+
+        sockaddr_nl local;
+        std::memset(&local, 0, sizeof(local));
+        local.nl_family = AF_NETLINK;
+        local.nl_groups = groups;
+        if (::bind(m_fd, reinterpret_cast<sockaddr *>(&local), sizeof(local)) < 0) {
+            qWarning() << "Failed to bind rtnetlink socket:" << std::strerror(errno);
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    ~NetlinkSocket()
+    {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    bool isValid() const
+    {
+        return m_fd >= 0;
+    }
+
+    int fd() const
+    {
+        return m_fd;
+    }
+
+    // Sends the request and passes every reply to onMessage until the dump
+    // ends or the kernel acknowledges. Returns 0 or a negative errno.
+    template <typename Handler>
+    int transact(const NetlinkRequest &request, Handler onMessage)
+    {
+        if (m_fd < 0) {
+            return -EBADF;
+        }
+
+        const quint32 sequence = ++m_sequence;
+        const QByteArray message = request.finish(sequence);
+
+        sockaddr_nl kernel;
+        std::memset(&kernel, 0, sizeof(kernel));
+        kernel.nl_family = AF_NETLINK;
+
+        if (::sendto(m_fd, message.constData(), size_t(message.size()), 0,
+                     reinterpret_cast<sockaddr *>(&kernel), sizeof(kernel)) < 0) {
+            return -errno;
+        }
+
+        for (;;) {
+            const ssize_t received = ::recv(m_fd, m_buffer.data(), m_buffer.size(), 0);
+            if (received < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -errno;
+            }
+
+            int remaining = int(received);
+            for (nlmsghdr *header = reinterpret_cast<nlmsghdr *>(m_buffer.data());
+                 NLMSG_OK(header, remaining);
+                 header = NLMSG_NEXT(header, remaining)) {
+                if (header->nlmsg_seq != sequence) {
+                    continue;
+                }
+                if (header->nlmsg_type == NLMSG_DONE) {
+                    return 0;
+                }
+                if (header->nlmsg_type == NLMSG_ERROR) {
+                    // error == 0 is the acknowledgement
+                    return static_cast<nlmsgerr *>(NLMSG_DATA(header))->error;
+                }
+                onMessage(header);
+            }
+        }
+    }
+
+    void drain()
+    {
+        while (::recv(m_fd, m_buffer.data(), m_buffer.size(), MSG_DONTWAIT) > 0) {
+        }
+    }
+
+private:
+    int m_fd;
+    quint32 m_sequence;
+    std::vector<char> m_buffer;
+};
+
+namespace {
+
+struct LinkInfo {
+    int index = 0;
+    QString name;
+    QString kind;
+    QByteArray hardwareAddress;
+    unsigned int flags = 0;
+    quint8 operState = kOperStateUnknown;
+};
+
+struct AddressInfo {
+    int linkIndex = 0;
+    quint32 address = 0;
+    int prefixLength = 0;
+    bool permanent = true;
+};
+
+QVector<LinkInfo> dumpLinks(NetlinkSocket &socket)
+{
+    QVector<LinkInfo> links;
+
+    ifinfomsg request;
+    std::memset(&request, 0, sizeof(request));
+    request.ifi_family = AF_UNSPEC;
+
+    NetlinkRequest message(RTM_GETLINK, NLM_F_REQUEST | NLM_F_DUMP);
+    message.append(&request, sizeof(request));
+
+    socket.transact(message, [&links](nlmsghdr *header) {
+        if (header->nlmsg_type != RTM_NEWLINK) {
+            return;
+        }
+
+        ifinfomsg *info = static_cast<ifinfomsg *>(NLMSG_DATA(header));
+        LinkInfo link;
+        link.index = info->ifi_index;
+        link.flags = info->ifi_flags;
+
+        forEachAttribute(IFLA_RTA(info), int(IFLA_PAYLOAD(header)), [&link](rtattr *attribute) {
+            switch (attribute->rta_type) {
+            case IFLA_IFNAME:
+                link.name = attributeString(attribute);
+                break;
+            case IFLA_ADDRESS:
+                link.hardwareAddress = QByteArray(static_cast<const char *>(RTA_DATA(attribute)),
+                                                  int(RTA_PAYLOAD(attribute)));
+                break;
+            case IFLA_OPERSTATE:
+                link.operState = *static_cast<quint8 *>(RTA_DATA(attribute));
+                break;
+            case IFLA_LINKINFO:
+                forEachAttribute(static_cast<rtattr *>(RTA_DATA(attribute)), int(RTA_PAYLOAD(attribute)),
+                                 [&link](rtattr *nested) {
+                    if (nested->rta_type == IFLA_INFO_KIND) {
+                        link.kind = attributeString(nested);
+                    }
+                });
+                break;
+            default:
+                break;
+            }
+        });
+
+        links.append(link);
+    });
+
+    return links;
+}
+
+// linkIndex 0 returns the addresses of every link
+QVector<AddressInfo> dumpAddresses(NetlinkSocket &socket, int linkIndex)
+{
+    QVector<AddressInfo> addresses;
+
+    ifaddrmsg request;
+    std::memset(&request, 0, sizeof(request));
+    request.ifa_family = AF_INET;
+
+    NetlinkRequest message(RTM_GETADDR, NLM_F_REQUEST | NLM_F_DUMP);
+    message.append(&request, sizeof(request));
+
+    socket.transact(message, [&addresses, linkIndex](nlmsghdr *header) {
+        if (header->nlmsg_type != RTM_NEWADDR) {
+            return;
+        }
+
+        ifaddrmsg *info = static_cast<ifaddrmsg *>(NLMSG_DATA(header));
+        if ((linkIndex != 0 && int(info->ifa_index) != linkIndex) || info->ifa_family != AF_INET) {
+            return;
+        }
+
+        AddressInfo address;
+        address.linkIndex = int(info->ifa_index);
+        address.prefixLength = info->ifa_prefixlen;
+        quint32 flags = info->ifa_flags;
+        bool haveLocal = false;
+
+        forEachAttribute(IFA_RTA(info), int(IFA_PAYLOAD(header)), [&](rtattr *attribute) {
+            switch (attribute->rta_type) {
+            case IFA_LOCAL:
+                address.address = attributeAddress(attribute);
+                haveLocal = true;
+                break;
+            case IFA_ADDRESS:
+                if (!haveLocal) {
+                    address.address = attributeAddress(attribute);
+                }
+                break;
+            case IFA_FLAGS:
+                std::memcpy(&flags, RTA_DATA(attribute), sizeof(flags));
+                break;
+            default:
+                break;
+            }
+        });
+
+        // Addresses handed out by a DHCP client carry a lifetime
+        address.permanent = flags & IFA_F_PERMANENT;
+        addresses.append(address);
+    });
+
+    return addresses;
+}
+
+// Default gateways of every link, by link index
+QHash<int, QStringList> dumpGateways(NetlinkSocket &socket)
+{
+    QHash<int, QStringList> gateways;
+
+    rtmsg request;
+    std::memset(&request, 0, sizeof(request));
+    request.rtm_family = AF_INET;
+
+    NetlinkRequest message(RTM_GETROUTE, NLM_F_REQUEST | NLM_F_DUMP);
+    message.append(&request, sizeof(request));
+
+    socket.transact(message, [&gateways](nlmsghdr *header) {
+        if (header->nlmsg_type != RTM_NEWROUTE) {
+            return;
+        }
+
+        rtmsg *route = static_cast<rtmsg *>(NLMSG_DATA(header));
+        if (route->rtm_dst_len != 0 || route->rtm_type != RTN_UNICAST) {
+            return;
+        }
+
+        quint32 table = route->rtm_table;
+        int outputLink = 0;
+        quint32 gateway = 0;
+
+        forEachAttribute(RTM_RTA(route), int(RTM_PAYLOAD(header)), [&](rtattr *attribute) {
+            switch (attribute->rta_type) {
+            case RTA_TABLE:
+                std::memcpy(&table, RTA_DATA(attribute), sizeof(table));
+                break;
+            case RTA_OIF:
+                std::memcpy(&outputLink, RTA_DATA(attribute), sizeof(outputLink));
+                break;
+            case RTA_GATEWAY:
+                gateway = attributeAddress(attribute);
+                break;
+            default:
+                break;
+            }
+        });
+
+        if (table == RT_TABLE_MAIN && outputLink != 0 && gateway != 0) {
+            gateways[outputLink] << addressToString(gateway);
+        }
+    });
+
+    return gateways;
+}
+
+QStringList readResolverServers()
+{
+    QStringList servers;
+    QFile file("/etc/resolv.conf");
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return servers;
+    }
+
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().simplified();
+        if (line.startsWith("nameserver ")) {
+            const QString server = QString::fromLatin1(line.mid(11));
+            quint32 address = 0;
+            if (parseAddress(server, address)) {
+                servers << server;
+            }
+        }
+    }
+    return servers;
+}
+
+int changeAddress(NetlinkSocket &socket, quint16 type, int linkIndex, quint32 address, int prefixLength)
+{
+    ifaddrmsg request;
+    std::memset(&request, 0, sizeof(request));
+    request.ifa_family = AF_INET;
+    request.ifa_prefixlen = quint8(prefixLength);
+    request.ifa_scope = RT_SCOPE_UNIVERSE;
+    request.ifa_index = quint32(linkIndex);
+
+    quint16 flags = NLM_F_REQUEST | NLM_F_ACK;
+    if (type == RTM_NEWADDR) {
+        flags |= NLM_F_CREATE | NLM_F_REPLACE;
+    }
+
+    NetlinkRequest message(type, flags);
+    message.append(&request, sizeof(request));
+    message.addAddress(IFA_LOCAL, address);
+    message.addAddress(IFA_ADDRESS, address);
+    if (type == RTM_NEWADDR && prefixLength < 31) {
+        const quint32 hostMask = prefixLength == 0 ? 0xffffffffu : (0xffffffffu >> prefixLength);
+        message.addAddress(IFA_BROADCAST, address | hostMask);
+    }
+
+    return socket.transact(message, [](nlmsghdr *) {});
+}
+
+int addDefaultRoute(NetlinkSocket &socket, int linkIndex, quint32 gateway)
+{
+    rtmsg request;
+    std::memset(&request, 0, sizeof(request));
+    request.rtm_family = AF_INET;
+    request.rtm_table = RT_TABLE_MAIN;
+    request.rtm_protocol = RTPROT_STATIC;
+    request.rtm_scope = RT_SCOPE_UNIVERSE;
+    request.rtm_type = RTN_UNICAST;
+
+    // No NLM_F_REPLACE: that would take over another link's default route
+    NetlinkRequest message(RTM_NEWROUTE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE);
+    message.append(&request, sizeof(request));
+    const quint32 outputLink = quint32(linkIndex);
+    message.addAttribute(RTA_OIF, &outputLink, sizeof(outputLink));
+    message.addAddress(RTA_GATEWAY, gateway);
+
+    return socket.transact(message, [](nlmsghdr *) {});
+}
+
+// Removes every default route leaving through the link
+int clearDefaultRoutes(NetlinkSocket &socket, int linkIndex)
+{
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        rtmsg request;
+        std::memset(&request, 0, sizeof(request));
+        request.rtm_family = AF_INET;
+        request.rtm_table = RT_TABLE_MAIN;
+        request.rtm_scope = RT_SCOPE_NOWHERE;
+
+        NetlinkRequest message(RTM_DELROUTE, NLM_F_REQUEST | NLM_F_ACK);
+        message.append(&request, sizeof(request));
+        const quint32 outputLink = quint32(linkIndex);
+        message.addAttribute(RTA_OIF, &outputLink, sizeof(outputLink));
+
+        const int error = socket.transact(message, [](nlmsghdr *) {});
+        if (error == -ESRCH) {
+            return 0;
+        }
+        if (error != 0) {
+            return error;
+        }
+    }
+    return 0;
+}
+
+int setLinkUp(NetlinkSocket &socket, int linkIndex)
+{
+    ifinfomsg request;
+    std::memset(&request, 0, sizeof(request));
+    request.ifi_family = AF_UNSPEC;
+    request.ifi_index = linkIndex;
+    request.ifi_flags = IFF_UP;
+    request.ifi_change = IFF_UP;
+
+    NetlinkRequest message(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_ACK);
+    message.append(&request, sizeof(request));
+
+    return socket.transact(message, [](nlmsghdr *) {});
+}
+
+AdapterState buildState(const LinkInfo &link, const QVector<AddressInfo> &addresses,
+                        const QStringList &gateways, const QStringList &dnsServers)
+{
+    AdapterState state;
+    state.name = link.name;
+    state.valid = true;
+    state.guid = linkGuid(link.hardwareAddress, link.name);
+    state.linkUp = (link.flags & IFF_UP) &&
+                   (link.operState == kOperStateUp || link.operState == kOperStateUnknown);
+
+    bool anyDynamic = false;
+    for (const AddressInfo &info : addresses) {
+        if (info.linkIndex != link.index) {
+            continue;
+        }
+        InterfaceAddress address;
+        address.address = addressToString(info.address);
+        address.prefixLength = info.prefixLength;
+        state.addresses.append(address);
+        anyDynamic = anyDynamic || !info.permanent;
+    }
+    state.isDhcp = anyDynamic;
+    // The resolver is not per link; follow the addresses
+    state.dnsFromDhcp = anyDynamic;
+
+    state.gateways = gateways;
+    state.dnsServers = dnsServers;
+    return state;
+}
+
+BackendResult stepFailure(const QString &description, int error)
+{
+    BackendResult result;
+    if (error == -EPERM || error == -EACCES) {
+        result.message = QString("错误：需要管理员权限（CAP_NET_ADMIN）。");
+    } else {
+        result.message = QString("错误：步骤“%1”失败：%2").arg(description, errorText(error));
+    }
+    return result;
+}
+
+} // namespace
+
+NetlinkBackend::NetlinkBackend(QObject *parent)
+    : NetworkBackend(parent)
+    , m_socket(new NetlinkSocket())
+    , m_notifier(nullptr)
+{
+}
+
+NetlinkBackend::~NetlinkBackend()
+{
+}
+
+QString NetlinkBackend::name() const
+{
+    return "netlink";
+}
+
+bool NetlinkBackend::hasPrivileges()
+{
+    // Also true for the mapped root of an unprivileged user namespace
+    return ::geteuid() == 0;
+}
+
+QVector<NetworkAdapter> NetlinkBackend::enumerateAdapters()
+{
+    QVector<NetworkAdapter> adapters;
+
+    for (const LinkInfo &link : dumpLinks(*m_socket)) {
+        if (link.flags & IFF_LOOPBACK) {
+            continue;
+        }
+
+        NetworkAdapter adapter;
+        adapter.name = link.name;
+        adapter.guid = linkGuid(link.hardwareAddress, link.name);
+        adapter.description = link.kind.isEmpty() ? QString("ethernet") : link.kind;
+        if (adapter.guid != link.name) {
+            adapter.description += QString(" %1").arg(adapter.guid);
+        }
+        adapters.append(adapter);
+    }
+
+    return adapters;
+}
+
+AdapterState NetlinkBackend::readState(const QString &adapterName)
+{
+    AdapterState state;
+    state.name = adapterName;
+
+    const int index = int(::if_nametoindex(adapterName.toLocal8Bit().constData()));
+    if (index == 0) {
+        return state;
+    }
+
+    for (const LinkInfo &link : dumpLinks(*m_socket)) {
+        if (link.index == index) {
+            return buildState(link, dumpAddresses(*m_socket, index),
+                              dumpGateways(*m_socket).value(index), readResolverServers());
+        }
+    }
+
+    return state;
+}
+
+QVector<AdapterState> NetlinkBackend::readAllStates()
+{
+    QVector<AdapterState> states;
+
+    // Three dumps cover every link
+    const QVector<LinkInfo> links = dumpLinks(*m_socket);
+    const QVector<AddressInfo> addresses = dumpAddresses(*m_socket, 0);
+    const QHash<int, QStringList> gateways = dumpGateways(*m_socket);
+    const QStringList dnsServers = readResolverServers();
+
+    for (const LinkInfo &link : links) {
+        if (link.flags & IFF_LOOPBACK) {
+            continue;
+        }
+        states.append(buildState(link, addresses, gateways.value(link.index), dnsServers));
+    }
+
+    return states;
+}
+
+BackendResult NetlinkBackend::setStatic(const QString &adapterName, const IpConfig &config,
+                                        const ProgressCallback &onProgress)
+{
+    BackendResult result;
+
+    const int index = int(::if_nametoindex(adapterName.toLocal8Bit().constData()));
+    if (index == 0) {
+        result.message = QString("错误：找不到网卡“%1”。").arg(adapterName);
+        return result;
+    }
+
+    quint32 address = 0;
+    quint32 gateway = 0;
+    int prefixLength = 0;
+    if (!parseAddress(config.ipAddress, address)) {
+        result.message = QString("错误：无效的IP地址“%1”。").arg(config.ipAddress);
+        return result;
+    }
+    if (!parsePrefix(config.subnetMask, prefixLength)) {
+        result.message = QString("错误：无效的子网掩码“%1”。").arg(config.subnetMask);
+        return result;
+    }
+    if (!config.gateway.isEmpty() && !parseAddress(config.gateway, gateway)) {
+        result.message = QString("错误：无效的默认网关“%1”。").arg(config.gateway);
+        return result;
+    }
+
+    const int totalSteps = 4;
+    auto progress = [&onProgress, totalSteps](int step, const QString &description) {
+        if (onProgress) {
+            onProgress(step, totalSteps, description);
+        }
+    };
+
+    // Add the new address before removing the old ones so the link is
+    // never left without an address
+    QString description = QString("设置IP地址 %1/%2").arg(config.ipAddress).arg(prefixLength);
+    progress(0, description);
+    int error = changeAddress(*m_socket, RTM_NEWADDR, index, address, prefixLength);
+    if (error != 0) {
+        return stepFailure(description, error);
+    }
+    progress(1, description);
+
+    description = QString("删除旧地址");
+    for (const AddressInfo &old : dumpAddresses(*m_socket, index)) {
+        if (old.address == address && old.prefixLength == prefixLength) {
+            continue;
+        }
+        error = changeAddress(*m_socket, RTM_DELADDR, index, old.address, old.prefixLength);
+        if (error != 0 && error != -EADDRNOTAVAIL) {
+            return stepFailure(description, error);
+        }
+    }
+    progress(2, description);
+
+    description = QString("启用网卡");
+    error = setLinkUp(*m_socket, index);
+    if (error != 0) {
+        return stepFailure(description, error);
+    }
+    progress(3, description);
+
+    // Matches netsh: a static address without a gateway clears it
+    description = gateway != 0 ? QString("设置默认网关 %1").arg(config.gateway)
+                               : QString("清除默认网关");
+    error = clearDefaultRoutes(*m_socket, index);
+    if (error == 0 && gateway != 0) {
+        error = addDefaultRoute(*m_socket, index, gateway);
+    }
+    if (error != 0) {
+        return stepFailure(description, error);
+    }
+    progress(4, description);
+
+    result.success = true;
+    result.message = QString("IP地址修改成功！");
+    if (!config.dns1.isEmpty() || !config.dns2.isEmpty()) {
+        result.message += QString("（DNS服务器需在系统解析器中配置，未修改。）");
+    }
+    return result;
+}
+
+BackendResult NetlinkBackend::setDhcp(const QString &adapterName, const ProgressCallback &onProgress)
+{
+    BackendResult result;
+
+    const int index = int(::if_nametoindex(adapterName.toLocal8Bit().constData()));
+    if (index == 0) {
+        result.message = QString("错误：找不到网卡“%1”。").arg(adapterName);
+        return result;
+    }
+
+    // The kernel has no DHCP client; dropping the static addresses hands
+    // the link back to whichever client manages it
+    const QString description = QString("删除静态地址");
+    if (onProgress) {
+        onProgress(0, 1, description);
+    }
+
+    for (const AddressInfo &old : dumpAddresses(*m_socket, index)) {
+        if (!old.permanent) {
+            continue;
+        }
+        const int error = changeAddress(*m_socket, RTM_DELADDR, index, old.address, old.prefixLength);
+        if (error != 0 && error != -EADDRNOTAVAIL) {
+            return stepFailure(description, error);
+        }
+    }
+
+    if (onProgress) {
+        onProgress(1, 1, description);
+    }
+
+    result.success = true;
+    result.message = QString("已删除静态地址，等待DHCP客户端分配地址。");
+    return result;
+}
+
+BackendResult NetlinkBackend::applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                                         const ProgressCallback &onProgress)
+{
+    const IpConfig &config = delta.target();
+    if (config.isDhcp) {
+        return setDhcp(adapterName, onProgress);
+    }
+    if (delta.has(ConfigDelta::Address)) {
+        BackendResult result = setStatic(adapterName, config, onProgress);
+        const QVector<InterfaceAddress> extra = delta.snapshot().addresses.mid(1);
+        if (!result.success || extra.isEmpty()) {
+            return result;
+        }
+
+        // A restored snapshot can have more than one address
+        const int index = int(::if_nametoindex(adapterName.toLocal8Bit().constData()));
+        for (const InterfaceAddress &address : extra) {
+            const QString description = QString("添加IP地址 %1/%2").arg(address.address)
+                                                                 .arg(address.prefixLength);
+            quint32 value = 0;
+            if (!parseAddress(address.address, value)) {
+                result.success = false;
+                result.message = QString("错误：无效的IP地址“%1”。").arg(address.address);
+                return result;
+            }
+            const int error = changeAddress(*m_socket, RTM_NEWADDR, index, value, address.prefixLength);
+            if (error != 0 && error != -EEXIST) {
+                return stepFailure(description, error);
+            }
+        }
+        return result;
+    }
+
+    BackendResult result;
+    const QString dnsNote = QString("（DNS服务器需在系统解析器中配置，未修改。）");
+
+    // Only the DNS servers differ, and those are not ours to change
+    if (!delta.has(ConfigDelta::Gateway)) {
+        result.success = true;
+        result.message = QString("IP地址和网关无需修改。") + dnsNote;
+        return result;
+    }
+
+    const int index = int(::if_nametoindex(adapterName.toLocal8Bit().constData()));
+    if (index == 0) {
+        result.message = QString("错误：找不到网卡“%1”。").arg(adapterName);
+        return result;
+    }
+
+    quint32 gateway = 0;
+    if (!config.gateway.isEmpty() && !parseAddress(config.gateway, gateway)) {
+        result.message = QString("错误：无效的默认网关“%1”。").arg(config.gateway);
+        return result;
+    }
+
+    // The address stays; only the default route is replaced
+    const QString description = gateway != 0 ? QString("设置默认网关 %1").arg(config.gateway)
+                                             : QString("清除默认网关");
+    if (onProgress) {
+        onProgress(0, 1, description);
+    }
+    int error = clearDefaultRoutes(*m_socket, index);
+    if (error == 0 && gateway != 0) {
+        error = addDefaultRoute(*m_socket, index, gateway);
+    }
+    if (error != 0) {
+        return stepFailure(description, error);
+    }
+    if (onProgress) {
+        onProgress(1, 1, description);
+    }
+
+    result.success = true;
+    result.message = QString("默认网关修改成功！");
+    if (delta.has(ConfigDelta::PrimaryDns) || delta.has(ConfigDelta::SecondaryDns)) {
+        result.message += dnsNote;
+    }
+    return result;
+}
+
+bool NetlinkBackend::canSetDns() const
+{
+    // resolv.conf belongs to whatever manages the resolver
+    return false;
+}
+
+bool NetlinkBackend::startWatching()
+{
+    if (m_notifier) {
+        return true;
+    }
+
+    m_watchSocket.reset(new NetlinkSocket(RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE));
+    if (!m_watchSocket->isValid()) {
+        m_watchSocket.reset();
+        return false;
+    }
+
+    m_notifier = new QSocketNotifier(m_watchSocket->fd(), QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &NetlinkBackend::onWatchReadable);
+    return true;
+}
+
+void NetlinkBackend::onWatchReadable()
+{
+    // The content does not matter; listeners re-read what they need
+    m_watchSocket->drain();
+    emit adaptersChanged();
+}
@@ -0,0 +1,47 @@
+#ifndef NETLINKBACKEND_H
+#define NETLINKBACKEND_H
+
+#include "NetworkBackend.h"
+#include <memory>
+
+class QSocketNotifier;
+class NetlinkSocket;
+
+// Linux backend talking rtnetlink directly: no processes are spawned, an
+// address change is a handful of syscalls. DNS servers are read from
+// /etc/resolv.conf but not written, since they are not a kernel setting.
+//
+// Runs unprivileged inside a user + network namespace, e.g.
+//     unshare -rn sh -c 'ip link add v0 type veth peer name v1 && ./ChangeIPTool'
+class NetlinkBackend : public NetworkBackend
+{
+    Q_OBJECT
+
+public:
+    explicit NetlinkBackend(QObject *parent = nullptr);
+    ~NetlinkBackend();
+
+    QString name() const override;
+    bool hasPrivileges() override;
+    QVector<NetworkAdapter> enumerateAdapters() override;
+    AdapterState readState(const QString &adapterName) override;
+    QVector<AdapterState> readAllStates() override;
+    BackendResult setStatic(const QString &adapterName, const IpConfig &config,
+                            const ProgressCallback &onProgress) override;
+    BackendResult setDhcp(const QString &adapterName,
+                          const ProgressCallback &onProgress) override;
+    BackendResult applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                             const ProgressCallback &onProgress) override;
+    bool canSetDns() const override;
+    bool startWatching() override;
+
+private slots:
+    void onWatchReadable();
+
+private:
+    std::unique_ptr<NetlinkSocket> m_socket;
+    std::unique_ptr<NetlinkSocket> m_watchSocket;
+    QSocketNotifier *m_notifier;
+};
+
+#endif // NETLINKBACKEND_H
@@ -0,0 +1,331 @@
+#include "NetshBackend.h"
+#include "NetworkAdapterManager.h"
+#include "ShellHost.h"
+#include "ApplyPlan.h"
+#include "CsvReader.h"
+#include "CommandTrace.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QDebug>
+
+namespace {
+
+QString quotePowerShell(const QString &value)
+{
+    QString escaped = value;
+    escaped.replace("'", "''");
+    return "'" + escaped + "'";
+}
+
+// ConvertTo-Json writes single values without an array around them
+QStringList toStringList(const QJsonValue &value)
+{
+    QStringList list;
+    if (value.isArray()) {
+        for (const QJsonValue &item : value.toArray()) {
+            if (!item.toString().isEmpty()) {
+                list << item.toString();
+            }
+        }
+    } else if (!value.toString().isEmpty()) {
+        list << value.toString();
+    }
+    return list;
+}
+
+} // namespace
+
+NetshBackend::NetshBackend(QObject *parent)
+    : NetworkBackend(parent)
+    , m_shell(new ShellHost(this))
+{
+}
+
+QString NetshBackend::name() const
+{
+    return "netsh";
+}
+
+bool NetshBackend::hasPrivileges()
+{
+    // A replayed session answers as the recorded (elevated) one did
+    if (CommandTrace::instance()->isReplaying()) {
+        return true;
+    }
+    return NetworkAdapterManager::isAdmin();
+}
+
+QVector<NetworkAdapter> NetshBackend::enumerateAdapters()
+{
+    QVector<NetworkAdapter> adapters;
+
+    // Run in the persistent shell session (output is already UTF-8)
+    ShellResult result = m_shell->execute("netsh.enumerateAdapters",
+        "Get-NetAdapter | Select-Object Name,InterfaceDescription,InterfaceGuid | ConvertTo-Csv -NoTypeInformation",
+        30000);
+
+    for (const NetworkAdapter &adapter : parseAdapterCsv(result.output)) {
+        // Skip virtual adapters
+        if (adapter.description.contains("Virtual", Qt::CaseInsensitive) ||
+            adapter.description.contains("Hyper-V", Qt::CaseInsensitive) ||
+            adapter.name.contains("Loopback", Qt::CaseInsensitive) ||
+            adapter.description.contains("Bluestacks", Qt::CaseInsensitive) ||
+            adapter.description.contains("VMware", Qt::CaseInsensitive) ||
+            adapter.description.contains("VirtualBox", Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        adapters.append(adapter);
+    }
+
+    return adapters;
+}
+
+QVector<NetworkAdapter> NetshBackend::parseAdapterCsv(const QByteArray &csv)
+{
+    QVector<NetworkAdapter> adapters;
+    CsvReader reader(csv);
+
+    // Columns are located by the header, so their order does not matter:
+    // "Name","InterfaceDescription","InterfaceGuid"
+    if (!reader.readRecord()) {
+        return adapters;
+    }
+    int nameColumn = -1;
+    int descriptionColumn = -1;
+    int guidColumn = -1;
+    for (int i = 0; i < reader.fieldCount(); ++i) {
+        const QByteArray header = reader.field(i).toByteArray();
+        if (header == "Name") {
+            nameColumn = i;
+        } else if (header == "InterfaceDescription") {
+            descriptionColumn = i;
+        } else if (header == "InterfaceGuid") {
+            guidColumn = i;
+        }
+    }
+    if (nameColumn < 0) {
+        qWarning() << "Unexpected Get-NetAdapter output header";
+        return adapters;
+    }
+
+    while (reader.readRecord()) {
+        if (reader.fieldCount() <= nameColumn) {
+            continue;
+        }
+
+        NetworkAdapter adapter;
+        adapter.name = reader.text(nameColumn).trimmed();
+        adapter.description = reader.text(descriptionColumn).trimmed();
+
+        // {12345678-1234-1234-1234-123456789abc} -> without braces
+        QByteArrayView guid = reader.field(guidColumn);
+        if (guid.startsWith('{') && guid.endsWith('}')) {
+            guid = guid.sliced(1, guid.size() - 2);
+        }
+        adapter.guid = QString::fromLatin1(guid);
+
+        if (!adapter.name.isEmpty()) {
+            adapters.append(adapter);
+        }
+    }
+
+    if (reader.hasError()) {
+        qWarning() << "Malformed CSV in Get-NetAdapter output";
+    }
+
+    return adapters;
+}
+
+AdapterState NetshBackend::readState(const QString &adapterName)
+{
+    AdapterState state;
+    state.name = adapterName;
+
+    // One request for everything the UI shows about an adapter; works even
+    // if the adapter is disconnected
+    const QString script = QString(
+        "$a = Get-NetAdapter -Name %1 -ErrorAction SilentlyContinue\n"
+        "if ($a) {\n"
+        "%2"
+        "    $state | ConvertTo-Json -Compress\n"
+        "}\n").arg(quotePowerShell(adapterName), stateScript());
+
+    ShellResult result = m_shell->execute("netsh.readState", script, 5000);
+    if (!result.ok) {
+        return state;
+    }
+
+    state = stateFromJson(QJsonDocument::fromJson(result.output.trimmed()).object());
+    state.name = adapterName;
+    return state;
+}
+
+QVector<AdapterState> NetshBackend::readAllStates()
+{
+    QVector<AdapterState> states;
+
+    // -InputObject keeps a single adapter wrapped in an array
+    const QString script = QString(
+        "$all = @(foreach ($a in Get-NetAdapter -ErrorAction SilentlyContinue) {\n"
+        "%1"
+        "    $state\n"
+        "})\n"
+        "ConvertTo-Json -InputObject $all -Compress\n").arg(stateScript());
+
+    ShellResult result = m_shell->execute("netsh.readAllStates", script, 10000);
+    if (!result.ok) {
+        return states;
+    }
+
+    const QJsonArray array = QJsonDocument::fromJson(result.output.trimmed()).array();
+    for (const QJsonValue &value : array) {
+        states.append(stateFromJson(value.toObject()));
+    }
+    return states;
+}
+
+QString NetshBackend::stateScript()
+{
+    // Builds $state for adapter $a
+    return QString(
+        "    $if = Get-NetIPInterface -InterfaceIndex $a.ifIndex -AddressFamily IPv4 -ErrorAction SilentlyContinue\n"
+        "    $state = [pscustomobject]@{\n"
+        "        Name = [string]$a.Name\n"
+        "        Guid = [string]$a.InterfaceGuid\n"
+        "        Up = ([string]$a.Status -eq 'Up')\n"
+        "        Dhcp = ([string]$if.Dhcp -eq 'Enabled')\n"
+        "        DnsDhcp = -not (Get-ItemProperty -Path \"HKLM:\\SYSTEM\\CurrentControlSet\\Services\\Tcpip\\Parameters\\Interfaces\\$($a.InterfaceGuid)\" -Name NameServer -ErrorAction SilentlyContinue).NameServer\n"
+        "        Addresses = @(Get-NetIPAddress -InterfaceIndex $a.ifIndex -AddressFamily IPv4 -ErrorAction SilentlyContinue | ForEach-Object { \"$($_.IPAddress)/$($_.PrefixLength)\" })\n"
+        "        Gateways = @(Get-NetRoute -InterfaceIndex $a.ifIndex -DestinationPrefix '0.0.0.0/0' -ErrorAction SilentlyContinue | ForEach-Object { $_.NextHop })\n"
+        "        Dns = @(Get-DnsClientServerAddress -InterfaceIndex $a.ifIndex -AddressFamily IPv4 -ErrorAction SilentlyContinue | ForEach-Object { $_.ServerAddresses })\n"
+        "    }\n");
+}
+
+AdapterState NetshBackend::stateFromJson(const QJsonObject &obj)
+{
+    AdapterState state;
+    state.name = obj["Name"].toString();
+    state.valid = !obj.isEmpty();
+
+    QString guid = obj["Guid"].toString();
+    guid.remove('{').remove('}');
+    state.guid = guid;
+    state.linkUp = obj["Up"].toBool();
+    state.isDhcp = obj["Dhcp"].toBool();
+    state.dnsFromDhcp = obj["DnsDhcp"].toBool();
+    state.gateways = toStringList(obj["Gateways"]);
+    state.dnsServers = toStringList(obj["Dns"]);
+
+    for (const QString &entry : toStringList(obj["Addresses"])) {
+        InterfaceAddress address;
+        address.address = entry.section('/', 0, 0);
+        address.prefixLength = entry.section('/', 1, 1).toInt();
+        state.addresses.append(address);
+    }
+
+    return state;
+}
+
+BackendResult NetshBackend::setStatic(const QString &adapterName, const IpConfig &config,
+                                      const ProgressCallback &onProgress)
+{
+    return executePlan(ApplyPlan::compile(adapterName, config), "IP地址修改成功！", onProgress);
+}
+
+BackendResult NetshBackend::setDhcp(const QString &adapterName, const ProgressCallback &onProgress)
+{
+    IpConfig config;
+    config.isDhcp = true;
+
+    return executePlan(ApplyPlan::compile(adapterName, config), "已成功切换到DHCP模式！", onProgress);
+}
+
+BackendResult NetshBackend::applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                                       const ProgressCallback &onProgress)
+{
+    return executePlan(ApplyPlan::compile(adapterName, delta),
+                       delta.target().isDhcp ? "已成功切换到DHCP模式！" : "IP地址修改成功！",
+                       onProgress);
+}
+
+bool NetshBackend::startWatching()
+{
+    // No change notifications through netsh
+    return false;
+}
+
+void NetshBackend::cancel()
+{
+    m_shell->cancel();
+}
+
+void NetshBackend::clearCancel()
+{
+    m_shell->clearCancel();
+}
+
+BackendResult NetshBackend::executePlan(const ApplyPlan &plan, const QString &successMessage,
+                                        const ProgressCallback &onProgress)
+{
+    BackendResult outcome;
+    const int totalSteps = plan.steps().size();
+
+    if (onProgress) {
+        onProgress(0, totalSteps, plan.steps().value(0).description);
+    }
+
+    // Progress lines arrive while the batch is still running
+    auto onStep = [&plan, &onProgress, totalSteps](const QByteArray &payload) {
+        const int index = payload.split(' ').value(0).toInt();
+        if (onProgress && index >= 0 && index < totalSteps) {
+            onProgress(index + 1, totalSteps, plan.steps()[index].description);
+        }
+    };
+
+    // The whole batch is one request to the shell host
+    ShellResult result = m_shell->execute("netsh.apply", plan.toShellScript(), 30000, onStep);
+
+    if (result.cancelled) {
+        outcome.cancelled = true;
+        outcome.message = QString("操作已取消，网卡可能只应用了部分配置。");
+        return outcome;
+    }
+
+    if (!result.ok) {
+        outcome.message = result.timedOut ? QString("错误：网络配置命令执行超时。")
+                                          : QString("错误：无法执行网络配置命令。");
+        return outcome;
+    }
+
+    const QVector<ApplyStepResult> results = plan.parseResults(result.output);
+
+    for (int i = 0; i < results.size(); ++i) {
+        const ApplyStepResult &step = results[i];
+        if (step.executed && step.exitCode == 0) {
+            continue;
+        }
+
+        // Check for errors
+        if (step.output.contains("请求的操作需要提升", Qt::CaseInsensitive) ||
+            step.output.contains("administrator", Qt::CaseInsensitive)) {
+            outcome.message = "错误：需要管理员权限。请以管理员身份运行此应用程序。";
+            return outcome;
+        }
+
+        const QString description = plan.steps()[i].description;
+        if (step.executed) {
+            qDebug() << "Apply step failed:" << description << step.exitCode << step.output;
+            outcome.message = QString("错误：步骤“%1”失败：%2").arg(description, step.output);
+        } else {
+            outcome.message = QString("错误：步骤“%1”未执行。").arg(description);
+        }
+        return outcome;
+    }
+
+    outcome.success = true;
+    outcome.message = successMessage;
+    return outcome;
+}
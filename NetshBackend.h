@@ -0,0 +1,47 @@
+#ifndef NETSHBACKEND_H
+#define NETSHBACKEND_H
+
+#include "NetworkBackend.h"
+
+class ShellHost;
+class ApplyPlan;
+class QJsonObject;
+
+// Windows backend: queries through PowerShell cmdlets and applies changes
+// with netsh, both running inside one persistent ShellHost session.
+class NetshBackend : public NetworkBackend
+{
+    Q_OBJECT
+
+public:
+    explicit NetshBackend(QObject *parent = nullptr);
+
+    QString name() const override;
+    bool hasPrivileges() override;
+    QVector<NetworkAdapter> enumerateAdapters() override;
+    AdapterState readState(const QString &adapterName) override;
+    QVector<AdapterState> readAllStates() override;
+    BackendResult setStatic(const QString &adapterName, const IpConfig &config,
+                            const ProgressCallback &onProgress) override;
+    BackendResult setDhcp(const QString &adapterName,
+                          const ProgressCallback &onProgress) override;
+    BackendResult applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                             const ProgressCallback &onProgress) override;
+    bool startWatching() override;
+
+    void cancel() override;
+    void clearCancel() override;
+
+    // Parses Get-NetAdapter | ConvertTo-Csv output; no filtering
+    static QVector<NetworkAdapter> parseAdapterCsv(const QByteArray &csv);
+
+private:
+    static QString stateScript();
+    static AdapterState stateFromJson(const QJsonObject &obj);
+    BackendResult executePlan(const ApplyPlan &plan, const QString &successMessage,
+                              const ProgressCallback &onProgress);
+
+    ShellHost *m_shell;
+};
+
+#endif // NETSHBACKEND_H
@@ -1,205 +1,753 @@
 #include "NetworkAdapterManager.h"
+#include "NetworkWorker.h"
+#include "CommandDeadlines.h"
+#include "CommandMetrics.h"
+#include <QElapsedTimer>
 #include <QProcess>
-#include <QRegularExpression>
+#include <QThread>
+#include <QTimer>
+#include <QTcpSocket>
+#include <QSet>
+#include <QMetaObject>
 #include <QDebug>
 #include <QCoreApplication>
 #include <QFileInfo>
 #include <QFile>
 
+#ifndef Q_OS_WIN
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int kProbeIntervalMs = 1000;  // Also how long one probe may take
+const quint16 kProbePort = 53;      // Routers usually listen; a refusal counts too
+
+} // namespace
+
 NetworkAdapterManager::NetworkAdapterManager(QObject *parent)
     : QObject(parent)
+    , m_thread(new QThread(this))
+    , m_worker(new NetworkWorker)
+    , m_scheduler(new ApplyScheduler(this))
+    , m_nextOperationId(1)
+    , m_refreshTimer(new QTimer(this))
+    , m_pollTimer(new QTimer(this))
+    , m_pollAdaptersId(0)
+    , m_pollStateId(0)
+    , m_canSetDns(true)
+    , m_probeTimer(new QTimer(this))
 {
+    qRegisterMetaType<NetworkAdapter>();
+    qRegisterMetaType<QVector<NetworkAdapter>>();
+    qRegisterMetaType<IpConfig>();
+    qRegisterMetaType<AdapterState>();
+    qRegisterMetaType<NetworkState>();
+    qRegisterMetaType<ConfigDelta>();
+
+    m_worker->moveToThread(m_thread);
+    connect(m_thread, &QThread::started, m_worker, &NetworkWorker::initialize);
+    connect(m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+
+    // Worker signals are queued back onto the GUI thread
+    connect(m_worker, &NetworkWorker::adaptersReady, this, &NetworkAdapterManager::onWorkerAdaptersReady);
+    connect(m_worker, &NetworkWorker::adapterStateReady, this, &NetworkAdapterManager::onWorkerAdapterStateReady);
+    connect(m_worker, &NetworkWorker::networkStateReady, this, &NetworkAdapterManager::onWorkerNetworkStateReady);
+    connect(m_worker, &NetworkWorker::adminStatusReady, this, &NetworkAdapterManager::adminStatusReady);
+    connect(m_worker, &NetworkWorker::adaptersChanged, this, &NetworkAdapterManager::onBackendChanged);
+    connect(m_worker, &NetworkWorker::watchingStarted, this, &NetworkAdapterManager::onWatchingStarted);
+    connect(m_worker, &NetworkWorker::backendReady, this, &NetworkAdapterManager::onBackendReady);
+
+    connect(m_scheduler, &ApplyScheduler::operationProgress, this, &NetworkAdapterManager::operationProgress);
+    connect(m_scheduler, &ApplyScheduler::operationFinished, this, &NetworkAdapterManager::onApplyFinished);
+    connect(m_scheduler, &ApplyScheduler::operationSuperseded, this, &NetworkAdapterManager::onApplySuperseded);
+    connect(m_scheduler, &ApplyScheduler::statsChanged, this, &NetworkAdapterManager::schedulerStatsChanged);
+    connect(m_scheduler, &ApplyScheduler::revertPrepared, this, &NetworkAdapterManager::onRevertPrepared);
+
+    // A single address change produces several netlink messages
+    m_refreshTimer->setSingleShot(true);
+    m_refreshTimer->setInterval(200);
+    connect(m_refreshTimer, &QTimer::timeout, this, &NetworkAdapterManager::refreshCache);
+
+    m_pollTimer->setInterval(5000);
+    connect(m_pollTimer, &QTimer::timeout, this, &NetworkAdapterManager::refreshCache);
+
+    m_probeTimer->setInterval(kProbeIntervalMs);
+    connect(m_probeTimer, &QTimer::timeout, this, &NetworkAdapterManager::probeReachability);
+
+    m_thread->setObjectName("NetworkWorker");
+    m_thread->start();
 }
 
-QVector<NetworkAdapter> NetworkAdapterManager::getAdapters() const
+NetworkAdapterManager::~NetworkAdapterManager()
 {
-    QVector<NetworkAdapter> adapters;
+    // Abort whatever is in flight so the threads can exit promptly. The
+    // window listening to us is already being destroyed, so stay quiet
+    blockSignals(true);
+    m_scheduler->cancelAll();
+    m_worker->cancelAll();
+    m_thread->quit();
+    m_thread->wait();
+}
 
-    // Execute PowerShell command directly with UTF-8 encoding
-    QProcess process;
-    process.start("powershell", QStringList()
-        << "-Command"
-        << "[Console]::OutputEncoding = [System.Text.Encoding]::UTF8; Get-NetAdapter | Select-Object Name,InterfaceDescription,InterfaceGuid | ConvertTo-Csv -NoTypeInformation");
-    process.waitForFinished(30000);
+quint64 NetworkAdapterManager::requestAdapters()
+{
+    const quint64 id = m_nextOperationId++;
+    NetworkWorker *worker = m_worker;
+    QMetaObject::invokeMethod(worker, [worker, id]() {
+        worker->fetchAdapters(id);
+    }, Qt::QueuedConnection);
+    return id;
+}
 
-    QByteArray outputBytes = process.readAllStandardOutput();
-    QString output = QString::fromUtf8(outputBytes);
-    QStringList lines = output.split('\n');
+quint64 NetworkAdapterManager::requestAdapterState(const QString &adapterName)
+{
+    const quint64 id = m_nextOperationId++;
+    NetworkWorker *worker = m_worker;
+    QMetaObject::invokeMethod(worker, [worker, id, adapterName]() {
+        worker->fetchAdapterState(id, adapterName);
+    }, Qt::QueuedConnection);
+    return id;
+}
 
-    // Skip the header line
-    if (lines.size() > 0) {
-        lines.removeFirst();
+quint64 NetworkAdapterManager::requestAdminStatus()
+{
+    const quint64 id = m_nextOperationId++;
+    NetworkWorker *worker = m_worker;
+    QMetaObject::invokeMethod(worker, [worker, id]() {
+        worker->checkAdmin(id);
+    }, Qt::QueuedConnection);
+    return id;
+}
+
+quint64 NetworkAdapterManager::applyConfig(const QString &adapterName, const IpConfig &config,
+                                           int confirmTimeoutSec)
+{
+    const quint64 id = m_nextOperationId++;
+    m_applyAdapters.insert(id, adapterName);
+
+    if (confirmTimeoutSec > 0) {
+        PendingRevert pending;
+        pending.adapterName = adapterName;
+        pending.timeoutSec = confirmTimeoutSec;
+        pending.started.start();
+
+        // Applying on top of an unconfirmed change: the new snapshot would
+        // be the unconfirmed state, so keep restoring the one before it.
+        // Its watchdog stops now, as its revert would run behind this apply;
+        // it resumes if this one is dropped without touching the adapter.
+        for (auto it = m_pendingReverts.begin(); it != m_pendingReverts.end(); ++it) {
+            if (it->adapterName == adapterName && (it->awaitingConfirm || it->replacedBy != 0)) {
+                pending.hasBaseline = true;
+                pending.baseline = it->revert.snapshot();
+                pending.replaces = it.key();
+                holdForReplacement(*it, id);
+                break;
+            }
+        }
+
+        m_pendingReverts.insert(id, pending);
     }
 
-    for (const QString &line : lines) {
-        QString trimmed = line.trimmed();
+    m_scheduler->submit(id, adapterName, config, confirmTimeoutSec > 0);
+    return id;
+}
 
-        if (trimmed.isEmpty()) {
-            continue;
+void NetworkAdapterManager::cancel(quint64 operationId)
+{
+    if (!m_scheduler->cancel(operationId)) {
+        m_worker->cancel(operationId);
+    }
+}
+
+void NetworkAdapterManager::confirmApply(quint64 operationId)
+{
+    auto it = m_pendingReverts.find(operationId);
+    if (it == m_pendingReverts.end() || (!it->awaitingConfirm && it->replacedBy == 0)) {
+        return;
+    }
+
+    finishConfirm(operationId, false);
+}
+
+void NetworkAdapterManager::finishConfirm(quint64 operationId, bool reachable)
+{
+    // Applies still running on top of it now start from a kept state
+    for (auto it = m_pendingReverts.begin(); it != m_pendingReverts.end(); ++it) {
+        if (it->replaces == operationId && it->hasBaseline) {
+            it->hasBaseline = false;
+            it->replaces = 0;
+        }
+    }
+
+    const qint64 elapsedMs = m_pendingReverts.value(operationId).started.elapsed();
+    dropPendingRevert(operationId);
+    emit applyConfirmed(operationId, reachable, elapsedMs);
+}
+
+bool NetworkAdapterManager::retireReplaced(quint64 operationId, const QString &revertReason)
+{
+    const QString adapterName = m_pendingReverts.value(operationId).adapterName;
+
+    // Older applies on the adapter still waiting, or held by this or a
+    // newer apply; this one's watchdog or revert covers them now. An empty
+    // reason closes them as confirmed, unless the user asked for a revert
+    // while they were held. Returns whether one did.
+    QList<quint64> replaced;
+    for (auto it = m_pendingReverts.cbegin(); it != m_pendingReverts.cend(); ++it) {
+        if (it.key() < operationId && it->adapterName == adapterName &&
+            (it->awaitingConfirm || it->replacedBy != 0)) {
+            replaced << it.key();
+        }
+    }
+
+    bool revertRequested = false;
+    for (quint64 id : replaced) {
+        const PendingRevert pending = m_pendingReverts.value(id);
+        dropPendingRevert(id);
+        if (pending.revertRequested) {
+            revertRequested = true;
+            emit revertStarted(id, revertReason.isEmpty() ? QString("用户要求还原") : revertReason);
+        } else if (revertReason.isEmpty()) {
+            emit applyConfirmed(id, false, pending.started.elapsed());
+        } else {
+            emit revertStarted(id, revertReason);
+        }
+    }
+    return revertRequested;
+}
+
+void NetworkAdapterManager::holdForReplacement(PendingRevert &pending, quint64 replacedBy)
+{
+    // Its confirmation box stays open; confirming it still keeps its state
+    if (pending.deadline) {
+        pending.remainingMs = pending.deadline->remainingTime();
+    } else if (pending.replacedBy == 0) {
+        pending.remainingMs = pending.timeoutSec * 1000;
+    }
+    pending.awaitingConfirm = false;
+    pending.replacedBy = replacedBy;
+    stopWatchdog(pending);
+}
+
+void NetworkAdapterManager::armWatchdog(quint64 operationId, int timeoutMs)
+{
+    auto it = m_pendingReverts.find(operationId);
+    if (it == m_pendingReverts.end()) {
+        return;
+    }
+
+    it->awaitingConfirm = true;
+    it->deadline = new QTimer(this);
+    it->deadline->setSingleShot(true);
+    connect(it->deadline, &QTimer::timeout, this, [this, operationId]() {
+        const auto pending = m_pendingReverts.constFind(operationId);
+        if (pending != m_pendingReverts.constEnd()) {
+            startRevert(operationId, QString("%1 秒内未确认").arg(pending->timeoutSec));
+        }
+    });
+    it->deadline->start(qMax(0, timeoutMs));
+
+    m_probeTimer->start();
+    emit confirmationRequired(operationId, it->adapterName, (timeoutMs + 999) / 1000);
+}
+
+void NetworkAdapterManager::revertApply(quint64 operationId)
+{
+    auto it = m_pendingReverts.find(operationId);
+    if (it == m_pendingReverts.end()) {
+        return;
+    }
+    if (it->awaitingConfirm) {
+        startRevert(operationId, QString("用户要求还原"));
+    } else if (it->replacedBy != 0) {
+        // Its revert would run behind the apply that holds it; that one
+        // restores the same state once it has finished
+        it->revertRequested = true;
+    }
+}
+
+QVector<NetworkAdapter> NetworkAdapterManager::adapters() const
+{
+    return m_adapters;
+}
+
+NetworkAdapter NetworkAdapterManager::adapterByGuid(const QString &guid) const
+{
+    for (const NetworkAdapter &adapter : m_adapters) {
+        if (adapter.guid == guid) {
+            return adapter;
+        }
+    }
+    return NetworkAdapter();
+}
+
+AdapterState NetworkAdapterManager::cachedState(const QString &adapterName) const
+{
+    const AdapterState *state = m_networkState.find(adapterName);
+    return state ? *state : AdapterState();
+}
+
+ConfigDelta NetworkAdapterManager::planApply(const QString &adapterName, const IpConfig &config) const
+{
+    return ConfigDelta::compute(cachedState(adapterName), config, m_canSetDns);
+}
+
+NetworkState NetworkAdapterManager::networkState() const
+{
+    return m_networkState;
+}
+
+quint64 NetworkAdapterManager::requestNetworkState()
+{
+    const quint64 id = m_nextOperationId++;
+    NetworkWorker *worker = m_worker;
+    QMetaObject::invokeMethod(worker, [worker, id]() {
+        worker->fetchNetworkState(id);
+    }, Qt::QueuedConnection);
+    return id;
+}
+
+ApplySchedulerStats NetworkAdapterManager::schedulerStats() const
+{
+    return m_scheduler->stats();
+}
+
+void NetworkAdapterManager::onWorkerAdaptersReady(quint64 operationId, const QVector<NetworkAdapter> &adapters)
+{
+    if (operationId == m_pollAdaptersId) {
+        m_pollAdaptersId = 0;
+    }
+
+    // Adapters are matched by GUID, so a rename shows up as an update
+    const QVector<NetworkAdapter> previous = m_adapters;
+    m_adapters = adapters;
+
+    QHash<QString, int> previousIndex;
+    for (int i = 0; i < previous.size(); ++i) {
+        previousIndex.insert(previous[i].guid, i);
+    }
+
+    QSet<QString> current;
+    for (const NetworkAdapter &adapter : adapters) {
+        current.insert(adapter.guid);
+    }
+
+    for (const NetworkAdapter &adapter : previous) {
+        if (!current.contains(adapter.guid)) {
+            removeCachedState(adapter.name);
+            emit adapterRemoved(adapter);
         }
+    }
 
-        // Parse CSV line: "以太网","Realtek PCIe GbE Family Controller","{12345678-1234-1234-1234-123456789abc}"
-        // Remove quotes and split by comma
-        QString unquoted = trimmed;
-        unquoted.remove('"');
-        QStringList parts = unquoted.split(',');
-
-        if (parts.size() >= 3) {
-            NetworkAdapter adapter;
-            adapter.name = parts[0].trimmed();
-            adapter.description = parts[1].trimmed();
-            QString guid = parts[2].trimmed();
-            guid.remove('{').remove('}');
-            adapter.guid = guid;
-
-            // Skip virtual adapters
-            if (adapter.description.contains("Virtual", Qt::CaseInsensitive) ||
-                adapter.description.contains("Hyper-V", Qt::CaseInsensitive) ||
-                adapter.name.contains("Loopback", Qt::CaseInsensitive) ||
-                adapter.description.contains("Bluestacks", Qt::CaseInsensitive) ||
-                adapter.description.contains("VMware", Qt::CaseInsensitive) ||
-                adapter.description.contains("VirtualBox", Qt::CaseInsensitive)) {
-                continue;
+    for (const NetworkAdapter &adapter : adapters) {
+        const int index = previousIndex.value(adapter.guid, -1);
+        if (index < 0) {
+            emit adapterAdded(adapter);
+        } else if (previous[index] != adapter) {
+            if (previous[index].name != adapter.name) {
+                removeCachedState(previous[index].name);
             }
+            emit adapterUpdated(adapter);
+        }
+    }
 
-            adapters.append(adapter);
+    emit adaptersReady(operationId, adapters);
+}
+
+void NetworkAdapterManager::onWorkerAdapterStateReady(quint64 operationId, const AdapterState &state)
+{
+    updateCachedState(state);
+    emit adapterStateReady(operationId, state);
+}
+
+void NetworkAdapterManager::onWorkerNetworkStateReady(quint64 operationId, const NetworkState &state)
+{
+    if (operationId == m_pollStateId) {
+        m_pollStateId = 0;
+    }
+
+    // Adapters missing from the snapshot are gone; adapterRemoved() is
+    // reported by the adapter list
+    for (int i = m_networkState.adapters.size() - 1; i >= 0; --i) {
+        if (!state.find(m_networkState.adapters[i].name)) {
+            m_networkState.adapters.removeAt(i);
         }
     }
 
-    return adapters;
+    for (const AdapterState &adapter : state.adapters) {
+        updateCachedState(adapter);
+    }
+    m_networkState.capturedAt = state.capturedAt;
+
+    emit networkStateReady(operationId, state);
 }
 
-bool NetworkAdapterManager::setIpAddress(const QString &adapterName,
-                                         const QString &ipAddress,
-                                         const QString &subnetMask,
-                                         const QString &gateway,
-                                         const QString &dns1,
-                                         const QString &dns2)
+void NetworkAdapterManager::updateCachedState(const AdapterState &state)
 {
-    // Check if running as administrator
-    if (!isAdmin()) {
-        emit operationFinished(false, "错误：需要管理员权限修改IP地址。请右键点击应用程序，选择\"以管理员身份运行\"。");
-        return false;
+    for (AdapterState &cached : m_networkState.adapters) {
+        if (cached.name == state.name) {
+            if (cached != state) {
+                cached = state;
+                emit adapterStateChanged(state);
+            }
+            return;
+        }
     }
 
-    // Set static IP
-    QString setIpCmd = QString("netsh interface ip set address \"%1\" static %2 %3")
-                          .arg(adapterName, ipAddress, subnetMask);
+    m_networkState.adapters.append(state);
+    emit adapterStateChanged(state);
+}
 
-    QString result = executeCommand(setIpCmd);
+void NetworkAdapterManager::removeCachedState(const QString &adapterName)
+{
+    for (int i = 0; i < m_networkState.adapters.size(); ++i) {
+        if (m_networkState.adapters[i].name == adapterName) {
+            m_networkState.adapters.removeAt(i);
+            return;
+        }
+    }
+}
 
-    // Check for errors
-    if (result.contains("请求的操作需要提升", Qt::CaseInsensitive) ||
-        result.contains("administrator", Qt::CaseInsensitive)) {
-        emit operationFinished(false, "错误：需要管理员权限。请以管理员身份运行此应用程序。");
-        return false;
+void NetworkAdapterManager::onApplyFinished(quint64 operationId, bool success, const QString &message)
+{
+    // Only the adapter that was changed needs to be read back
+    const QString adapterName = m_applyAdapters.take(operationId);
+    if (!adapterName.isEmpty()) {
+        requestAdapterState(adapterName);
     }
 
-    // Set gateway if provided
-    if (!gateway.isEmpty()) {
-        QString setGatewayCmd = QString("netsh interface ip set address \"%1\" static %2 %3 %4")
-                                    .arg(adapterName, ipAddress, subnetMask, gateway);
-        result = executeCommand(setGatewayCmd);
+    // Reverts are ours; callers only hear about them through revertFinished
+    if (m_revertOperations.contains(operationId)) {
+        finishRevert(operationId, success, message);
+        return;
+    }
+
+    auto it = m_pendingReverts.find(operationId);
+    if (it != m_pendingReverts.end()) {
+        if (it->prepared && it->hasBaseline) {
+            // Fixed from here on: the apply it replaces is retired below
+            it->revert = ConfigDelta::restore(it->revert.live(), it->baseline, m_canSetDns);
+            it->hasBaseline = false;
+        }
+
+        if (!it->prepared) {
+            // Stopped before touching the adapter; an unconfirmed apply it
+            // would have replaced resumes its own watchdog
+            dropPendingRevert(operationId);
+        } else if (it->revert.isEmpty()) {
+            // Back where the replaced apply started, so nothing to undo
+            retireReplaced(operationId, QString());
+            dropPendingRevert(operationId);
+        } else if (!success) {
+            // Whatever part of it ran is put back right away
+            retireReplaced(operationId, QString("新的设置应用失败"));
+            startRevert(operationId, QString("应用失败"));
+        } else if (retireReplaced(operationId, QString())) {
+            // Asked for while this one ran
+            startRevert(operationId, QString("用户要求还原"));
+        } else {
+            // Erasing from the hash may move the other entries
+            it = m_pendingReverts.find(operationId);
+
+            // A newer apply already queued on the adapter restores the
+            // same baseline, so this one waits for it instead of arming
+            for (auto newer = m_pendingReverts.begin(); newer != m_pendingReverts.end(); ++newer) {
+                if (newer.key() > operationId && newer->adapterName == it->adapterName && newer->hasBaseline) {
+                    newer->replaces = operationId;
+                    holdForReplacement(*it, newer.key());
+                    break;
+                }
+            }
+            if (it->replacedBy == 0) {
+                armWatchdog(operationId, it->timeoutSec * 1000);
+            }
+        }
     }
 
-    // Set DNS servers
-    if (!dns1.isEmpty()) {
-        QString setDnsCmd = QString("netsh interface ip set dns \"%1\" static %2")
-                                .arg(adapterName, dns1);
-        result = executeCommand(setDnsCmd);
+    emit operationFinished(operationId, success, message);
+}
+
+void NetworkAdapterManager::onApplySuperseded(quint64 operationId, quint64 replacedBy)
+{
+    m_applyAdapters.remove(operationId);
+
+    const auto revert = m_revertOperations.constFind(operationId);
+    if (revert != m_revertOperations.constEnd()) {
+        finishRevert(operationId, false, QString("还原被新的操作取代。"));
+        return;
     }
+    dropPendingRevert(operationId);
+
+    emit operationSuperseded(operationId, replacedBy);
+}
 
-    if (!dns2.isEmpty()) {
-        QString addDnsCmd = QString("netsh interface ip add dns \"%1\" %2")
-                                .arg(adapterName, dns2);
-        result = executeCommand(addDnsCmd);
+void NetworkAdapterManager::onRevertPrepared(quint64 operationId, const ConfigDelta &revert)
+{
+    auto it = m_pendingReverts.find(operationId);
+    if (it == m_pendingReverts.end()) {
+        return;
     }
 
-    emit operationFinished(true, "IP地址修改成功！");
-    return true;
+    // The baseline is only applied once this apply has finished, in case
+    // the apply it replaces is confirmed meanwhile
+    it->prepared = true;
+    it->revert = revert;
 }
 
-bool NetworkAdapterManager::setDhcp(const QString &adapterName)
+void NetworkAdapterManager::startRevert(quint64 operationId, const QString &reason)
 {
-    // Check if running as administrator
-    if (!isAdmin()) {
-        emit operationFinished(false, "错误：需要管理员权限切换到DHCP。请右键点击应用程序，选择\"以管理员身份运行\"。");
-        return false;
+    auto it = m_pendingReverts.find(operationId);
+    if (it == m_pendingReverts.end()) {
+        return;
     }
 
-    QString cmd = QString("netsh interface ip set address \"%1\" dhcp").arg(adapterName);
-    QString result = executeCommand(cmd);
+    it->awaitingConfirm = false;
+    stopWatchdog(*it);
 
-    // Check for errors
-    if (result.contains("请求的操作需要提升", Qt::CaseInsensitive) ||
-        result.contains("administrator", Qt::CaseInsensitive)) {
-        emit operationFinished(false, "错误：需要管理员权限。请以管理员身份运行此应用程序。");
-        return false;
+    qDebug() << "Reverting" << it->adapterName << "after operation" << operationId << ":" << reason;
+
+    const quint64 revertId = m_nextOperationId++;
+    it->revertOperation = revertId;
+    it->revertTimer.start();
+    m_applyAdapters.insert(revertId, it->adapterName);
+    m_revertOperations.insert(revertId, operationId);
+
+    emit revertStarted(operationId, reason);
+    m_scheduler->submitDelta(revertId, it->adapterName, it->revert);
+}
+
+void NetworkAdapterManager::finishRevert(quint64 revertOperation, bool success, const QString &message)
+{
+    const quint64 operationId = m_revertOperations.take(revertOperation);
+    const auto it = m_pendingReverts.constFind(operationId);
+    if (it == m_pendingReverts.constEnd()) {
+        return;
     }
 
-    QString dnsCmd = QString("netsh interface ip set dns \"%1\" dhcp").arg(adapterName);
-    result = executeCommand(dnsCmd);
+    const qint64 revertMs = it->revertTimer.elapsed();
+    const qint64 outageMs = it->started.elapsed();
+    qDebug() << "Revert of operation" << operationId << (success ? "succeeded" : "failed")
+             << "in" << revertMs << "ms; settings were off for" << outageMs << "ms";
 
-    emit operationFinished(true, "已成功切换到DHCP模式！");
-    return true;
+    dropPendingRevert(operationId);
+    emit revertFinished(operationId, success, message, revertMs, outageMs);
 }
 
-QString NetworkAdapterManager::getCurrentIpAddress(const QString &adapterName) const
+void NetworkAdapterManager::dropPendingRevert(quint64 operationId)
 {
-    // Use PowerShell to get IP address (works even if adapter is disconnected)
-    QProcess process;
-    QString psCommand = QString(
-        "Get-NetAdapter -Name '%1' | Get-NetIPAddress -AddressFamily IPv4 -ErrorAction SilentlyContinue | Select-Object -ExpandProperty IPAddress"
-    ).arg(adapterName);
+    auto it = m_pendingReverts.find(operationId);
+    if (it == m_pendingReverts.end()) {
+        return;
+    }
+
+    stopWatchdog(*it);
+    m_pendingReverts.erase(it);
 
-    process.start("powershell", QStringList() << "-Command" << psCommand);
-    process.waitForFinished(5000);  // Reduced timeout to 5 seconds
+    // Gone without retiring the apply it held, which picks up where it was
+    QList<quint64> held;
+    for (auto pending = m_pendingReverts.cbegin(); pending != m_pendingReverts.cend(); ++pending) {
+        if (pending->replacedBy == operationId) {
+            held << pending.key();
+        }
+    }
+    for (quint64 id : held) {
+        PendingRevert &pending = m_pendingReverts[id];
+        pending.replacedBy = 0;
+        if (pending.revertRequested) {
+            startRevert(id, QString("用户要求还原"));
+        } else {
+            armWatchdog(id, pending.remainingMs);
+        }
+    }
 
-    QString output = QString::fromUtf8(process.readAllStandardOutput()).trimmed();
+    bool awaiting = false;
+    for (auto pending = m_pendingReverts.cbegin(); pending != m_pendingReverts.cend(); ++pending) {
+        awaiting = awaiting || pending->awaitingConfirm;
+    }
+    if (!awaiting) {
+        m_probeTimer->stop();
+    }
+}
 
-    if (!output.isEmpty()) {
-        // Remove any quotes or extra whitespace
-        output.remove('"');
-        output = output.trimmed();
-        return output;
+void NetworkAdapterManager::stopWatchdog(PendingRevert &pending)
+{
+    // May run from the deadline's own timeout
+    if (pending.deadline) {
+        pending.deadline->stop();
+        pending.deadline->deleteLater();
+        pending.deadline = nullptr;
     }
+    discardProbe(pending);
+}
 
-    return QString();
+void NetworkAdapterManager::discardProbe(PendingRevert &pending)
+{
+    // Cleared first: abort() can report an error, which must not count
+    QTcpSocket *probe = pending.probe;
+    pending.probe = nullptr;
+    if (probe) {
+        probe->abort();
+        probe->deleteLater();
+    }
 }
 
-QString NetworkAdapterManager::executeCommand(const QString &command) const
+void NetworkAdapterManager::probeReachability()
 {
-    QProcess process;
-    process.start("cmd", QStringList() << "/c" << command);
-    process.waitForFinished(30000); // 30 seconds timeout
+    // By id: a probe that fails at once confirms or drops its entry
+    const QList<quint64> operations = m_pendingReverts.keys();
+    for (quint64 operationId : operations) {
+        auto it = m_pendingReverts.find(operationId);
+        if (it == m_pendingReverts.end() || !it->awaitingConfirm) {
+            continue;
+        }
 
-    QString output = QString::fromLocal8Bit(process.readAllStandardOutput());
-    QString error = QString::fromLocal8Bit(process.readAllStandardError());
+        // A probe still going after a whole interval counts as lost
+        discardProbe(*it);
 
-    if (!error.isEmpty()) {
-        // Log error only if it's critical
-        if (!output.isEmpty() && !output.contains("successfully", Qt::CaseInsensitive)) {
-            qDebug() << "Command error:" << error;
+        // The gateway the profile set, or for DHCP the one it handed out
+        QString gateway = it->revert.live().gateways.value(0);
+        if (gateway.isEmpty()) {
+            gateway = cachedState(it->adapterName).gateways.value(0);
+        }
+        if (gateway.isEmpty()) {
+            continue;   // Only the user can confirm
         }
+
+        QTcpSocket *socket = new QTcpSocket(this);
+        it->probe = socket;
+
+        auto onResult = [this, operationId, socket](bool reachable) {
+            auto pending = m_pendingReverts.find(operationId);
+            if (pending == m_pendingReverts.end() || pending->probe != socket) {
+                return;
+            }
+            discardProbe(*pending);
+
+            if (reachable) {
+                finishConfirm(operationId, true);
+            }
+        };
+        connect(socket, &QTcpSocket::connected, this, [onResult]() {
+            onResult(true);
+        });
+        connect(socket, &QAbstractSocket::errorOccurred, this, [onResult](QAbstractSocket::SocketError error) {
+            // Refused means the gateway answered
+            onResult(error == QAbstractSocket::ConnectionRefusedError);
+        });
+        socket->connectToHost(gateway, kProbePort);
+    }
+}
+
+void NetworkAdapterManager::onWatchingStarted(bool available)
+{
+    if (available) {
+        m_pollTimer->stop();
+    } else {
+        qDebug() << "Backend has no change notifications, polling adapters every"
+                 << m_pollTimer->interval() << "ms";
+        m_pollTimer->start();
     }
+}
+
+void NetworkAdapterManager::onBackendReady(bool canSetDns)
+{
+    m_canSetDns = canSetDns;
+}
 
-    return output;
+void NetworkAdapterManager::onBackendChanged()
+{
+    m_refreshTimer->start();
 }
 
-bool NetworkAdapterManager::runElevated(const QString &command)
+void NetworkAdapterManager::refreshCache()
 {
-    // This would be used if we need to run with admin privileges
-    // For now, the user needs to run the application as administrator
-    Q_UNUSED(command);
-    return false;
+    // Don't pile up polls behind a slow enumeration
+    if (m_pollAdaptersId != 0 || m_pollStateId != 0) {
+        return;
+    }
+
+    // One snapshot covers every adapter
+    m_pollAdaptersId = requestAdapters();
+    m_pollStateId = requestNetworkState();
+}
+
+bool NetworkAdapterManager::runElevated(const QString &program, const QStringList &arguments)
+{
+#ifdef Q_OS_WIN
+    // Start-Process -Verb RunAs shows the UAC prompt; whether the user
+    // accepted is only known once the process shows up. Start-Process
+    // joins -ArgumentList with spaces, so each argument is double-quoted
+    QStringList quoted;
+    for (const QString &argument : arguments) {
+        quoted << QString("'\"%1\"'").arg(QString(argument).replace("'", "''"));
+    }
+
+    QString command = QString("Start-Process -FilePath '%1' -Verb RunAs -WindowStyle Hidden")
+                          .arg(QString(program).replace("'", "''"));
+    if (!quoted.isEmpty()) {
+        command += QString(" -ArgumentList %1").arg(quoted.join(','));
+    }
+
+    CommandMetrics::instance()->recordSpawn("elevated");
+    return QProcess::startDetached("powershell",
+                                   QStringList() << "-NoProfile" << "-NonInteractive"
+                                                 << "-Command" << command);
+#else
+    // No elevation prompt elsewhere; the helper runs with our own rights,
+    // which is what testing the helper on Linux wants
+    CommandMetrics::instance()->recordSpawn("elevated");
+    return QProcess::startDetached(program, arguments);
+#endif
 }
 
 bool NetworkAdapterManager::isAdmin()
 {
+    // A process cannot gain or lose elevation while it runs, so check once
+    static const bool admin = checkAdmin();
+    return admin;
+}
+
+bool NetworkAdapterManager::checkAdmin()
+{
+#ifndef Q_OS_WIN
+    // Neither net session nor the Windows directory exist here, and
+    // C:\Windows\Temp\... would just be a file in the working directory
+    return ::geteuid() == 0;
+#else
     // Check if running as administrator on Windows
+    CommandDeadlines *deadlines = CommandDeadlines::instance();
     QProcess process;
-    process.start("net", QStringList() << "session");
-    process.waitForFinished(3000);
+    bool finished = false;
+    for (int attempt = 0; !finished; ++attempt) {
+        const int deadlineMs = deadlines->timeoutMs("process.netSession", 3000, attempt);
+        QElapsedTimer timer;
+        timer.start();
+        process.start("net", QStringList() << "session");
+        CommandMetrics::instance()->recordSpawn("process.netSession");
+        finished = process.waitForFinished(deadlineMs);
+        if (!finished && process.error() == QProcess::FailedToStart) {
+            // Not a timeout, and starting again will not help
+            qWarning() << "Could not start net session:" << process.errorString();
+            CommandMetrics::instance()->record("process.netSession", timer, CommandMetrics::Failed);
+            break;
+        }
+        CommandMetrics::instance()->record("process.netSession", timer,
+                                           finished ? CommandMetrics::Succeeded : CommandMetrics::TimedOut);
+        if (finished) {
+            deadlines->recordLatency("process.netSession", timer.nsecsElapsed() / 1000);
+            break;
+        }
+
+        process.kill();
+        process.waitForFinished(1000);
+        const bool retrying = attempt < deadlines->maxRetries("process.netSession");
+        deadlines->recordTimeout("process.netSession", deadlineMs, attempt, retrying);
+        if (!retrying) {
+            break;
+        }
+        QThread::msleep(deadlines->retryDelayMs(attempt));
+    }
 
     QString output = QString::fromLocal8Bit(process.readAllStandardOutput());
     QString error = QString::fromLocal8Bit(process.readAllStandardError());
@@ -226,4 +774,5 @@ bool NetworkAdapterManager::isAdmin()
     }
 
     return false;  // Failed to write - not admin
+#endif
 }
@@ -2,38 +2,177 @@
 #define NETWORKADAPTERMANAGER_H
 
 #include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QString>
 #include <QVector>
+#include "IpConfigManager.h"
+#include "NetworkBackend.h"
+#include "ApplyScheduler.h"
+#include "ConfigDelta.h"
 
-struct NetworkAdapter {
-    QString name;
-    QString description;
-    QString guid;
-};
+class QTcpSocket;
+class QThread;
+class QTimer;
+class NetworkWorker;
 
+// Asynchronous front end for all adapter queries and changes. Every request
+// returns an operation id immediately and runs on a worker thread against
+// the platform's NetworkBackend; results are delivered through the signals
+// below on the caller's thread.
+//
+// cancel() drops a request that has not started yet and aborts one that is
+// running. Cancelled queries produce no result signal; a cancelled
+// applyConfig() still finishes with operationFinished(id, false, ...).
+//
+// Queries share one worker thread. applyConfig() goes through an
+// ApplyScheduler instead: serialized per adapter, parallel across
+// adapters, and a newer request for an adapter replaces one that has not
+// started yet (operationSuperseded).
+//
+// applyConfig() with a confirmation timeout guards against a profile that
+// cuts the machine off: the worker snapshots the adapter and hands back the
+// inverse delta before changing anything. After a successful apply the
+// manager waits for confirmApply(), probing the gateway meanwhile (a TCP
+// connect; an answer of any kind, even a refusal, counts as reachable).
+// Without a confirmation inside the timeout, the precomputed revert is
+// submitted as one batched operation. A failed or cancelled apply is
+// reverted straight away. Quitting while a watchdog runs keeps the new
+// settings. A second apply on an adapter awaiting confirmation stops that
+// watchdog at once, keeping only the state it would restore. Once the
+// second apply has changed the adapter it closes the first one, and its
+// revert goes back to the state before both; if it is dropped before
+// that, the first watchdog resumes with the time it had left.
+//
+// The manager also keeps a cache of the adapter list and a NetworkState
+// snapshot of every adapter's addresses, gateways, DNS servers, DHCP flag
+// and link state, so reading them is free. Both are kept current from the
+// backend's change notifications, or by a diff-based poller when the
+// backend has none, and differences are reported through
+// adapterAdded/Removed/Updated and adapterStateChanged, so views never
+// need to rebuild from scratch.
 class NetworkAdapterManager : public QObject
 {
     Q_OBJECT
 
 public:
     explicit NetworkAdapterManager(QObject *parent = nullptr);
+    ~NetworkAdapterManager();
+
+    quint64 requestAdapters();
+    quint64 requestAdapterState(const QString &adapterName);
+    quint64 requestNetworkState();
+    quint64 requestAdminStatus();
+    // confirmTimeoutSec > 0 arms the revert watchdog
+    quint64 applyConfig(const QString &adapterName, const IpConfig &config, int confirmTimeoutSec = 0);
+    void cancel(quint64 operationId);
+
+    // Keeps the settings of an apply waiting for confirmation
+    void confirmApply(quint64 operationId);
+    // Restores the snapshot now instead of waiting for the timeout
+    void revertApply(quint64 operationId);
 
-    QVector<NetworkAdapter> getAdapters() const;
-    bool setIpAddress(const QString &adapterName, const QString &ipAddress,
-                      const QString &subnetMask, const QString &gateway,
-                      const QString &dns1, const QString &dns2);
-    bool setDhcp(const QString &adapterName);
-    QString getCurrentIpAddress(const QString &adapterName) const;
+    QVector<NetworkAdapter> adapters() const;
+    NetworkAdapter adapterByGuid(const QString &guid) const;
+    AdapterState cachedState(const QString &adapterName) const;
+    // What applyConfig() would change, judged from the cached state. The
+    // worker recomputes it against the live state before applying.
+    ConfigDelta planApply(const QString &adapterName, const IpConfig &config) const;
+    NetworkState networkState() const;
+    ApplySchedulerStats schedulerStats() const;
+
+    // Cached after the first call; safe from any thread
     static bool isAdmin();
 
-    static bool runElevated(const QString &command);
+    // Starts program with administrator rights (UAC prompt on Windows)
+    static bool runElevated(const QString &program, const QStringList &arguments);
 
 signals:
-    void operationFinished(bool success, const QString &message);
+    void adaptersReady(quint64 operationId, const QVector<NetworkAdapter> &adapters);
+    void adapterStateReady(quint64 operationId, const AdapterState &state);
+    void networkStateReady(quint64 operationId, const NetworkState &state);
+    void adminStatusReady(quint64 operationId, bool isAdmin);
+    void operationProgress(quint64 operationId, int step, int totalSteps, const QString &description);
+    void operationFinished(quint64 operationId, bool success, const QString &message);
+    void operationSuperseded(quint64 operationId, quint64 replacedBy);
+    void schedulerStatsChanged();
+
+    // Revert watchdog; elapsed times count from when the apply was submitted
+    void confirmationRequired(quint64 operationId, const QString &adapterName, int timeoutSec);
+    void applyConfirmed(quint64 operationId, bool reachable, qint64 elapsedMs);
+    void revertStarted(quint64 operationId, const QString &reason);
+    void revertFinished(quint64 operationId, bool success, const QString &message,
+                        qint64 revertMs, qint64 outageMs);
+
+    void adapterAdded(const NetworkAdapter &adapter);
+    void adapterRemoved(const NetworkAdapter &adapter);
+    void adapterUpdated(const NetworkAdapter &adapter);
+    void adapterStateChanged(const AdapterState &state);
+
+private slots:
+    void onWorkerAdaptersReady(quint64 operationId, const QVector<NetworkAdapter> &adapters);
+    void onWorkerAdapterStateReady(quint64 operationId, const AdapterState &state);
+    void onWorkerNetworkStateReady(quint64 operationId, const NetworkState &state);
+    void onApplyFinished(quint64 operationId, bool success, const QString &message);
+    void onApplySuperseded(quint64 operationId, quint64 replacedBy);
+    void onRevertPrepared(quint64 operationId, const ConfigDelta &revert);
+    void probeReachability();
+    void onWatchingStarted(bool available);
+    void onBackendReady(bool canSetDns);
+    void onBackendChanged();
+    void refreshCache();
 
 private:
-    QString executeCommand(const QString &command) const;
-    NetworkAdapter parseAdapterInfo(const QString &info) const;
+    struct PendingRevert {
+        QString adapterName;
+        int timeoutSec = 0;
+        ConfigDelta revert;
+        bool prepared = false;
+        bool hasBaseline = false;   // Replaces an unconfirmed apply
+        AdapterState baseline;      // The snapshot that one would have restored
+        quint64 replaces = 0;       // That apply, until this one is armed
+        bool awaitingConfirm = false;
+        quint64 replacedBy = 0;     // A newer apply holds this one's baseline
+        int remainingMs = 0;        // Left on the deadline when it was held
+        bool revertRequested = false;   // While held
+        QElapsedTimer started;      // Apply submitted
+        QTimer *deadline = nullptr;
+        QTcpSocket *probe = nullptr;
+        quint64 revertOperation = 0;
+        QElapsedTimer revertTimer;
+    };
+
+    static bool checkAdmin();
+    void startRevert(quint64 operationId, const QString &reason);
+    void finishRevert(quint64 revertOperation, bool success, const QString &message);
+    void finishConfirm(quint64 operationId, bool reachable);
+    void dropPendingRevert(quint64 operationId);
+    bool retireReplaced(quint64 operationId, const QString &revertReason);
+    void holdForReplacement(PendingRevert &pending, quint64 replacedBy);
+    void armWatchdog(quint64 operationId, int timeoutMs);
+    void stopWatchdog(PendingRevert &pending);
+    void discardProbe(PendingRevert &pending);
+    void updateCachedState(const AdapterState &state);
+    void removeCachedState(const QString &adapterName);
+
+    QThread *m_thread;
+    NetworkWorker *m_worker;
+    ApplyScheduler *m_scheduler;
+    quint64 m_nextOperationId;
+
+    // Adapter cache, in enumeration order
+    QVector<NetworkAdapter> m_adapters;
+    NetworkState m_networkState;
+    QHash<quint64, QString> m_applyAdapters;    // Apply operation -> adapter name
+    QTimer *m_refreshTimer;                     // Coalesces bursts of notifications
+    QTimer *m_pollTimer;                        // Only without notifications
+    quint64 m_pollAdaptersId;
+    quint64 m_pollStateId;
+    bool m_canSetDns;                           // Reported by the backend at startup
+
+    QHash<quint64, PendingRevert> m_pendingReverts;  // By apply operation
+    QHash<quint64, quint64> m_revertOperations;      // Revert operation -> apply operation
+    QTimer *m_probeTimer;                            // While any apply awaits confirmation
 };
 
 #endif // NETWORKADAPTERMANAGER_H
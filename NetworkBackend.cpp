@@ -0,0 +1,96 @@
+#include "NetworkBackend.h"
+#include "ConfigDelta.h"
+#include "NetshBackend.h"
+#include "HelperBackend.h"
+#include "FakeBackend.h"
+#include "CommandTrace.h"
+#include "NetworkAdapterManager.h"
+#ifdef Q_OS_LINUX
+#include "NetlinkBackend.h"
+#endif
+#include <QDebug>
+
+NetworkBackend::NetworkBackend(QObject *parent)
+    : QObject(parent)
+{
+}
+
+NetworkBackend::~NetworkBackend()
+{
+}
+
+NetworkBackend *NetworkBackend::create(QObject *parent)
+{
+    QString requested = qEnvironmentVariable("IPTOOL_BACKEND").toLower();
+
+    // Traces are netsh sessions, wherever they are replayed
+    if (requested.isEmpty() && CommandTrace::instance()->isReplaying()) {
+        requested = "netsh";
+    }
+
+#ifdef Q_OS_WIN
+    // An unprivileged GUI hands changes to the elevated helper
+    if (requested.isEmpty() && !NetworkAdapterManager::isAdmin()) {
+        requested = "helper";
+    }
+#endif
+
+    if (requested == "helper") {
+        return new HelperBackend(parent);
+    }
+
+    return createLocal(requested, parent);
+}
+
+NetworkBackend *NetworkBackend::createLocal(const QString &name, QObject *parent)
+{
+    QString requested = name.toLower();
+
+    if (requested.isEmpty()) {
+#ifdef Q_OS_LINUX
+        requested = "netlink";
+#else
+        requested = "netsh";
+#endif
+    }
+
+#ifdef Q_OS_LINUX
+    if (requested == "netlink") {
+        return new NetlinkBackend(parent);
+    }
+#endif
+
+    if (requested == "fake") {
+        return new FakeBackend(parent);
+    }
+
+    if (requested != "netsh") {
+        qWarning() << "Unknown or unsupported network backend" << requested << "- using netsh";
+    }
+
+    return new NetshBackend(parent);
+}
+
+QVector<AdapterState> NetworkBackend::readAllStates()
+{
+    QVector<AdapterState> states;
+    for (const NetworkAdapter &adapter : enumerateAdapters()) {
+        states.append(readState(adapter.name));
+    }
+    return states;
+}
+
+BackendResult NetworkBackend::applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                                         const ProgressCallback &onProgress)
+{
+    return delta.target().isDhcp ? setDhcp(adapterName, onProgress)
+                                 : setStatic(adapterName, delta.target(), onProgress);
+}
+
+void NetworkBackend::cancel()
+{
+}
+
+void NetworkBackend::clearCancel()
+{
+}
@@ -0,0 +1,150 @@
+#ifndef NETWORKBACKEND_H
+#define NETWORKBACKEND_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+#include "IpConfigManager.h"
+
+class ConfigDelta;
+
+struct NetworkAdapter {
+    QString name;
+    QString description;
+    QString guid;
+};
+
+Q_DECLARE_METATYPE(NetworkAdapter)
+
+inline bool operator==(const NetworkAdapter &a, const NetworkAdapter &b)
+{
+    return a.name == b.name && a.description == b.description && a.guid == b.guid;
+}
+
+inline bool operator!=(const NetworkAdapter &a, const NetworkAdapter &b)
+{
+    return !(a == b);
+}
+
+struct InterfaceAddress {
+    QString address;
+    int prefixLength = 0;
+};
+
+inline bool operator==(const InterfaceAddress &a, const InterfaceAddress &b)
+{
+    return a.address == b.address && a.prefixLength == b.prefixLength;
+}
+
+struct AdapterState {
+    QString name;
+    QString guid;
+    QVector<InterfaceAddress> addresses;  // IPv4 only
+    QStringList gateways;
+    QStringList dnsServers;
+    bool isDhcp = false;
+    bool dnsFromDhcp = false;  // DNS servers are assigned by DHCP, not static
+    bool linkUp = false;
+    bool valid = false;        // False if the backend could not read the adapter
+};
+
+Q_DECLARE_METATYPE(AdapterState)
+
+inline bool operator==(const AdapterState &a, const AdapterState &b)
+{
+    return a.name == b.name && a.guid == b.guid && a.addresses == b.addresses &&
+           a.gateways == b.gateways && a.dnsServers == b.dnsServers &&
+           a.isDhcp == b.isDhcp && a.dnsFromDhcp == b.dnsFromDhcp && a.linkUp == b.linkUp &&
+           a.valid == b.valid;
+}
+
+inline bool operator!=(const AdapterState &a, const AdapterState &b)
+{
+    return !(a == b);
+}
+
+// Every adapter's state from one backend call
+struct NetworkState {
+    QVector<AdapterState> adapters;
+    QDateTime capturedAt;  // UTC; invalid if never captured
+
+    bool isValid() const { return capturedAt.isValid(); }
+
+    const AdapterState *find(const QString &adapterName) const
+    {
+        for (const AdapterState &state : adapters) {
+            if (state.name == adapterName) {
+                return &state;
+            }
+        }
+        return nullptr;
+    }
+};
+
+Q_DECLARE_METATYPE(NetworkState)
+
+struct BackendResult {
+    bool success = false;
+    bool cancelled = false;
+    QString message;
+};
+
+// Operating system access used by NetworkWorker. Implementations are
+// created on the worker thread and are only called from it, except for
+// cancel() and clearCancel() which must be thread-safe.
+//
+// Backends are selected by NetworkBackend::create(): netsh/PowerShell on
+// Windows, rtnetlink on Linux. An unprivileged GUI on Windows goes through
+// the privileged helper instead. IPTOOL_BACKEND=netsh|netlink|helper|fake
+// overrides the default.
+class NetworkBackend : public QObject
+{
+    Q_OBJECT
+
+public:
+    using ProgressCallback = std::function<void(int step, int totalSteps, const QString &description)>;
+
+    explicit NetworkBackend(QObject *parent = nullptr);
+    virtual ~NetworkBackend();
+
+    static NetworkBackend *create(QObject *parent = nullptr);
+    // A backend that talks to the OS in this process; empty name = default
+    static NetworkBackend *createLocal(const QString &name, QObject *parent = nullptr);
+
+    virtual QString name() const = 0;
+    virtual bool hasPrivileges() = 0;
+    virtual QVector<NetworkAdapter> enumerateAdapters() = 0;
+    // A state with only the name and valid unset if the adapter is gone or
+    // the query failed
+    virtual AdapterState readState(const QString &adapterName) = 0;
+    // All adapters at once. The default reads them one by one; backends
+    // override it with a single query.
+    virtual QVector<AdapterState> readAllStates();
+    virtual BackendResult setStatic(const QString &adapterName, const IpConfig &config,
+                                    const ProgressCallback &onProgress) = 0;
+    virtual BackendResult setDhcp(const QString &adapterName,
+                                  const ProgressCallback &onProgress) = 0;
+    // Applies only the changes in delta, which is never empty. The default
+    // applies the whole target through setStatic()/setDhcp(), so of a
+    // ConfigDelta::restore() only what an IpConfig can hold comes back.
+    virtual BackendResult applyDelta(const QString &adapterName, const ConfigDelta &delta,
+                                     const ProgressCallback &onProgress);
+    // False if the backend only reads DNS servers and never writes them;
+    // deltas for it then leave DNS out
+    virtual bool canSetDns() const { return true; }
+
+    // Starts emitting adaptersChanged() when links or addresses change.
+    // Returns false if the backend has no change notifications.
+    virtual bool startWatching() = 0;
+
+    virtual void cancel();
+    virtual void clearCancel();
+
+signals:
+    void adaptersChanged();
+};
+
+#endif // NETWORKBACKEND_H
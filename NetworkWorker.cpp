@@ -0,0 +1,224 @@
+#include "NetworkWorker.h"
+#include "ConfigDelta.h"
+#include "CommandMetrics.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QDebug>
+
+NetworkWorker::NetworkWorker(QObject *parent)
+    : QObject(parent)
+    , m_backend(nullptr)
+    , m_currentOperation(0)
+    , m_cancelAll(false)
+{
+}
+
+void NetworkWorker::initialize()
+{
+    NetworkBackend *network = backend();
+    qDebug() << "Using network backend" << network->name();
+    emit backendReady(network->canSetDns());
+
+    connect(network, &NetworkBackend::adaptersChanged, this, &NetworkWorker::adaptersChanged);
+    emit watchingStarted(network->startWatching());
+}
+
+void NetworkWorker::fetchAdapters(quint64 operationId)
+{
+    if (!beginOperation(operationId)) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QVector<NetworkAdapter> adapters = backend()->enumerateAdapters();
+    endOperation();
+    CommandMetrics::instance()->record("worker.enumerateAdapters", timer, CommandMetrics::Succeeded);
+
+    emit adaptersReady(operationId, adapters);
+}
+
+void NetworkWorker::fetchAdapterState(quint64 operationId, const QString &adapterName)
+{
+    if (!beginOperation(operationId)) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const AdapterState state = backend()->readState(adapterName);
+    endOperation();
+    CommandMetrics::instance()->record("worker.readState", timer, CommandMetrics::Succeeded);
+
+    emit adapterStateReady(operationId, state);
+}
+
+void NetworkWorker::fetchNetworkState(quint64 operationId)
+{
+    if (!beginOperation(operationId)) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    NetworkState state;
+    state.adapters = backend()->readAllStates();
+    state.capturedAt = QDateTime::currentDateTimeUtc();
+    endOperation();
+    CommandMetrics::instance()->record("worker.readAllStates", timer, CommandMetrics::Succeeded);
+
+    emit networkStateReady(operationId, state);
+}
+
+void NetworkWorker::checkAdmin(quint64 operationId)
+{
+    if (!beginOperation(operationId)) {
+        return;
+    }
+
+    const bool admin = backend()->hasPrivileges();
+    endOperation();
+
+    emit adminStatusReady(operationId, admin);
+}
+
+void NetworkWorker::applyConfig(quint64 operationId, const QString &adapterName, const IpConfig &config,
+                                bool captureRevert)
+{
+    if (!beginOperation(operationId)) {
+        emit operationFinished(operationId, false, QString("操作已取消。"));
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Only what differs from the live state is changed; a profile that is
+    // already in effect costs one read and needs no privileges
+    const AdapterState live = backend()->readState(adapterName);
+    if (captureRevert && !live.valid) {
+        // Without a snapshot there is nothing to go back to
+        endOperation();
+        CommandMetrics::instance()->record("worker.apply", timer, CommandMetrics::Failed);
+        emit operationFinished(operationId, false,
+            QString("错误：无法读取网卡“%1”的当前设置，超时后将无法还原，未做任何修改。").arg(adapterName));
+        return;
+    }
+    const ConfigDelta delta = ConfigDelta::compute(live, config, backend()->canSetDns());
+    if (delta.isEmpty()) {
+        endOperation();
+        CommandMetrics::instance()->record("worker.apply.unchanged", timer, CommandMetrics::Succeeded);
+        emit operationFinished(operationId, true, QString("当前设置与配置一致，无需修改。"));
+        return;
+    }
+
+    // Check if running as administrator
+    if (!backend()->hasPrivileges()) {
+        endOperation();
+        emit operationFinished(operationId, false, config.isDhcp
+            ? QString("错误：需要管理员权限切换到DHCP。请右键点击应用程序，选择\"以管理员身份运行\"。")
+            : QString("错误：需要管理员权限修改IP地址。请右键点击应用程序，选择\"以管理员身份运行\"。"));
+        return;
+    }
+
+    // The state just read is the snapshot; its inverse is ready before
+    // anything changes, so a revert never has to query first
+    if (captureRevert) {
+        emit revertPrepared(operationId, delta.inverse());
+    }
+
+    auto onProgress = [this, operationId](int step, int totalSteps, const QString &description) {
+        emit operationProgress(operationId, step, totalSteps, description);
+    };
+
+    const BackendResult result = backend()->applyDelta(adapterName, delta, onProgress);
+    endOperation();
+    CommandMetrics::instance()->record("worker.apply", timer,
+                                       result.cancelled ? CommandMetrics::Cancelled
+                                       : result.success ? CommandMetrics::Succeeded
+                                                        : CommandMetrics::Failed);
+
+    emit operationFinished(operationId, result.success, result.message);
+}
+
+void NetworkWorker::applyDelta(quint64 operationId, const QString &adapterName, const ConfigDelta &delta)
+{
+    if (!beginOperation(operationId)) {
+        emit operationFinished(operationId, false, QString("操作已取消。"));
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!backend()->hasPrivileges()) {
+        endOperation();
+        emit operationFinished(operationId, false,
+            QString("错误：需要管理员权限修改IP地址。请右键点击应用程序，选择\"以管理员身份运行\"。"));
+        return;
+    }
+
+    auto onProgress = [this, operationId](int step, int totalSteps, const QString &description) {
+        emit operationProgress(operationId, step, totalSteps, description);
+    };
+
+    const BackendResult result = backend()->applyDelta(adapterName, delta, onProgress);
+    endOperation();
+    CommandMetrics::instance()->record("worker.revert", timer,
+                                       result.cancelled ? CommandMetrics::Cancelled
+                                       : result.success ? CommandMetrics::Succeeded
+                                                        : CommandMetrics::Failed);
+
+    emit operationFinished(operationId, result.success, result.message);
+}
+
+void NetworkWorker::cancel(quint64 operationId)
+{
+    QMutexLocker locker(&m_mutex);
+    if (operationId == m_currentOperation) {
+        if (m_backend) {
+            m_backend->cancel();
+        }
+    } else {
+        m_cancelled.insert(operationId);
+    }
+}
+
+void NetworkWorker::cancelAll()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cancelAll = true;
+    if (m_currentOperation != 0 && m_backend) {
+        m_backend->cancel();
+    }
+}
+
+bool NetworkWorker::beginOperation(quint64 operationId)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_cancelAll || m_cancelled.remove(operationId)) {
+        return false;
+    }
+
+    m_currentOperation = operationId;
+    if (m_backend) {
+        m_backend->clearCancel();
+    }
+    return true;
+}
+
+void NetworkWorker::endOperation()
+{
+    QMutexLocker locker(&m_mutex);
+    m_currentOperation = 0;
+}
+
+NetworkBackend *NetworkWorker::backend()
+{
+    if (!m_backend) {
+        NetworkBackend *created = NetworkBackend::create(this);
+        QMutexLocker locker(&m_mutex);
+        m_backend = created;
+    }
+    return m_backend;
+}
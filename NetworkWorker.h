@@ -0,0 +1,65 @@
+#ifndef NETWORKWORKER_H
+#define NETWORKWORKER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include "IpConfigManager.h"
+#include "NetworkBackend.h"
+#include "ConfigDelta.h"
+
+// Runs the blocking network operations on NetworkAdapterManager's worker
+// thread through the selected NetworkBackend. Every operation is
+// identified by the id the manager handed out; results come back through
+// signals, which the manager re-emits on the GUI thread.
+class NetworkWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit NetworkWorker(QObject *parent = nullptr);
+
+    void initialize();
+    void fetchAdapters(quint64 operationId);
+    void fetchAdapterState(quint64 operationId, const QString &adapterName);
+    void fetchNetworkState(quint64 operationId);
+    void checkAdmin(quint64 operationId);
+    // With captureRevert, revertPrepared() carries the inverse of what is
+    // about to change before the adapter is touched
+    void applyConfig(quint64 operationId, const QString &adapterName, const IpConfig &config,
+                     bool captureRevert = false);
+    // Runs a precomputed delta as is, without reading the state first
+    void applyDelta(quint64 operationId, const QString &adapterName, const ConfigDelta &delta);
+
+    // Thread-safe
+    void cancel(quint64 operationId);
+    void cancelAll();
+
+signals:
+    void adaptersReady(quint64 operationId, const QVector<NetworkAdapter> &adapters);
+    void adapterStateReady(quint64 operationId, const AdapterState &state);
+    void networkStateReady(quint64 operationId, const NetworkState &state);
+    void adminStatusReady(quint64 operationId, bool isAdmin);
+    void operationProgress(quint64 operationId, int step, int totalSteps, const QString &description);
+    void operationFinished(quint64 operationId, bool success, const QString &message);
+    void revertPrepared(quint64 operationId, const ConfigDelta &revert);
+    void adaptersChanged();
+    void watchingStarted(bool available);
+    void backendReady(bool canSetDns);
+
+private:
+    bool beginOperation(quint64 operationId);
+    void endOperation();
+    NetworkBackend *backend();
+
+    NetworkBackend *m_backend;  // Created on the worker thread
+
+    QMutex m_mutex;
+    QSet<quint64> m_cancelled;
+    quint64 m_currentOperation;
+    bool m_cancelAll;
+};
+
+#endif // NETWORKWORKER_H
@@ -0,0 +1,425 @@
+#include "ShellHost.h"
+#include "CommandDeadlines.h"
+#include "CommandMetrics.h"
+#include "CommandTrace.h"
+#include <QProcess>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QtGlobal>
+#include <QDebug>
+
+namespace {
+
+// Host loop run inside PowerShell. Each request is decoded, evaluated and
+// answered between sentinels so the caller can split the output stream.
+const char *const kPowerShellLoop = R"PS(
+[Console]::OutputEncoding = [System.Text.Encoding]::UTF8
+$ProgressPreference = 'SilentlyContinue'
+while ($true) {
+    $line = [Console]::In.ReadLine()
+    if ($null -eq $line) { break }
+    if ($line -notmatch '^@@REQ (\d+) (\S*)$') { continue }
+    $id = $Matches[1]
+    $RequestId = $id
+    $script = [System.Text.Encoding]::UTF8.GetString([System.Convert]::FromBase64String($Matches[2]))
+    $global:LASTEXITCODE = 0
+    $code = 0
+    try {
+        $out = Invoke-Expression $script 2>&1 | Out-String -Width 4096
+        if ($LASTEXITCODE) { $code = $LASTEXITCODE }
+    } catch {
+        $out = $_ | Out-String
+        $code = 1
+    }
+    [Console]::Out.Write("@@BEGIN $id`n$out`n@@END $id $code`n")
+    [Console]::Out.Flush()
+}
+)PS";
+
+// Same protocol for POSIX shells, used on non-Windows builds.
+const char *const kShLoop = R"SH(
+while IFS= read -r line; do
+    case "$line" in
+        "@@REQ "*) ;;
+        *) continue ;;
+    esac
+    set -- $line
+    id=$2
+    RequestId=$id
+    export RequestId
+    script=$(printf '%s' "$3" | base64 -d)
+    out=$(sh -c "$script" 2>&1)
+    code=$?
+    printf '@@BEGIN %s\n%s\n@@END %s %s\n' "$id" "$out" "$id" "$code"
+done
+)SH";
+
+const int kRestartDelayMs = 500;
+const int kMaxRestarts = 20;
+const int kPollIntervalMs = 50;  // How often a blocked request checks for cancellation
+
+} // namespace
+
+ShellHost::ShellHost(QObject *parent)
+    : QObject(parent)
+    , m_process(nullptr)
+    , m_nextId(1)
+    , m_currentId(0)
+    , m_restarts(0)
+    , m_restartsSinceAnswer(0)
+    , m_stopping(false)
+    , m_cancelRequested(false)
+{
+}
+
+ShellHost::~ShellHost()
+{
+    stop();
+}
+
+ShellResult ShellHost::execute(const QString &kind, const QString &script, int timeoutMs,
+                               const ProgressCallback &onProgress)
+{
+    CommandDeadlines *deadlines = CommandDeadlines::instance();
+
+    for (int attempt = 0;; ++attempt) {
+        const int deadlineMs = deadlines->timeoutMs(kind, timeoutMs, attempt);
+        QElapsedTimer timer;
+        timer.start();
+
+        ShellResult result = executeOnce(kind, script, deadlineMs, onProgress);
+        if (!result.timedOut) {
+            if (result.ok) {
+                deadlines->recordLatency(kind, timer.nsecsElapsed() / 1000);
+            }
+            return result;
+        }
+
+        const bool retrying = attempt < deadlines->maxRetries(kind) && !m_cancelRequested;
+        deadlines->recordTimeout(kind, deadlineMs, attempt, retrying);
+        if (!retrying) {
+            return result;
+        }
+
+        // Spread out retries from several workers hitting the same slow host
+        const int delayMs = deadlines->retryDelayMs(attempt);
+        qDebug() << "Retrying" << kind << "in" << delayMs << "ms";
+        QElapsedTimer backoff;
+        backoff.start();
+        while (backoff.elapsed() < delayMs) {
+            if (m_cancelRequested) {
+                m_cancelRequested = false;
+                result = ShellResult();
+                result.cancelled = true;
+                return result;
+            }
+            QThread::msleep(qMin<qint64>(delayMs - backoff.elapsed(), kPollIntervalMs));
+        }
+    }
+}
+
+ShellResult ShellHost::executeOnce(const QString &kind, const QString &script, int timeoutMs,
+                                   const ProgressCallback &onProgress)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    CommandTrace *trace = CommandTrace::instance();
+    ShellResult result;
+
+    if (trace->isReplaying()) {
+        // No host process at all; the trace stands in for it
+        result = trace->replay(kind, script, timeoutMs, onProgress, m_cancelRequested);
+        if (result.cancelled) {
+            m_cancelRequested = false;
+        }
+    } else if (trace->isRecording()) {
+        CommandTrace::Entry entry;
+        const ProgressCallback recordProgress = [&entry, &timer, &onProgress](const QByteArray &payload) {
+            CommandTrace::Progress progress;
+            progress.offsetUs = timer.nsecsElapsed() / 1000;
+            progress.payload = payload;
+            entry.progress.append(progress);
+            if (onProgress) {
+                onProgress(payload);
+            }
+        };
+
+        result = run(script, timeoutMs, recordProgress);
+
+        entry.kind = kind;
+        entry.script = script;
+        entry.result = result;
+        entry.elapsedUs = timer.nsecsElapsed() / 1000;
+        trace->record(entry);
+    } else {
+        result = run(script, timeoutMs, onProgress);
+    }
+
+    CommandMetrics::Outcome outcome = CommandMetrics::Succeeded;
+    if (result.timedOut) {
+        outcome = CommandMetrics::TimedOut;
+    } else if (result.cancelled) {
+        outcome = CommandMetrics::Cancelled;
+    } else if (!result.ok || result.exitCode != 0) {
+        outcome = CommandMetrics::Failed;
+    }
+    CommandMetrics::instance()->record(kind, timer, outcome, result.output.size());
+
+    return result;
+}
+
+ShellResult ShellHost::run(const QString &script, int timeoutMs, const ProgressCallback &onProgress)
+{
+    ShellResult result;
+
+    if (!ensureStarted()) {
+        return result;
+    }
+
+    const quint64 id = m_nextId++;
+    m_waiting.insert(id);
+    if (onProgress) {
+        m_progress.insert(id, onProgress);
+    }
+
+    QByteArray frame = "@@REQ " + QByteArray::number(id) + ' ' + script.toUtf8().toBase64() + '\n';
+    m_process->write(frame);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!m_completed.contains(id)) {
+        const qint64 remaining = timeoutMs - timer.elapsed();
+        if (remaining <= 0) {
+            qWarning() << "Shell host request" << id << "timed out after" << timeoutMs << "ms, restarting host";
+            m_waiting.remove(id);
+            m_progress.remove(id);
+            result.timedOut = true;
+            restart();
+            return result;
+        }
+
+        if (m_cancelRequested) {
+            // The host may be stuck inside the command; a fresh one is cheaper
+            // than waiting for it
+            qDebug() << "Shell host request" << id << "cancelled, restarting host";
+            m_waiting.remove(id);
+            m_progress.remove(id);
+            m_cancelRequested = false;
+            result.cancelled = true;
+            restart();
+            return result;
+        }
+
+        if (m_process->state() != QProcess::Running) {
+            qWarning() << "Shell host died while running request" << id;
+            m_waiting.remove(id);
+            m_progress.remove(id);
+            restart();
+            return result;
+        }
+
+        // Emits readyRead, which feeds parseBuffer()
+        m_process->waitForReadyRead(int(qMin<qint64>(remaining, kPollIntervalMs)));
+    }
+
+    m_waiting.remove(id);
+    m_progress.remove(id);
+    m_restartsSinceAnswer = 0;
+    return m_completed.take(id);
+}
+
+void ShellHost::cancel()
+{
+    m_cancelRequested = true;
+}
+
+void ShellHost::clearCancel()
+{
+    m_cancelRequested = false;
+}
+
+bool ShellHost::isRunning() const
+{
+    return m_process && m_process->state() == QProcess::Running;
+}
+
+void ShellHost::restart()
+{
+    stop();
+    m_restarts++;
+    m_restartsSinceAnswer++;
+    if (ensureStarted()) {
+        emit hostRestarted();
+    }
+}
+
+int ShellHost::restartCount() const
+{
+    return m_restarts;
+}
+
+void ShellHost::onReadyRead()
+{
+    m_buffer.append(m_process->readAllStandardOutput());
+    parseBuffer();
+}
+
+void ShellHost::onHostFinished()
+{
+    if (m_stopping) {
+        return;
+    }
+
+    qWarning() << "Shell host exited unexpectedly with code" << m_process->exitCode();
+
+    // Keep a warm session ready for the next request, but do not spin if
+    // the host cannot be started at all. Cancels and timeouts restart it
+    // too, so only restarts without an answer in between count.
+    if (m_restartsSinceAnswer < kMaxRestarts) {
+        QTimer::singleShot(kRestartDelayMs, this, [this]() {
+            if (!isRunning()) {
+                restart();
+            }
+        });
+    }
+}
+
+bool ShellHost::ensureStarted()
+{
+    if (isRunning()) {
+        return true;
+    }
+
+    if (m_process) {
+        stop();
+    }
+
+    QString program;
+    QStringList arguments;
+    hostCommand(program, arguments);
+
+    m_process = new QProcess(this);
+    m_process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    connect(m_process, &QProcess::readyReadStandardOutput, this, &ShellHost::onReadyRead);
+    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &ShellHost::onHostFinished);
+
+    m_process->start(program, arguments);
+    CommandMetrics::instance()->recordSpawn("shell.host");
+    if (!m_process->waitForStarted(10000)) {
+        qWarning() << "Failed to start shell host:" << program << m_process->errorString();
+        return false;
+    }
+
+    return true;
+}
+
+void ShellHost::stop()
+{
+    if (!m_process) {
+        return;
+    }
+
+    m_stopping = true;
+    if (m_process->state() != QProcess::NotRunning) {
+        // The host loop exits on EOF; kill it if it is stuck in a command
+        m_process->closeWriteChannel();
+        if (!m_process->waitForFinished(1000)) {
+            m_process->kill();
+            m_process->waitForFinished(1000);
+        }
+    }
+    m_process->disconnect(this);
+    m_process->deleteLater();
+    m_process = nullptr;
+    m_stopping = false;
+
+    m_buffer.clear();
+    m_currentId = 0;
+    m_currentOutput.clear();
+    m_completed.clear();
+    m_progress.clear();
+}
+
+void ShellHost::parseBuffer()
+{
+    int start = 0;
+    int newline;
+
+    while ((newline = m_buffer.indexOf('\n', start)) >= 0) {
+        QByteArray line = m_buffer.mid(start, newline - start);
+        start = newline + 1;
+
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+
+        if (line.startsWith("@@PROGRESS ")) {
+            const int space = line.indexOf(' ', 11);
+            const quint64 id = line.mid(11, space < 0 ? -1 : space - 11).toULongLong();
+            const auto callback = m_progress.constFind(id);
+            if (callback != m_progress.constEnd()) {
+                (*callback)(space < 0 ? QByteArray() : line.mid(space + 1));
+            }
+            continue;
+        }
+
+        if (line.startsWith("@@BEGIN ")) {
+            m_currentId = line.mid(8).toULongLong();
+            m_currentOutput.clear();
+            continue;
+        }
+
+        if (line.startsWith("@@END ")) {
+            const QList<QByteArray> parts = line.mid(6).split(' ');
+            const quint64 id = parts.value(0).toULongLong();
+            if (id != 0 && id == m_currentId) {
+                if (m_waiting.contains(id)) {
+                    ShellResult result;
+                    result.ok = true;
+                    result.exitCode = parts.value(1).toInt();
+                    result.output = m_currentOutput;
+                    m_completed.insert(id, result);
+                }
+                m_currentId = 0;
+                m_currentOutput.clear();
+                continue;
+            }
+        }
+
+        // Anything outside a BEGIN/END pair is host noise and is dropped
+        if (m_currentId != 0) {
+            m_currentOutput.append(line);
+            m_currentOutput.append('\n');
+        }
+    }
+
+    m_buffer.remove(0, start);
+}
+
+void ShellHost::hostCommand(QString &program, QStringList &arguments)
+{
+    const QString custom = qEnvironmentVariable("IPTOOL_SHELL_HOST");
+    if (!custom.isEmpty()) {
+        program = custom;
+        arguments.clear();
+        return;
+    }
+
+#ifdef Q_OS_WIN
+    // -EncodedCommand avoids any quoting issues with the loop body
+    const QString loop = QString::fromUtf8(kPowerShellLoop);
+    const QByteArray utf16(reinterpret_cast<const char *>(loop.utf16()), loop.size() * 2);
+    program = "powershell";
+    arguments = QStringList() << "-NoLogo" << "-NoProfile" << "-NonInteractive"
+                              << "-ExecutionPolicy" << "Bypass"
+                              << "-EncodedCommand" << QString::fromLatin1(utf16.toBase64());
+#else
+    Q_UNUSED(kPowerShellLoop);
+    program = "/bin/sh";
+    arguments = QStringList() << "-c" << QString::fromUtf8(kShLoop);
+#endif
+}
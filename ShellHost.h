@@ -0,0 +1,92 @@
+#ifndef SHELLHOST_H
+#define SHELLHOST_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+
+class QProcess;
+
+struct ShellResult {
+    bool ok = false;        // The host answered with an end sentinel
+    bool timedOut = false;
+    bool cancelled = false;
+    int exitCode = -1;
+    QByteArray output;
+};
+
+// Long-lived shell session owned by NetworkAdapterManager.
+//
+// Requests are framed on the host's stdin as a single line:
+//     @@REQ <id> <base64 of the UTF-8 script>
+// and the host answers on stdout with:
+//     @@BEGIN <id>
+//     <merged stdout/stderr of the script>
+//     @@END <id> <exit code>
+//
+// Scripts may also write "@@PROGRESS <id> <payload>" lines at any time
+// ($RequestId holds the id); they are passed to the request's progress
+// callback as soon as they arrive.
+//
+// The host is PowerShell on Windows and /bin/sh elsewhere. Setting the
+// IPTOOL_SHELL_HOST environment variable replaces it with any executable
+// that speaks the same protocol (see tools/fake_shell_host.sh).
+// Requests can also be recorded to and replayed from a trace file; see
+// CommandTrace.
+class ShellHost : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ShellHost(QObject *parent = nullptr);
+    ~ShellHost();
+
+    using ProgressCallback = std::function<void(const QByteArray &payload)>;
+
+    // kind labels the request in CommandMetrics and CommandDeadlines, e.g.
+    // "netsh.readState". timeoutMs only applies until the kind's latency is
+    // known; a timed-out read is retried once with a longer deadline.
+    ShellResult execute(const QString &kind, const QString &script, int timeoutMs,
+                        const ProgressCallback &onProgress = ProgressCallback());
+    void cancel();        // Thread-safe; aborts the request in flight
+    void clearCancel();   // Thread-safe; drops a cancel that arrived too late
+    bool isRunning() const;
+    void restart();
+    int restartCount() const;
+
+signals:
+    void hostRestarted();
+
+private slots:
+    void onReadyRead();
+    void onHostFinished();
+
+private:
+    ShellResult executeOnce(const QString &kind, const QString &script, int timeoutMs,
+                            const ProgressCallback &onProgress);
+    ShellResult run(const QString &script, int timeoutMs, const ProgressCallback &onProgress);
+    bool ensureStarted();
+    void stop();
+    void parseBuffer();
+    static void hostCommand(QString &program, QStringList &arguments);
+
+    QProcess *m_process;
+    QByteArray m_buffer;
+    quint64 m_nextId;
+    quint64 m_currentId;            // Response currently being collected, 0 if none
+    QByteArray m_currentOutput;
+    QSet<quint64> m_waiting;
+    QHash<quint64, ShellResult> m_completed;
+    QHash<quint64, ProgressCallback> m_progress;
+    int m_restarts;
+    int m_restartsSinceAnswer;      // Reset whenever a request gets its response
+    bool m_stopping;
+    std::atomic_bool m_cancelRequested;
+};
+
+#endif // SHELLHOST_H
@@ -0,0 +1,599 @@
+// Benchmarks for the hot paths: adapter output parsing, the profile store
+// and the profile table. Everything runs against FakeBackend and a private
+// QStandardPaths test location, so the suite is safe to run headless on a
+// build box. See bench/README.md for baselines and comparisons.
+
+#include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QStandardPaths>
+#include <QtTest>
+#include "BinaryConfigStore.h"
+#include "ConfigDelta.h"
+#include "ConfigTransfer.h"
+#include "CsvReader.h"
+#include "FakeBackend.h"
+#include "IpConfigManager.h"
+#include "MainWindow.h"
+#include "NetshBackend.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int kAdapters = 8;  // Profiles are spread over this many adapters
+
+QByteArray adapterCsv(int rows)
+{
+    QByteArray csv = "\"Name\",\"InterfaceDescription\",\"InterfaceGuid\"\r\n";
+    for (int i = 0; i < rows; ++i) {
+        const NetworkAdapter adapter = FakeBackend::adapter(i);
+        // Every third description has a comma, like real team/VLAN names
+        const QString description = i % 3 == 0 ? adapter.description + ", VLAN " + QString::number(i)
+                                                : adapter.description;
+        csv += QString("\"%1\",\"%2\",\"{%3}\"\r\n")
+                   .arg(adapter.name, description, adapter.guid).toUtf8();
+    }
+    return csv;
+}
+
+IpConfig profile(int index)
+{
+    IpConfig config;
+    config.name = QString("Profile %1").arg(index);
+    config.ipAddress = QString("192.168.%1.%2").arg((index / 250) % 250).arg(index % 250 + 2);
+    config.subnetMask = "255.255.255.0";
+    config.gateway = QString("192.168.%1.1").arg((index / 250) % 250);
+    config.dns1 = "8.8.8.8";
+    config.dns2 = "8.8.4.4";
+    config.isDhcp = index % 10 == 0;
+    config.adapterGuid = FakeBackend::adapter(index % kAdapters).guid;
+    return config;
+}
+
+QString configFilePath()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    return dir + "/ip_configs.json";
+}
+
+// Profile store files; a journal or checkpoint left by an earlier case
+// would be loaded too
+void removeStore()
+{
+    QFile::remove(configFilePath());
+    QFile::remove(configFilePath() + ".journal");
+    QFile::remove(QFileInfo(configFilePath()).path() + "/ip_configs.bin");
+}
+
+// Writes a store with the given number of profiles in IpConfigManager's
+// format, without going through the manager
+void writeStore(int count)
+{
+    QJsonArray array;
+    for (int i = 0; i < count; ++i) {
+        const IpConfig config = profile(i);
+        QJsonObject obj;
+        obj["id"] = i + 1;
+        obj["name"] = config.name;
+        obj["ipAddress"] = config.ipAddress;
+        obj["subnetMask"] = config.subnetMask;
+        obj["gateway"] = config.gateway;
+        obj["dns1"] = config.dns1;
+        obj["dns2"] = config.dns2;
+        obj["isDhcp"] = config.isDhcp;
+        obj["adapterGuid"] = config.adapterGuid;
+        array.append(obj);
+    }
+
+    removeStore();
+
+    QFile file(configFilePath());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qFatal("Cannot write %s", qPrintable(file.fileName()));
+    }
+    file.write(QJsonDocument(array).toJson(QJsonDocument::Compact));
+}
+
+// The same store as a binary checkpoint (IPTOOL_STORE_FORMAT=binary)
+void writeBinaryStore(int count)
+{
+    QVector<IpConfig> configs;
+    configs.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        configs.append(profile(i));
+        configs.last().id = i + 1;
+    }
+
+    removeStore();
+
+    QFile file(QFileInfo(configFilePath()).path() + "/ip_configs.bin");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qFatal("Cannot write %s", qPrintable(file.fileName()));
+    }
+    file.write(BinaryConfigStore::encode(configs));
+}
+
+// Managers created in its scope use the binary checkpoint
+struct BinaryStoreScope
+{
+    BinaryStoreScope() { qputenv("IPTOOL_STORE_FORMAT", "binary"); }
+    ~BinaryStoreScope() { qunsetenv("IPTOOL_STORE_FORMAT"); }
+};
+
+// Resident set size of this process, or -1 where it is not measured
+qint64 residentBytes()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return qint64(counters.WorkingSetSize);
+    }
+    return -1;
+#elif defined(Q_OS_LINUX)
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.size() > 1 ? fields[1].toLongLong() * sysconf(_SC_PAGESIZE) : -1;
+#else
+    return -1;
+#endif
+}
+
+void addSizes()
+{
+    QTest::addColumn<int>("profiles");
+    QTest::newRow("10") << 10;
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("100k") << 100000;
+}
+
+void addRowCounts()
+{
+    QTest::addColumn<int>("rows");
+    QTest::newRow("10") << 10;
+    QTest::newRow("100") << 100;
+    QTest::newRow("1k") << 1000;
+}
+
+} // namespace
+
+class ChangeIPToolBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    // Adapter enumeration output
+    void parseAdapterCsv_data() { addRowCounts(); }
+    void parseAdapterCsv();
+    void csvReader_data() { addRowCounts(); }
+    void csvReader();
+    void csvSplit_data() { addRowCounts(); }
+    void csvSplit();
+    void configDelta();
+
+    // Profile store
+    void configLoad_data() { addSizes(); }
+    void configLoad();
+    void configLoadBinary_data() { addSizes(); }
+    void configLoadBinary();
+    void configsForAdapterBinary_data() { addSizes(); }
+    void configsForAdapterBinary();
+    void configResidentMemory_data();
+    void configResidentMemory();
+    void bulkImport_data();
+    void bulkImport();
+    void configSave_data() { addSizes(); }
+    void configSave();
+    void configAdd_data() { addSizes(); }
+    void configAdd();
+    void configUpdate_data() { addSizes(); }
+    void configUpdate();
+    void configsForAdapter_data() { addSizes(); }
+    void configsForAdapter();
+    void configBatch_data() { addSizes(); }
+    void configBatch();
+    void configExternalMerge_data() { addSizes(); }
+    void configExternalMerge();
+    void configSearch_data();
+    void configSearch();
+    void configConflicts_data() { addSizes(); }
+    void configConflicts();
+
+    // Profile table
+    void refreshConfigList_data() { addSizes(); }
+    void refreshConfigList();
+};
+
+void ChangeIPToolBench::initTestCase()
+{
+    removeStore();
+}
+
+void ChangeIPToolBench::cleanupTestCase()
+{
+    removeStore();
+}
+
+void ChangeIPToolBench::parseAdapterCsv()
+{
+    QFETCH(int, rows);
+    const QByteArray csv = adapterCsv(rows);
+
+    QVector<NetworkAdapter> adapters;
+    QBENCHMARK {
+        adapters = NetshBackend::parseAdapterCsv(csv);
+    }
+    QCOMPARE(adapters.size(), rows);
+}
+
+void ChangeIPToolBench::csvReader()
+{
+    QFETCH(int, rows);
+    const QByteArray csv = adapterCsv(rows);
+
+    qsizetype bytes = 0;
+    QBENCHMARK {
+        CsvReader reader(csv);
+        while (reader.readRecord()) {
+            for (int i = 0; i < reader.fieldCount(); ++i) {
+                bytes += reader.field(i).size();
+            }
+        }
+    }
+    QVERIFY(bytes > 0);
+}
+
+void ChangeIPToolBench::csvSplit()
+{
+    // The decode/split/strip-quotes approach CsvReader replaced, for
+    // comparison with csvReader
+    QFETCH(int, rows);
+    const QByteArray csv = adapterCsv(rows);
+
+    qsizetype fields = 0;
+    QBENCHMARK {
+        const QStringList lines = QString::fromUtf8(csv).split('\n');
+        for (const QString &line : lines) {
+            QString unquoted = line.trimmed();
+            unquoted.remove('"');
+            fields += unquoted.split(',').size();
+        }
+    }
+    QVERIFY(fields > 0);
+}
+
+void ChangeIPToolBench::configDelta()
+{
+    FakeBackend backend;
+    const AdapterState state = backend.readState(FakeBackend::adapter(0).name);
+    const IpConfig config = profile(1);
+
+    int changes = 0;
+    QBENCHMARK {
+        changes += ConfigDelta::compute(state, config).changes();
+    }
+    QVERIFY(changes != 0);
+}
+
+void ChangeIPToolBench::configLoad()
+{
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    IpConfigManager manager;
+    QBENCHMARK {
+        manager.loadFromFile();
+    }
+    QCOMPARE(manager.getConfigs().size(), profiles);
+}
+
+void ChangeIPToolBench::configLoadBinary()
+{
+    QFETCH(int, profiles);
+    writeBinaryStore(profiles);
+
+    BinaryStoreScope binary;
+    IpConfigManager manager;
+    QBENCHMARK {
+        manager.loadFromFile();
+    }
+    QCOMPARE(manager.getConfigs().size(), profiles);
+}
+
+void ChangeIPToolBench::configsForAdapterBinary()
+{
+    // Decodes the adapter's profiles from the loaded file on every call
+    QFETCH(int, profiles);
+    writeBinaryStore(profiles);
+
+    BinaryStoreScope binary;
+    IpConfigManager manager;
+    const QString guid = FakeBackend::adapter(kAdapters - 1).guid;
+    qsizetype found = 0;
+    QBENCHMARK {
+        found += manager.getConfigsForAdapter(guid).size();
+    }
+    QVERIFY(profiles < kAdapters || found > 0);
+}
+
+void ChangeIPToolBench::configResidentMemory_data()
+{
+    QTest::addColumn<bool>("binary");
+    QTest::newRow("json/100k") << false;
+    QTest::newRow("binary/100k") << true;
+}
+
+void ChangeIPToolBench::configResidentMemory()
+{
+    // Growth of the resident set from loading the store, reported as the
+    // result. Memory freed by earlier cases is reused, so for exact numbers
+    // run one row on its own: ChangeIPTool_bench configResidentMemory:binary/100k
+    QFETCH(bool, binary);
+    const int profiles = 100000;
+    if (residentBytes() < 0) {
+        QSKIP("Resident memory is not measured on this platform");
+    }
+
+    if (binary) {
+        writeBinaryStore(profiles);
+        qputenv("IPTOOL_STORE_FORMAT", "binary");
+    } else {
+        writeStore(profiles);
+    }
+
+    const qint64 before = residentBytes();
+    IpConfigManager *manager = new IpConfigManager;
+    const qint64 after = residentBytes();
+    const int loaded = int(manager->getConfigs().size());
+    delete manager;
+    qunsetenv("IPTOOL_STORE_FORMAT");
+
+    QCOMPARE(loaded, profiles);
+    QTest::setBenchmarkResult(qreal(after - before), QTest::BytesAllocated);
+}
+
+void ChangeIPToolBench::bulkImport_data()
+{
+    QTest::addColumn<QString>("suffix");
+    QTest::addColumn<int>("profiles");
+    QTest::newRow("csv/1k") << QString("csv") << 1000;
+    QTest::newRow("csv/100k") << QString("csv") << 100000;
+    QTest::newRow("json/1k") << QString("json") << 1000;
+    QTest::newRow("json/100k") << QString("json") << 100000;
+}
+
+void ChangeIPToolBench::bulkImport()
+{
+    // Reading, validating and committing a file into an empty store
+    QFETCH(QString, suffix);
+    QFETCH(int, profiles);
+
+    QVector<IpConfig> configs;
+    configs.reserve(profiles);
+    for (int i = 0; i < profiles; ++i) {
+        configs.append(profile(i));
+    }
+    const QString fileName = QFileInfo(configFilePath()).path() + "/import." + suffix;
+    QVERIFY(ConfigTransfer::exportFile(fileName, configs));
+
+    ImportResult result;
+    QBENCHMARK {
+        writeStore(0);
+        IpConfigManager manager;
+        result = ConfigTransfer::importFile(fileName, QString());
+        manager.addConfigs(result.configs);
+    }
+    QFile::remove(fileName);
+
+    QCOMPARE(int(result.configs.size()), profiles);
+    QVERIFY(result.errors.isEmpty());
+}
+
+void ChangeIPToolBench::configSave()
+{
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    IpConfigManager manager;
+    QBENCHMARK {
+        manager.saveToFile();
+    }
+}
+
+void ChangeIPToolBench::configAdd()
+{
+    // Each add grows the store by one; against the sizes measured here the
+    // drift over a run is negligible
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    IpConfigManager manager;
+    const IpConfig config = profile(profiles);
+    QBENCHMARK {
+        manager.addConfig(config);
+    }
+}
+
+void ChangeIPToolBench::configUpdate()
+{
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    IpConfigManager manager;
+    const quint64 id = manager.getConfigs().at(profiles / 2).id;
+    IpConfig config = profile(profiles / 2);
+    config.gateway = "192.168.0.254";
+    QBENCHMARK {
+        manager.updateConfig(id, config);
+    }
+}
+
+void ChangeIPToolBench::configsForAdapter()
+{
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    IpConfigManager manager;
+    const QString guid = FakeBackend::adapter(kAdapters - 1).guid;
+    qsizetype found = 0;
+    QBENCHMARK {
+        found += manager.getConfigsForAdapter(guid).size();
+    }
+    QVERIFY(profiles < kAdapters || found > 0);
+}
+
+void ChangeIPToolBench::configBatch()
+{
+    // Removing a selection of up to 100 profiles in a batch, including the
+    // snapshot taken for it. Rolled back, so every iteration sees the same
+    // store.
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    IpConfigManager manager;
+    const QVector<IpConfig> configs = manager.getConfigs();
+    const int selection = qMin(100, profiles);
+    QBENCHMARK {
+        ConfigBatch batch(&manager);
+        for (int i = 0; i < selection; ++i) {
+            manager.removeConfig(configs[i].id);
+        }
+    }
+    QCOMPARE(int(manager.getConfigs().size()), profiles);
+}
+
+void ChangeIPToolBench::configExternalMerge()
+{
+    // Another process appending one change to the journal, and this one
+    // noticing and merging it
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    IpConfigManager manager;
+    IpConfig config = manager.getConfigs().at(profiles / 2);
+    QFile journal(configFilePath() + ".journal");
+    int merged = 0;
+    connect(&manager, &IpConfigManager::configsChanged, [&merged](const ConfigChangeSet &changes) {
+        merged += int(changes.updated.size());
+    });
+
+    int appended = 0;
+    QBENCHMARK {
+        config.gateway = appended++ % 2 ? "192.168.0.254" : "192.168.0.253";
+        QJsonObject record;
+        record["op"] = "update";
+        record["config"] = IpConfigManager::serializeIpConfig(config);
+        if (!journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qFatal("Cannot write %s", qPrintable(journal.fileName()));
+        }
+        journal.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+        journal.close();
+
+        manager.mergeExternalChanges();
+    }
+    QCOMPARE(merged, appended);
+}
+
+void ChangeIPToolBench::configSearch_data()
+{
+    QTest::addColumn<QString>("query");
+    QTest::addColumn<int>("profiles");
+    for (int profiles : { 1000, 100000 }) {
+        const QString size = profiles == 1000 ? "1k" : "100k";
+        QTest::newRow(qPrintable("name/" + size)) << QString("profile 12") << profiles;
+        QTest::newRow(qPrintable("subnet/" + size)) << QString("192.168.1.0/24") << profiles;
+        QTest::newRow(qPrintable("address/" + size)) << QString("192.168.1.7") << profiles;
+    }
+}
+
+void ChangeIPToolBench::configSearch()
+{
+    // One keystroke's worth of searching in the main window; the first
+    // search, which builds the indexes, is not measured
+    QFETCH(QString, query);
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    IpConfigManager manager;
+    const QString adapterGuid = FakeBackend::adapter(0).guid;
+    QVector<quint64> ids = manager.searchConfigs(query, adapterGuid);
+    QBENCHMARK {
+        ids = manager.searchConfigs(query, adapterGuid);
+    }
+    QVERIFY(!ids.isEmpty());
+}
+
+void ChangeIPToolBench::configConflicts()
+{
+    // An update once conflicts are tracked: the profile leaves the
+    // indexes, and its conflicts are found again and counted on both sides
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    IpConfigManager manager;
+    const quint64 id = manager.getConfigs().at(profiles / 2).id;
+    IpConfig config = profile(profiles / 2);
+    manager.hasConflicts(id);
+
+    int updates = 0;
+    QBENCHMARK {
+        // Alternately inside and outside the subnet
+        config.gateway = updates++ % 2 ? "10.0.0.1" : "192.168.0.1";
+        manager.updateConfig(id, config);
+    }
+    QCOMPARE(manager.hasConflicts(id), config.gateway == "10.0.0.1");
+}
+
+void ChangeIPToolBench::refreshConfigList()
+{
+    QFETCH(int, profiles);
+    writeStore(profiles);
+
+    // The window loads the store written above and talks to FakeBackend
+    MainWindow window;
+    const QString guid = FakeBackend::adapter(0).guid;
+    QBENCHMARK {
+        window.refreshConfigList(guid);
+    }
+    QCOMPARE(window.m_configTableWidget->rowCount(),
+             int(window.m_ipConfigManager->getConfigsForAdapter(guid).size()));
+}
+
+int main(int argc, char *argv[])
+{
+    // Headless and hermetic by default
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    qputenv("IPTOOL_BACKEND", "fake");
+    QStandardPaths::setTestModeEnabled(true);
+
+    QApplication app(argc, argv);
+    app.setApplicationName("ChangeIPTool_bench");
+    app.setOrganizationName("IPTool");
+
+    // Store writes log one line each; keep the output readable
+    QLoggingCategory::setFilterRules("default.debug=false");
+
+    ChangeIPToolBench bench;
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "ChangeIPToolBench.moc"
@@ -0,0 +1,25 @@
+// libFuzzer entry point for CsvReader; see IPTOOL_BUILD_FUZZERS in
+// CMakeLists.txt. Seeds live in fuzz/corpus/csv.
+
+#include "CsvReader.h"
+#include <cstdint>
+#include <cstddef>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    CsvReader reader(QByteArrayView(reinterpret_cast<const char *>(data), qsizetype(size)));
+
+    volatile qsizetype total = 0;
+    while (reader.readRecord()) {
+        for (int i = 0; i < reader.fieldCount(); ++i) {
+            const QByteArrayView field = reader.field(i);
+            total += field.size();
+            total += reader.text(i).size();
+        }
+        // Out of range fields must be empty, not crash
+        total += reader.field(reader.fieldCount()).size();
+        total += reader.text(-1).size();
+    }
+
+    return 0;
+}
@@ -1,9 +1,22 @@
 #include <QApplication>
+#include <QCoreApplication>
 #include <QTextCodec>
+#include <cstring>
 #include "MainWindow.h"
+#include "HelperServer.h"
 
 int main(int argc, char *argv[])
 {
+    // Privileged helper mode: no window, just the local socket server
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--helper") == 0) {
+            QCoreApplication app(argc, argv);
+            app.setApplicationName("ChangeIPTool");
+            const QString serverName = i + 1 < argc ? QString::fromLocal8Bit(argv[i + 1]) : QString();
+            return HelperServer::run(serverName);
+        }
+    }
+
     QApplication app(argc, argv);
 
     // Set codec for Chinese character support
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Compare ChangeIPTool_bench results against bench/baseline.json.
+
+    ./ChangeIPTool_bench -o bench.xml,xml
+    tools/bench_compare.py bench.xml                # report, exit 1 on regressions
+    tools/bench_compare.py bench.xml --update       # record as the new baseline
+
+Values are per iteration, in the metric QTest reports (walltime ms by
+default). A benchmark regresses when it is slower than the baseline by more
+than --threshold percent. --update also records the machine and Qt build
+the results came from; comparing against an empty baseline, or one from
+another machine, is an error rather than a silent pass.
+"""
+
+import argparse
+import json
+import os
+import platform
+import socket
+import sys
+import time
+import xml.etree.ElementTree as ET
+
+DEFAULT_BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "..", "bench", "baseline.json")
+
+
+def read_environment(root):
+    machine = {
+        "host": socket.gethostname(),
+        "os": platform.platform(),
+        "cpu": platform.processor() or platform.machine(),
+    }
+    environment = root.find("Environment")
+    if environment is not None:
+        machine["qt"] = (environment.findtext("QtVersion") or "").strip()
+        machine["qt_build"] = (environment.findtext("QtBuild") or "").strip()
+    return machine
+
+
+def read_results(path):
+    results = {}
+    root = ET.parse(path).getroot()
+    for function in root.iter("TestFunction"):
+        name = function.get("name")
+        for result in function.iter("BenchmarkResult"):
+            tag = result.get("tag") or ""
+            iterations = max(1, int(result.get("iterations", "1")))
+            key = "%s/%s" % (name, tag) if tag else name
+            results[key] = {
+                "metric": result.get("metric"),
+                "value": float(result.get("value")) / iterations,
+            }
+    return results, read_environment(root)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("results", help="QTest XML output (-o file.xml,xml)")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE)
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed slowdown in percent (default 10)")
+    parser.add_argument("--update", action="store_true",
+                        help="write the results as the new baseline")
+    args = parser.parse_args()
+
+    current, machine = read_results(args.results)
+    if not current:
+        sys.exit("No benchmark results in %s" % args.results)
+
+    if args.update:
+        with open(args.baseline, "w") as f:
+            json.dump({"version": 1,
+                       "recorded": time.strftime("%Y-%m-%d"),
+                       "machine": machine,
+                       "results": current}, f, indent=4, sort_keys=True)
+            f.write("\n")
+        print("Baseline updated with %d results from %s" % (len(current), machine["host"]))
+        return 0
+
+    try:
+        with open(args.baseline) as f:
+            recorded = json.load(f)
+    except FileNotFoundError:
+        recorded = {}
+    baseline = recorded.get("results", {})
+    if not baseline:
+        sys.exit("Baseline %s has no results; record one on the reference machine "
+                 "with --update" % args.baseline)
+
+    recorded_on = recorded.get("machine", {})
+    print("Baseline recorded %s on %s (%s, Qt %s)" % (
+        recorded.get("recorded", "?"), recorded_on.get("host", "?"),
+        recorded_on.get("cpu", "?"), recorded_on.get("qt", "?")))
+    if recorded_on.get("host") != machine["host"]:
+        sys.exit("Results are from %s, not the baseline machine; timings are not comparable"
+                 % machine["host"])
+
+    regressions = 0
+    print("%-45s %14s %14s %9s" % ("benchmark", "baseline", "current", "change"))
+    for key in sorted(set(current) | set(baseline)):
+        old = baseline.get(key)
+        new = current.get(key)
+        if new is None:
+            print("%-45s %14.4f %14s %9s" % (key, old["value"], "-", "missing"))
+            continue
+        if old is None or old.get("metric") != new["metric"]:
+            print("%-45s %14s %14.4f %9s" % (key, "-", new["value"], "new"))
+            continue
+
+        change = (new["value"] - old["value"]) / old["value"] * 100 if old["value"] else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  improved"
+        print("%-45s %14.4f %14.4f %+8.1f%%%s" % (key, old["value"], new["value"], change, flag))
+
+    if regressions:
+        print("\n%d benchmark(s) regressed by more than %.0f%%" % (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
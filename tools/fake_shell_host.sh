@@ -0,0 +1,74 @@
+#!/bin/sh
+# Stand-in for the PowerShell host used by ShellHost, so the whole
+# NetworkAdapterManager path can be exercised on Linux:
+#
+#     IPTOOL_SHELL_HOST=$PWD/tools/fake_shell_host.sh ./ChangeIPTool
+#
+# It speaks the same framed protocol (@@REQ / @@BEGIN / @@END) and answers
+# the PowerShell queries the manager sends with canned output. Anything it
+# does not recognise is run with sh.
+#
+# FAKE_SHELL_DELAY   seconds to sleep before each answer (timeout testing)
+# FAKE_SHELL_ADAPTERS  file with CSV to return for Get-NetAdapter
+
+answer() {
+    case "$1" in
+        *Get-NetAdapter*ConvertTo-Csv*)
+            if [ -n "$FAKE_SHELL_ADAPTERS" ] && [ -r "$FAKE_SHELL_ADAPTERS" ]; then
+                cat "$FAKE_SHELL_ADAPTERS"
+            else
+                echo '"Name","InterfaceDescription","InterfaceGuid"'
+                echo '"Ethernet","Intel(R) Ethernet Connection I219-V","{4D36E972-E325-11CE-BFC1-08002BE10318}"'
+                echo '"Wi-Fi","Intel(R) Wi-Fi 6 AX201 160MHz","{8E3C1F7A-55B2-4C1D-9A0E-2B7D9C4E6F11}"'
+            fi
+            ;;
+        *"ConvertTo-Json -InputObject"*)
+            # Snapshot of every adapter
+            echo '[{"Name":"Ethernet","Guid":"{4D36E972-E325-11CE-BFC1-08002BE10318}","Up":true,"Dhcp":false,"DnsDhcp":false,"Addresses":["192.168.1.100/24"],"Gateways":["192.168.1.1"],"Dns":["8.8.8.8","8.8.4.4"]},{"Name":"Wi-Fi","Guid":"{8E3C1F7A-55B2-4C1D-9A0E-2B7D9C4E6F11}","Up":false,"Dhcp":true,"DnsDhcp":true,"Addresses":[],"Gateways":[],"Dns":[]}]'
+            ;;
+        *ConvertTo-Json*)
+            echo '{"Name":"Ethernet","Guid":"{4D36E972-E325-11CE-BFC1-08002BE10318}","Up":true,"Dhcp":false,"DnsDhcp":false,"Addresses":["192.168.1.100/24"],"Gateways":["192.168.1.1"],"Dns":["8.8.8.8","8.8.4.4"]}'
+            ;;
+        *Get-NetIPAddress*)
+            echo '192.168.1.100'
+            ;;
+        *@@STEP*)
+            # Apply plan: report every netsh step as successful
+            steps=$(printf '%s\n' "$1" | grep -c '^\$steps += ')
+            i=0
+            while [ "$i" -lt "$steps" ]; do
+                echo "@@PROGRESS $RequestId $i 0"
+                echo "@@STEP $i 0"
+                echo 'Ok.'
+                i=$((i + 1))
+            done
+            ;;
+        *netsh*)
+            echo 'Ok.'
+            ;;
+        *)
+            sh -c "$1" 2>&1
+            ;;
+    esac
+}
+
+while IFS= read -r line; do
+    case "$line" in
+        "@@REQ "*) ;;
+        *) continue ;;
+    esac
+    set -- $line
+    id=$2
+    RequestId=$id
+    script=$(printf '%s' "$3" | base64 -d)
+    if [ "$script" = "__exit__" ]; then
+        # Simulates the host dying mid-request
+        exit 3
+    fi
+    if [ -n "$FAKE_SHELL_DELAY" ]; then
+        sleep "$FAKE_SHELL_DELAY"
+    fi
+    out=$(answer "$script")
+    code=$?
+    printf '@@BEGIN %s\n%s\n@@END %s %s\n' "$id" "$out" "$id" "$code"
+done